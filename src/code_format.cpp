@@ -0,0 +1,200 @@
+#include "code_format.h"
+#include "varint.h"
+#include <string.h>
+
+// Таблица по полубайтам: 16 слов вместо 256
+static const uint32_t codeCrcTable[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+uint32_t codeFormatCrc(uint32_t crc, const uint8_t *data, size_t len)
+{
+    crc = ~crc;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ codeCrcTable[crc & 0x0F];
+        crc = (crc >> 4) ^ codeCrcTable[crc & 0x0F];
+    }
+
+    return ~crc;
+}
+
+static void putLe32(uint8_t *buf, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        buf[i] = value >> (8 * i);
+}
+
+static uint32_t getLe32(const uint8_t *buf)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+        value |= (uint32_t)buf[i] << (8 * i);
+    return value;
+}
+
+void codeFormatInitHeader(CodeFileHeader &header)
+{
+    header.version = CODE_FORMAT_VERSION;
+    header.flags = 0;
+    header.count = 0;
+    header.lastId = 0;
+    header.recordsEnd = CODE_FORMAT_HEADER_LEN;
+    header.crc = 0;
+}
+
+size_t codeFormatEncodeHeader(uint8_t *buf, size_t size, const CodeFileHeader &header)
+{
+    if (size < CODE_FORMAT_HEADER_LEN)
+        return 0;
+
+    memcpy(buf, CODE_FORMAT_MAGIC, 4);
+    buf[4] = header.version;
+    buf[5] = header.flags;
+    buf[6] = buf[7] = 0;
+    putLe32(buf + 8, header.count);
+    putLe32(buf + 12, (uint32_t)header.lastId);
+    putLe32(buf + 16, header.recordsEnd);
+    putLe32(buf + 20, header.crc);
+
+    return CODE_FORMAT_HEADER_LEN;
+}
+
+bool codeFormatDecodeHeader(const uint8_t *buf, size_t len, CodeFileHeader &header)
+{
+    if (len < CODE_FORMAT_HEADER_LEN || memcmp(buf, CODE_FORMAT_MAGIC, 4) != 0 || buf[4] == 0 ||
+        buf[4] > CODE_FORMAT_VERSION)
+        return false;
+
+    header.version = buf[4];
+    header.flags = buf[5];
+    header.count = getLe32(buf + 8);
+    header.lastId = (int32_t)getLe32(buf + 12);
+    header.recordsEnd = getLe32(buf + 16);
+    header.crc = getLe32(buf + 20);
+
+    return header.recordsEnd >= CODE_FORMAT_HEADER_LEN;
+}
+
+// Длина перед данными: записи короче 128 байт, поэтому под нее резервируется один байт
+size_t codeFormatEncodeRecord(uint8_t *buf, size_t size, int prevId, const CodeRecord &record)
+{
+    uint8_t data[CODE_FORMAT_RECORD_MAX_LEN];
+    size_t len = 0;
+    size_t n;
+
+    uint64_t fields[] = {
+        zigzagEncode((int64_t)record.id - prevId),
+        zigzagEncode(record.protocol), // UNKNOWN = -1
+        record.address,
+        record.command,
+        record.bits,
+    };
+
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+    {
+        n = varintPut(data + len, sizeof(data) - len, fields[i]);
+        if (n == 0)
+            return 0;
+        len += n;
+    }
+
+    n = varintPut(buf, size, len);
+    if (n == 0 || n + len > size)
+        return 0;
+
+    memcpy(buf + n, data, len);
+    return n + len;
+}
+
+int codeFormatDecodeRecord(const uint8_t *buf, size_t len, int prevId, CodeRecord &record)
+{
+    uint64_t dataLen;
+    size_t headLen = varintGet(buf, len, dataLen);
+
+    if (headLen == 0)
+        return len >= VARINT_MAX_LEN ? -1 : 0;
+    if (dataLen == 0 || dataLen > CODE_FORMAT_RECORD_MAX_LEN)
+        return -1;
+    if (len < headLen + dataLen)
+        return 0;
+
+    const uint8_t *data = buf + headLen;
+    uint64_t fields[5] = {};
+    size_t pos = 0;
+
+    // Поля, которых нет в записи, остаются нулевыми; лишние поля новых версий пропускаются
+    for (size_t i = 0; i < 5 && pos < dataLen; i++)
+    {
+        size_t n = varintGet(data + pos, dataLen - pos, fields[i]);
+        if (n == 0)
+            return -1;
+        pos += n;
+    }
+
+    if (pos == 0 || fields[2] > UINT32_MAX || fields[3] > UINT32_MAX || fields[4] > UINT16_MAX)
+        return -1;
+
+    int64_t id = prevId + zigzagDecode(fields[0]);
+    if (id <= 0 || id > INT32_MAX)
+        return -1;
+
+    record.id = (int)id;
+    record.protocol = (int)zigzagDecode(fields[1]);
+    record.address = (uint32_t)fields[2];
+    record.command = (uint32_t)fields[3];
+    record.bits = (uint16_t)fields[4];
+
+    return headLen + dataLen;
+}
+
+size_t codeFormatEncodeName(uint8_t *buf, size_t size, int id, const char *name)
+{
+    size_t nameLen = strlen(name);
+
+    if (id <= 0 || nameLen > CODE_FORMAT_NAME_MAX_LEN)
+        return 0;
+
+    size_t len = varintPut(buf, size, id);
+    size_t n = len ? varintPut(buf + len, size - len, nameLen) : 0;
+
+    if (n == 0 || len + n + nameLen > size)
+        return 0;
+
+    len += n;
+    memcpy(buf + len, name, nameLen);
+    return len + nameLen;
+}
+
+int codeFormatDecodeName(const uint8_t *buf, size_t len, int &id, char *name, size_t size)
+{
+    uint64_t value;
+    uint64_t nameLen;
+    size_t pos = varintGet(buf, len, value);
+
+    if (pos == 0)
+        return len >= VARINT_MAX_LEN ? -1 : 0;
+    if (value == 0 || value > INT32_MAX)
+        return -1;
+
+    size_t n = varintGet(buf + pos, len - pos, nameLen);
+    if (n == 0)
+        return len - pos >= VARINT_MAX_LEN ? -1 : 0;
+    if (nameLen > CODE_FORMAT_NAME_MAX_LEN)
+        return -1;
+
+    pos += n;
+    if (len < pos + nameLen)
+        return 0;
+
+    // Слишком длинное для вызывающего имя обрезается, запись пропускается по длине целиком
+    size_t copy = nameLen < size ? (size_t)nameLen : size - 1;
+    memcpy(name, buf + pos, copy);
+    name[copy] = '\0';
+    id = (int)value;
+
+    return pos + nameLen;
+}
@@ -0,0 +1,58 @@
+#ifndef CODE_FORMAT_H
+#define CODE_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CODE_FORMAT_MAGIC "IRCD"       // Начало файла кодов
+#define CODE_FORMAT_VERSION 1          // Версия формата; файлы более новых версий не читаются
+#define CODE_FORMAT_HEADER_LEN 24      // См. CodeFileHeader, числа little-endian
+#define CODE_FORMAT_RECORD_MAX_LEN 40  // Запись целиком, с длиной
+#define CODE_FORMAT_NAME_MAX_LEN 64    // Имя в разделе имен
+#define CODE_FORMAT_FLAG_NAMES 0x01    // После записей идет раздел имен
+
+// Запись кода
+struct CodeRecord
+{
+    int id;
+    int protocol; // decode_type_t
+    uint32_t address;
+    uint32_t command;
+    uint16_t bits; // Длина кадра; 0 - по умолчанию для протокола
+};
+
+// Заголовок: магия (4), версия (1), флаги (1), резерв (2), число записей (4), ID последней записи (4),
+// конец записей - смещение раздела имен или места дозаписи (4), CRC-32 записей (4).
+// Последний ID и CRC позволяют дописывать записи, не читая файл
+struct CodeFileHeader
+{
+    uint8_t version;
+    uint8_t flags;
+    uint32_t count;
+    int32_t lastId;
+    uint32_t recordsEnd;
+    uint32_t crc;
+};
+
+// Двоичный файл кодов: заголовок, записи "длина (varint), данные", необязательный раздел имен.
+// В записи varint: разность ID с предыдущей записью (zigzag), протокол (zigzag), адрес, команда,
+// длина кадра. Поля, добавленные в следующих версиях, дописываются в конец записи, и старый
+// разбор пропускает их по длине. Раздел имен: число имен, затем пары "ID, имя (длина и байты)".
+// Без зависимостей от Arduino: файл можно разбирать и собирать на компьютере
+void codeFormatInitHeader(CodeFileHeader &header);
+size_t codeFormatEncodeHeader(uint8_t *buf, size_t size, const CodeFileHeader &header);
+bool codeFormatDecodeHeader(const uint8_t *buf, size_t len, CodeFileHeader &header); // false - другой формат или версия
+
+// Длина записи или 0, если она не помещается в buf. prevId - ID предыдущей записи файла (0 для первой)
+size_t codeFormatEncodeRecord(uint8_t *buf, size_t size, int prevId, const CodeRecord &record);
+// Длина записи; 0 - данных недостаточно; -1 - ошибка формата
+int codeFormatDecodeRecord(const uint8_t *buf, size_t len, int prevId, CodeRecord &record);
+
+// Элементы раздела имен: те же коды возврата
+size_t codeFormatEncodeName(uint8_t *buf, size_t size, int id, const char *name);
+int codeFormatDecodeName(const uint8_t *buf, size_t len, int &id, char *name, size_t size);
+
+// CRC-32 (IEEE), продолжаемая: crc - значение для уже обработанных данных, 0 в начале
+uint32_t codeFormatCrc(uint32_t crc, const uint8_t *data, size_t len);
+
+#endif // CODE_FORMAT_H
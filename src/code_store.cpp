@@ -0,0 +1,1405 @@
+#include "code_store.h"
+#include "name_index.h"
+#include "varint.h"
+#include <SD.h>
+#include <Preferences.h>
+#include <esp_heap_caps.h>
+
+#define CODE_STORE_READ_LEN 512          // Блок чтения и записи файла кодов
+#define CODE_STORE_LINE_LEN 64           // Максимальная длина строки текстового файла
+#define CODE_STORE_EXPORT_RECORDS 16     // Записей выгрузки /export за один захват мьютекса (буфер на стеке)
+#define CODE_STORE_PATH_LEN (DEVICE_NAME_LEN + 24) // Путь файла устройства с расширением .txt.bak
+#define CODE_STORE_UPDATE_MODE "r+"      // Дозапись с обновлением заголовка
+#define CODE_STORE_NVS_NAMESPACE "codes" // NVS: имя активного устройства
+#define CODE_ROUTES_NVS_NAMESPACE "code_routes" // NVS: канал излучателя устройства по его имени
+#define CODE_KEY_EMPTY INT32_MIN         // Пустая ячейка хеш-набора
+
+// Макрос для отладки
+#define DEBUG_CODE_STORE true
+
+extern SemaphoreHandle_t xMutex;
+
+// Страница файла устройства: смещение первой записи, ее ID и ID предыдущей записи (ID хранятся разностями)
+struct CodePage
+{
+    uint32_t offset;
+    int firstId;
+    int prevId;
+};
+
+struct CodeDevice
+{
+    char name[DEVICE_NAME_LEN];
+    bool indexed; // Файл просканирован, таблица страниц построена
+    bool sorted;  // ID идут по возрастанию - поиск страницы двоичный
+    uint8_t channel; // Канал излучателя по умолчанию
+    bool readOnly;   // Файл другого формата или новой версии - дозапись запрещена
+    int count;
+    int maxId;
+    CodePage *pages; // В PSRAM
+    int pagesCapacity;
+    uint32_t fileBytes; // Метрики индексации, см. CodeStoreStats
+    uint32_t textBytes;
+    uint32_t indexUs;
+    bool damaged;
+};
+
+// Страница кэша записей
+struct CodeCachePage
+{
+    int device; // -1 - свободна
+    int page;
+    uint32_t lastUse;
+    int count;
+    CodeRecord records[CODE_PAGE_RECORDS];
+};
+
+// Ключ хеш-набора для поиска дубликатов: кадры разной длины (Sony 12/15/20) - разные коды
+struct CodeKey
+{
+    int32_t protocol;
+    uint32_t address;
+    uint32_t command;
+    uint16_t bits;
+};
+
+CodeDevice codeDevices[CODE_MAX_DEVICES];
+int codeDevicesCount = 0;
+int activeDevice = 0;
+int codesMaxId = 0;
+
+CodeCachePage *codeCache = NULL;
+int codeCachePages = 0;
+uint32_t codeCacheClock = 0;
+
+// Хеш-набор (protocol, address, command, bits) по всем устройствам, в PSRAM
+CodeKey *codeKeys = NULL;
+uint32_t codeKeysCapacity = 0;
+uint32_t codeKeysCount = 0;
+bool codeKeysLost = false; // Не хватило памяти - дубликаты ищутся перебором страниц
+
+CodeStoreStats codeStats; // Перенос текстовых файлов; метрики индексации - в CodeDevice
+
+// Крупные таблицы - в PSRAM, при ее отсутствии - во внутренней памяти
+void *codeStoreAlloc(size_t size)
+{
+    void *ptr = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    return ptr ? ptr : malloc(size);
+}
+
+void *codeStoreRealloc(void *ptr, size_t size)
+{
+    void *moved = heap_caps_realloc(ptr, size, MALLOC_CAP_SPIRAM);
+    return moved ? moved : realloc(ptr, size);
+}
+
+uint32_t codeHash(int protocol, uint32_t address, uint32_t command, uint16_t bits)
+{
+    uint32_t h = (uint32_t)protocol * 0x9E3779B1UL;
+    h ^= address + 0x7F4A7C15UL + (h << 6) + (h >> 2);
+    h ^= command + 0x7F4A7C15UL + (h << 6) + (h >> 2);
+    h ^= bits + 0x7F4A7C15UL + (h << 6) + (h >> 2);
+    h ^= h >> 16;
+    h *= 0x85EBCA6BUL;
+    h ^= h >> 13;
+    return h;
+}
+
+// Вызывается под xMutex
+void codeKeyPut(CodeKey *keys, uint32_t capacity, const CodeKey &key)
+{
+    uint32_t mask = capacity - 1;
+    uint32_t slot = codeHash(key.protocol, key.address, key.command, key.bits) & mask;
+
+    while (keys[slot].protocol != CODE_KEY_EMPTY)
+        slot = (slot + 1) & mask;
+
+    keys[slot] = key;
+}
+
+// Вызывается под xMutex
+void codeKeyInsert(const CodeRecord &r)
+{
+    if (codeKeysLost)
+        return;
+
+    // Заполненность хеш-набора не выше 50%
+    if ((codeKeysCount + 1) * 2 > codeKeysCapacity)
+    {
+        uint32_t capacity = codeKeysCapacity ? codeKeysCapacity * 2 : 256;
+        CodeKey *keys = (CodeKey *)codeStoreAlloc(capacity * sizeof(CodeKey));
+
+        if (keys == NULL)
+        {
+            free(codeKeys);
+            codeKeys = NULL;
+            codeKeysCapacity = 0;
+            codeKeysCount = 0;
+            codeKeysLost = true;
+            return;
+        }
+
+        for (uint32_t i = 0; i < capacity; i++)
+            keys[i].protocol = CODE_KEY_EMPTY;
+
+        for (uint32_t i = 0; i < codeKeysCapacity; i++)
+            if (codeKeys[i].protocol != CODE_KEY_EMPTY)
+                codeKeyPut(keys, capacity, codeKeys[i]);
+
+        free(codeKeys);
+        codeKeys = keys;
+        codeKeysCapacity = capacity;
+    }
+
+    CodeKey key = {r.protocol, r.address, r.command, r.bits};
+    codeKeyPut(codeKeys, codeKeysCapacity, key);
+    codeKeysCount++;
+}
+
+bool parseCodeLine(const char *line, CodeRecord &record)
+{
+    char *end;
+
+    record.id = strtol(line, &end, 10);
+    if (end == line || record.id <= 0)
+        return false;
+
+    line = end;
+    record.protocol = strtol(line, &end, 10);
+    if (end == line)
+        return false;
+
+    line = end;
+    record.address = strtoul(line, &end, 10);
+    if (end == line)
+        return false;
+
+    line = end;
+    record.command = strtoul(line, &end, 10);
+    if (end == line)
+        return false;
+
+    // Длина кадра - необязательное пятое поле (выгрузка /export)
+    line = end;
+    record.bits = strtoul(line, &end, 10);
+    if (end == line)
+        record.bits = 0;
+
+    return true;
+}
+
+// Длина строки записи в текстовом формате - для сравнения с двоичным
+uint32_t codeTextLen(const CodeRecord &r)
+{
+    uint32_t values[] = {(uint32_t)r.id, (uint32_t)abs(r.protocol), r.address, r.command};
+    uint32_t len = 3 + 2 + (r.protocol < 0 ? 1 : 0); // Пробелы, "\r\n", знак
+
+    for (uint32_t v : values)
+    {
+        len++;
+        while (v >= 10)
+        {
+            v /= 10;
+            len++;
+        }
+    }
+
+    return len;
+}
+
+// Последовательное чтение двоичных записей блоками; вызывается под xMutex
+struct CodeFileReader
+{
+    File &file;
+    uint32_t left;   // Непрочитанные байты файла до конца записей
+    uint32_t offset; // Смещение в файле текущей записи (block + pos)
+    size_t pos;
+    size_t len;
+    uint8_t block[CODE_STORE_READ_LEN];
+
+    CodeFileReader(File &f, uint32_t start, uint32_t end)
+        : file(f), left(end > start ? end - start : 0), offset(start), pos(0), len(0)
+    {
+    }
+
+    // Длина прочитанной записи, ее байты - в block + pos до вызова skip; 0 - записи кончились или повреждены
+    int next(int prevId, CodeRecord &record)
+    {
+        // Запись не должна обрываться на границе блока
+        if (len - pos < CODE_FORMAT_RECORD_MAX_LEN + 1 && left > 0)
+        {
+            memmove(block, block + pos, len - pos);
+            len -= pos;
+            pos = 0;
+
+            int n = file.read(block + len, min((uint32_t)(sizeof(block) - len), left));
+            if (n > 0)
+            {
+                len += n;
+                left -= n;
+            }
+        }
+
+        int used = codeFormatDecodeRecord(block + pos, len - pos, prevId, record);
+        return used > 0 ? used : 0;
+    }
+
+    void skip(int used)
+    {
+        pos += used;
+        offset += used;
+    }
+};
+
+// Буферизованная дозапись двоичных записей с обновлением заголовка; вызывается под xMutex
+struct CodeFileWriter
+{
+    File &file;
+    CodeFileHeader &header;
+    size_t len;
+    bool ok;
+    uint32_t writeUs; // Время записи на SD - для разделения записи и разбора при переносе
+    uint8_t block[CODE_STORE_READ_LEN];
+
+    CodeFileWriter(File &f, CodeFileHeader &h) : file(f), header(h), len(0), ok(true), writeUs(0)
+    {
+    }
+
+    // Смещение записи в файле
+    uint32_t put(const CodeRecord &record)
+    {
+        if (len + CODE_FORMAT_RECORD_MAX_LEN > sizeof(block))
+            flush();
+
+        uint32_t offset = header.recordsEnd;
+        size_t n = codeFormatEncodeRecord(block + len, sizeof(block) - len, header.lastId, record);
+
+        header.crc = codeFormatCrc(header.crc, block + len, n);
+        header.count++;
+        header.lastId = record.id;
+        header.recordsEnd += n;
+        len += n;
+
+        return offset;
+    }
+
+    void flush()
+    {
+        uint32_t started = micros();
+
+        if (len > 0 && file.write(block, len) != len)
+            ok = false;
+
+        len = 0;
+        writeUs += micros() - started;
+    }
+
+    // Заголовок пишется после записей: при сбое питания до его обновления дописанные записи не видны
+    bool finish()
+    {
+        flush();
+
+        uint32_t started = micros();
+        uint8_t head[CODE_FORMAT_HEADER_LEN];
+
+        codeFormatEncodeHeader(head, sizeof(head), header);
+        if (!file.seek(0) || file.write(head, sizeof(head)) != sizeof(head))
+            ok = false;
+
+        writeUs += micros() - started;
+        return ok;
+    }
+};
+
+bool deviceNameValid(const char *name)
+{
+    size_t len = strlen(name);
+
+    if (len == 0 || len >= DEVICE_NAME_LEN)
+        return false;
+
+    for (size_t i = 0; i < len; i++)
+        if (!(islower((uint8_t)name[i]) || isdigit((uint8_t)name[i]) || name[i] == '_' || name[i] == '-'))
+            return false;
+
+    return true;
+}
+
+void devicePath(int device, char *path, size_t size)
+{
+    if (device == 0)
+        snprintf(path, size, "%s", CODES_FILE);
+    else
+        snprintf(path, size, "%s/%s.bin", DEVICES_DIR, codeDevices[device].name);
+}
+
+// Текстовый файл устройства прежних версий
+void deviceTextPath(int device, char *path, size_t size)
+{
+    if (device == 0)
+        snprintf(path, size, "%s", CODES_TEXT_FILE);
+    else
+        snprintf(path, size, "%s/%s.txt", DEVICES_DIR, codeDevices[device].name);
+}
+
+// Вызывается под xMutex
+int deviceFind(const char *name)
+{
+    for (int i = 0; i < codeDevicesCount; i++)
+        if (strcmp(codeDevices[i].name, name) == 0)
+            return i;
+
+    return -1;
+}
+
+// Вызывается под xMutex
+int deviceAdd(const char *name)
+{
+    if (codeDevicesCount >= CODE_MAX_DEVICES)
+        return -1;
+
+    CodeDevice &dev = codeDevices[codeDevicesCount];
+    memset(&dev, 0, sizeof(dev));
+    strcpy(dev.name, name);
+    dev.sorted = true;
+
+    return codeDevicesCount++;
+}
+
+// Вызывается под xMutex: таблица страниц устаревает, устройство будет проиндексировано заново
+void deviceDropIndex(CodeDevice &dev)
+{
+    free(dev.pages);
+    dev.pages = NULL;
+    dev.pagesCapacity = 0;
+    dev.indexed = false;
+    dev.sorted = true;
+    dev.readOnly = false;
+    dev.count = 0;
+    dev.maxId = 0;
+    dev.fileBytes = 0;
+    dev.textBytes = 0;
+    dev.indexUs = 0;
+    dev.damaged = false;
+}
+
+// Вызывается под xMutex
+void cacheDrop(int device, int fromPage)
+{
+    for (int i = 0; i < codeCachePages; i++)
+        if (codeCache[i].device == device && codeCache[i].page >= fromPage)
+            codeCache[i].device = -1;
+}
+
+// Вызывается под xMutex. Учет записи в таблице страниц и хеш-наборе
+bool deviceAddRecord(CodeDevice &dev, const CodeRecord &record, uint32_t offset, int prevId)
+{
+    if (dev.count % CODE_PAGE_RECORDS == 0)
+    {
+        int page = dev.count / CODE_PAGE_RECORDS;
+
+        if (page >= dev.pagesCapacity)
+        {
+            int capacity = max(8, dev.pagesCapacity * 2);
+            CodePage *pages = (CodePage *)codeStoreRealloc(dev.pages, capacity * sizeof(CodePage));
+            if (pages == NULL)
+                return false;
+
+            dev.pages = pages;
+            dev.pagesCapacity = capacity;
+        }
+
+        dev.pages[page].offset = offset;
+        dev.pages[page].firstId = record.id;
+        dev.pages[page].prevId = prevId;
+    }
+
+    if (dev.count > 0 && record.id <= dev.maxId)
+        dev.sorted = false;
+    if (record.id > dev.maxId)
+        dev.maxId = record.id;
+    if (record.id > codesMaxId)
+        codesMaxId = record.id;
+
+    dev.count++;
+    codeKeyInsert(record);
+    return true;
+}
+
+// Вызывается под xMutex. Имена из раздела имен файла (файл, собранный на компьютере) переносятся
+// в индекс имен, а раздел снимается флагом заголовка, чтобы удаленные позже имена не вернулись.
+// Флаг снимается, только если раздел прочитан целиком и каждое имя есть в индексе (или недопустимо):
+// иначе перенос повторится при следующей индексации файла
+void deviceTakeNames(const char *path, File &file, CodeFileHeader &header)
+{
+    uint8_t block[CODE_STORE_READ_LEN];
+    int n = file.seek(header.recordsEnd) ? file.read(block, sizeof(block)) : 0;
+    size_t len = n > 0 ? n : 0;
+    uint64_t count = 0;
+    size_t pos = varintGet(block, len, count);
+    uint64_t i = 0;
+    int taken = 0;
+    int failed = 0;
+
+    for (; pos > 0 && i < count; i++)
+    {
+        // Имя не должно обрываться на границе блока
+        if (len - pos < CODE_FORMAT_NAME_MAX_LEN + 2 * VARINT_MAX_LEN)
+        {
+            memmove(block, block + pos, len - pos);
+            len -= pos;
+            pos = 0;
+
+            n = file.read(block + len, sizeof(block) - len);
+            if (n > 0)
+                len += n;
+        }
+
+        int id;
+        char name[NAME_MAX_LEN + 1];
+        int used = codeFormatDecodeName(block + pos, len - pos, id, name, sizeof(name));
+
+        if (used <= 0)
+            break;
+
+        pos += used;
+
+        if (!nameIndexValid(name) || nameIndexFind(name) >= 0)
+            continue; // Недопустимое или уже занятое имя не перенесется и при повторе
+
+        if (nameIndexAdd(name, id))
+            taken++;
+        else
+            failed++;
+    }
+
+    file.close();
+
+    bool complete = pos > 0 && i == count && failed == 0;
+
+    if (DEBUG_CODE_STORE)
+        Serial.printf("Codes file %s: %d names moved to the name index%s\n", path, taken,
+                      complete ? "" : ", the rest is left for the next indexing");
+
+    if (!complete)
+        return;
+
+    File update = SD.open(path, CODE_STORE_UPDATE_MODE);
+    if (!update)
+        return;
+
+    header.flags &= ~CODE_FORMAT_FLAG_NAMES;
+    codeFormatEncodeHeader(block, sizeof(block), header);
+    update.write(block, CODE_FORMAT_HEADER_LEN);
+    update.close();
+}
+
+// Вызывается под xMutex. Однократное сканирование файла устройства: таблица страниц и ключи дубликатов.
+// Таблица страниц выделяется сразу по числу записей из заголовка, записи разбираются без токенизации текста
+bool deviceIndex(int device)
+{
+    CodeDevice &dev = codeDevices[device];
+
+    if (dev.indexed)
+        return true;
+
+    char path[CODE_STORE_PATH_LEN];
+    devicePath(device, path, sizeof(path));
+
+    dev.indexed = true;
+
+    File file = SD.open(path, FILE_READ);
+    if (!file)
+        return true; // Файла еще нет - устройство пустое
+
+    uint32_t started = micros();
+    uint8_t head[CODE_FORMAT_HEADER_LEN];
+    CodeFileHeader header;
+
+    int n = file.read(head, sizeof(head));
+
+    if (n != CODE_FORMAT_HEADER_LEN || !codeFormatDecodeHeader(head, n, header))
+    {
+        if (DEBUG_CODE_STORE)
+            Serial.printf("Error: %s is not a codes file of a supported version\n", path);
+        file.close();
+        dev.readOnly = true;
+        return true;
+    }
+
+    int capacity = header.count / CODE_PAGE_RECORDS + 1;
+    if (dev.pages == NULL && header.count > 0)
+    {
+        dev.pages = (CodePage *)codeStoreAlloc(capacity * sizeof(CodePage));
+        dev.pagesCapacity = dev.pages ? capacity : 0;
+    }
+
+    CodeFileReader reader(file, CODE_FORMAT_HEADER_LEN, min(header.recordsEnd, (uint32_t)file.size()));
+    uint32_t crc = 0;
+    int prevId = 0;
+    bool ok = true;
+
+    while (ok && (uint32_t)dev.count < header.count)
+    {
+        CodeRecord record;
+        int used = reader.next(prevId, record);
+
+        if (used == 0)
+            break;
+
+        crc = codeFormatCrc(crc, reader.block + reader.pos, used);
+        ok = deviceAddRecord(dev, record, reader.offset, prevId);
+        dev.textBytes += codeTextLen(record);
+        reader.skip(used);
+        prevId = record.id;
+    }
+
+    dev.fileBytes = reader.offset;
+    dev.indexUs = micros() - started;
+
+    // Записи, найденные до повреждения, остаются доступны
+    if (ok && ((uint32_t)dev.count != header.count || crc != header.crc))
+    {
+        dev.damaged = true;
+        dev.readOnly = (uint32_t)dev.count != header.count; // Дописанное после обрыва не было бы прочитано
+        if (DEBUG_CODE_STORE)
+            Serial.printf("Error: Codes file %s is damaged, %d of %lu codes read\n", path, dev.count, (unsigned long)header.count);
+    }
+
+    if (ok && (header.flags & CODE_FORMAT_FLAG_NAMES))
+        deviceTakeNames(path, file, header);
+    else
+        file.close();
+
+    if (!ok)
+    {
+        if (DEBUG_CODE_STORE)
+            Serial.println("Error: Not enough memory to index codes");
+        deviceDropIndex(dev);
+    }
+
+    return ok;
+}
+
+// Вызывается под xMutex. После deviceIndexEach обычно ничего не сканирует
+void deviceIndexAll()
+{
+    for (int i = 0; i < codeDevicesCount; i++)
+        deviceIndex(i);
+}
+
+// Вызывается без xMutex. Еще не просканированные устройства индексируются по одному, мьютекс
+// захватывается на каждое: поиск и отправка кодов из других задач не ждут сканирования всех файлов
+void deviceIndexEach()
+{
+    for (int i = 0;; i++)
+    {
+        if (xSemaphoreTake(xMutex, portMAX_DELAY) != pdTRUE)
+            return;
+
+        bool more = i < codeDevicesCount;
+        if (more)
+            deviceIndex(i);
+
+        xSemaphoreGive(xMutex);
+
+        if (!more)
+            return;
+    }
+}
+
+// Вызывается под xMutex. Страница из кэша или с SD-карты, вытесняется давно не использованная
+CodeCachePage *cachePage(int device, int page)
+{
+    const CodeDevice &dev = codeDevices[device];
+    CodeCachePage *slot = NULL;
+
+    codeCacheClock++;
+
+    for (int i = 0; i < codeCachePages; i++)
+    {
+        CodeCachePage &p = codeCache[i];
+
+        if (p.device == device && p.page == page)
+        {
+            p.lastUse = codeCacheClock;
+            return &p;
+        }
+
+        if (slot == NULL || p.device < 0 || (slot->device >= 0 && p.lastUse < slot->lastUse))
+            slot = &p;
+    }
+
+    if (slot == NULL)
+        return NULL;
+
+    char path[CODE_STORE_PATH_LEN];
+    devicePath(device, path, sizeof(path));
+
+    File file = SD.open(path, FILE_READ);
+    if (!file || !file.seek(dev.pages[page].offset))
+        return NULL;
+
+    int expected = min(CODE_PAGE_RECORDS, dev.count - page * CODE_PAGE_RECORDS);
+    CodeFileReader reader(file, dev.pages[page].offset, file.size());
+    int prevId = dev.pages[page].prevId;
+
+    slot->device = -1;
+    slot->count = 0;
+
+    while (slot->count < expected)
+    {
+        CodeRecord &record = slot->records[slot->count];
+        int used = reader.next(prevId, record);
+
+        if (used == 0)
+            break;
+
+        reader.skip(used);
+        prevId = record.id;
+        slot->count++;
+    }
+
+    file.close();
+
+    if (slot->count != expected || slot->records[0].id != dev.pages[page].firstId)
+        return NULL; // Файл изменен вне устройства
+
+    slot->device = device;
+    slot->page = page;
+    slot->lastUse = codeCacheClock;
+    return slot;
+}
+
+// Вызывается под xMutex
+bool deviceFindRecord(int device, int id, CodeRecord &record)
+{
+    CodeDevice &dev = codeDevices[device];
+
+    if (!deviceIndex(device) || dev.count == 0 || id > dev.maxId)
+        return false;
+
+    int first = 0;
+    int last = (dev.count - 1) / CODE_PAGE_RECORDS;
+
+    if (dev.sorted)
+    {
+        // Последняя страница с firstId <= id
+        int lo = 0;
+        int hi = last;
+
+        while (lo < hi)
+        {
+            int mid = (lo + hi + 1) / 2;
+
+            if (dev.pages[mid].firstId <= id)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+
+        first = last = lo;
+    }
+
+    for (int page = first; page <= last; page++)
+    {
+        CodeCachePage *p = cachePage(device, page);
+
+        for (int i = 0; p != NULL && i < p->count; i++)
+        {
+            if (p->records[i].id == id)
+            {
+                record = p->records[i];
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// Вызывается под xMutex при загрузке. Текстовый файл прежних версий переписывается в двоичный
+// через временный файл; исходный файл остается с расширением .bak
+bool deviceMigrate(const char *textPath, const char *binPath)
+{
+    char tmpPath[CODE_STORE_PATH_LEN];
+    char bakPath[CODE_STORE_PATH_LEN];
+
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", binPath);
+    snprintf(bakPath, sizeof(bakPath), "%s.bak", textPath);
+
+    File in = SD.open(textPath, FILE_READ);
+    File out = SD.open(tmpPath, FILE_WRITE);
+
+    if (!in || !out)
+    {
+        if (in)
+            in.close();
+        if (out)
+            out.close();
+        return false;
+    }
+
+    uint32_t started = micros();
+    uint32_t textBytes = in.size();
+    CodeFileHeader header;
+    codeFormatInitHeader(header);
+
+    CodeFileWriter writer(out, header);
+    uint8_t head[CODE_FORMAT_HEADER_LEN];
+    codeFormatEncodeHeader(head, sizeof(head), header);
+    out.write(head, sizeof(head)); // Место заголовка, заполняется в finish
+
+    char block[CODE_STORE_READ_LEN];
+    char line[CODE_STORE_LINE_LEN];
+    size_t lineLen = 0;
+    bool lineOverflow = false;
+    int n;
+
+    while ((n = in.read((uint8_t *)block, sizeof(block))) > 0)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            if (block[i] != '\n')
+            {
+                if (lineLen < sizeof(line) - 1)
+                    line[lineLen++] = block[i];
+                else
+                    lineOverflow = true;
+                continue;
+            }
+
+            CodeRecord record;
+            line[lineLen] = '\0';
+
+            if (!lineOverflow && parseCodeLine(line, record))
+                writer.put(record);
+
+            lineLen = 0;
+            lineOverflow = false;
+        }
+    }
+
+    // Последняя строка без перевода строки
+    if (lineLen > 0 && !lineOverflow)
+    {
+        CodeRecord record;
+        line[lineLen] = '\0';
+
+        if (parseCodeLine(line, record))
+            writer.put(record);
+    }
+
+    in.close();
+
+    bool ok = writer.finish();
+    uint32_t parseUs = micros() - started - writer.writeUs;
+    out.close();
+
+    if (!ok || !SD.rename(tmpPath, binPath))
+    {
+        if (DEBUG_CODE_STORE)
+            Serial.printf("Error: Could not migrate codes file %s\n", textPath);
+        SD.remove(tmpPath);
+        return false;
+    }
+
+    SD.remove(bakPath);
+    SD.rename(textPath, bakPath);
+
+    codeStats.migrated++;
+    codeStats.migratedCodes += header.count;
+    codeStats.migratedTextBytes += textBytes;
+    codeStats.migratedBytes += header.recordsEnd;
+    codeStats.textParseUs += parseUs;
+
+    if (DEBUG_CODE_STORE)
+        Serial.printf("Codes file %s migrated to %s: %lu codes, %lu -> %lu bytes, text parsed in %lu us\n", textPath, binPath,
+                      (unsigned long)header.count, (unsigned long)textBytes, (unsigned long)header.recordsEnd,
+                      (unsigned long)parseUs);
+    return true;
+}
+
+bool codeStoreLoad()
+{
+    bool found = false;
+
+    if (xSemaphoreTake(xMutex, portMAX_DELAY) != pdTRUE)
+        return false;
+
+    if (codeCache == NULL)
+    {
+        codeCachePages = CODE_CACHE_PAGES;
+        codeCache = (CodeCachePage *)heap_caps_malloc(codeCachePages * sizeof(CodeCachePage), MALLOC_CAP_SPIRAM);
+
+        if (codeCache == NULL)
+        {
+            codeCachePages = CODE_CACHE_PAGES_NO_PSRAM;
+            codeCache = (CodeCachePage *)malloc(codeCachePages * sizeof(CodeCachePage));
+        }
+
+        if (codeCache == NULL)
+            codeCachePages = 0;
+
+        for (int i = 0; i < codeCachePages; i++)
+            codeCache[i].device = -1;
+    }
+
+    codeDevicesCount = 0;
+    deviceAdd(DEFAULT_DEVICE);
+
+    // Текстовый файл прежних версий переносится в двоичный формат один раз
+    if (!SD.exists(CODES_FILE) && SD.exists(CODES_TEXT_FILE))
+        deviceMigrate(CODES_TEXT_FILE, CODES_FILE);
+
+    found = SD.exists(CODES_FILE);
+
+    // Читается только список файлов, сами коды - при первом обращении
+    File dir = SD.open(DEVICES_DIR);
+
+    if (dir && dir.isDirectory())
+    {
+        for (File file = dir.openNextFile(); file; file = dir.openNextFile())
+        {
+            char name[DEVICE_NAME_LEN + 4];
+            const char *fileName = strrchr(file.name(), '/');
+            fileName = fileName ? fileName + 1 : file.name();
+
+            size_t len = strlen(fileName);
+
+            // Двоичные файлы и текстовые файлы прежних версий, которые будут перенесены ниже
+            if (!file.isDirectory() && len > 4 && len - 4 < DEVICE_NAME_LEN &&
+                (strcmp(fileName + len - 4, ".bin") == 0 || strcmp(fileName + len - 4, ".txt") == 0))
+            {
+                memcpy(name, fileName, len - 4);
+                name[len - 4] = '\0';
+
+                if (deviceNameValid(name) && deviceFind(name) < 0 && deviceAdd(name) >= 0)
+                    found = true;
+            }
+
+            file.close();
+        }
+    }
+
+    if (dir)
+        dir.close();
+
+    // Перенос после обхода каталога: файлы не создаются и не переименовываются во время обхода
+    for (int i = 1; i < codeDevicesCount; i++)
+    {
+        char binPath[CODE_STORE_PATH_LEN];
+        char textPath[CODE_STORE_PATH_LEN];
+
+        devicePath(i, binPath, sizeof(binPath));
+        deviceTextPath(i, textPath, sizeof(textPath));
+
+        if (!SD.exists(binPath) && SD.exists(textPath))
+            deviceMigrate(textPath, binPath);
+    }
+
+    // Активное устройство сохраняется между перезагрузками
+    Preferences prefs;
+    char active[DEVICE_NAME_LEN] = "";
+
+    if (prefs.begin(CODE_STORE_NVS_NAMESPACE, true))
+    {
+        prefs.getString("device", active, sizeof(active));
+        prefs.end();
+    }
+
+    activeDevice = max(0, deviceFind(active));
+
+    if (prefs.begin(CODE_ROUTES_NVS_NAMESPACE, true))
+    {
+        for (int i = 0; i < codeDevicesCount; i++)
+            codeDevices[i].channel = prefs.getUChar(codeDevices[i].name, 0);
+        prefs.end();
+    }
+
+    xSemaphoreGive(xMutex);
+    return found;
+}
+
+bool codeStoreClear()
+{
+    bool existed = false;
+
+    if (xSemaphoreTake(xMutex, portMAX_DELAY) != pdTRUE)
+        return false;
+
+    for (int i = 0; i < codeDevicesCount; i++)
+    {
+        char path[CODE_STORE_PATH_LEN];
+
+        // Текстовый файл, который не удалось перенести, иначе вернул бы коды при загрузке
+        for (int text = 0; text < 2; text++)
+        {
+            if (text)
+                deviceTextPath(i, path, sizeof(path));
+            else
+                devicePath(i, path, sizeof(path));
+
+            if (SD.exists(path))
+            {
+                SD.remove(path);
+                existed = true;
+            }
+        }
+
+        deviceDropIndex(codeDevices[i]);
+    }
+
+    codeDevicesCount = 1;
+    activeDevice = 0;
+    codesMaxId = 0;
+
+    for (int i = 0; i < codeCachePages; i++)
+        codeCache[i].device = -1;
+
+    free(codeKeys);
+    codeKeys = NULL;
+    codeKeysCapacity = 0;
+    codeKeysCount = 0;
+    codeKeysLost = false;
+
+    xSemaphoreGive(xMutex);
+
+    Preferences prefs;
+    if (prefs.begin(CODE_STORE_NVS_NAMESPACE, false))
+    {
+        prefs.remove("device");
+        prefs.end();
+    }
+
+    if (prefs.begin(CODE_ROUTES_NVS_NAMESPACE, false))
+    {
+        prefs.clear();
+        prefs.end();
+    }
+
+    codeDevices[0].channel = 0;
+
+    return existed;
+}
+
+bool codeStoreFind(int id, CodeRecord &record, int *device)
+{
+    bool found = false;
+
+    if (xSemaphoreTake(xMutex, portMAX_DELAY) == pdTRUE)
+    {
+        for (int n = 0; n < codeDevicesCount && !found; n++)
+        {
+            // Сначала активное устройство: обычно код нужен из него, затем остальные по порядку
+            int i = (n == 0) ? activeDevice : (n <= activeDevice ? n - 1 : n);
+
+            found = deviceFindRecord(i, id, record);
+            if (found && device != NULL)
+                *device = i;
+        }
+
+        xSemaphoreGive(xMutex);
+    }
+
+    return found;
+}
+
+// Вызывается под xMutex
+bool codeKeyFind(int protocol, uint32_t address, uint32_t command, uint16_t bits)
+{
+    if (codeKeysCapacity == 0)
+        return false;
+
+    uint32_t mask = codeKeysCapacity - 1;
+
+    for (uint32_t slot = codeHash(protocol, address, command, bits) & mask; codeKeys[slot].protocol != CODE_KEY_EMPTY;
+         slot = (slot + 1) & mask)
+    {
+        const CodeKey &k = codeKeys[slot];
+
+        if (k.protocol == protocol && k.address == address && k.command == command && k.bits == bits)
+            return true;
+    }
+
+    return false;
+}
+
+// Запись без длины кадра (bits = 0, старые файлы) отправляется с длиной по умолчанию
+// и совпадает с кодом любой длины
+bool codeStoreContains(int protocol, uint32_t address, uint32_t command, uint16_t bits)
+{
+    bool found = false;
+
+    // Дубликаты ищутся по всем устройствам
+    deviceIndexEach();
+
+    if (xSemaphoreTake(xMutex, portMAX_DELAY) != pdTRUE)
+        return false;
+
+    deviceIndexAll();
+
+    if (!codeKeysLost)
+    {
+        found = codeKeyFind(protocol, address, command, bits) ||
+                (bits != 0 && codeKeyFind(protocol, address, command, 0));
+    }
+    else
+    {
+        // Без хеш-набора - перебор страниц всех устройств
+        for (int d = 0; d < codeDevicesCount && !found; d++)
+        {
+            for (int page = 0; page * CODE_PAGE_RECORDS < codeDevices[d].count && !found; page++)
+            {
+                CodeCachePage *p = cachePage(d, page);
+
+                for (int i = 0; p != NULL && i < p->count && !found; i++)
+                {
+                    const CodeRecord &r = p->records[i];
+                    found = (r.protocol == protocol && r.address == address && r.command == command &&
+                             (r.bits == bits || r.bits == 0));
+                }
+            }
+        }
+    }
+
+    xSemaphoreGive(xMutex);
+    return found;
+}
+
+int codeStoreNextId()
+{
+    int id = 0;
+
+    deviceIndexEach();
+
+    if (xSemaphoreTake(xMutex, portMAX_DELAY) == pdTRUE)
+    {
+        deviceIndexAll();
+        id = codesMaxId + 1;
+        xSemaphoreGive(xMutex);
+    }
+
+    return id;
+}
+
+int codeStoreAppend(CodeRecord *records, int count)
+{
+    // Новые ID выдаются после максимального по всем устройствам
+    deviceIndexEach();
+
+    if (xSemaphoreTake(xMutex, portMAX_DELAY) != pdTRUE)
+        return -1;
+
+    deviceIndexAll();
+
+    int device = activeDevice;
+    CodeDevice &dev = codeDevices[device];
+    char path[CODE_STORE_PATH_LEN];
+
+    devicePath(device, path, sizeof(path));
+
+    if (device != 0 && !SD.exists(DEVICES_DIR))
+        SD.mkdir(DEVICES_DIR);
+
+    // Последний ID и CRC берутся из заголовка: файл не перечитывается
+    CodeFileHeader header;
+    File file = dev.readOnly ? File() : SD.open(path, CODE_STORE_UPDATE_MODE);
+
+    if (file)
+    {
+        uint8_t head[CODE_FORMAT_HEADER_LEN];
+        int n = file.read(head, sizeof(head));
+
+        if (n != CODE_FORMAT_HEADER_LEN || !codeFormatDecodeHeader(head, n, header) || !file.seek(header.recordsEnd))
+            file.close();
+    }
+    else if (!dev.readOnly && !SD.exists(path))
+    {
+        file = SD.open(path, FILE_WRITE);
+        codeFormatInitHeader(header);
+
+        // Место заголовка, заполняется в finish
+        uint8_t head[CODE_FORMAT_HEADER_LEN];
+        codeFormatEncodeHeader(head, sizeof(head), header);
+        if (file)
+            file.write(head, sizeof(head));
+    }
+
+    if (!file)
+    {
+        xSemaphoreGive(xMutex);
+        return -1;
+    }
+
+    // Флаг раздела имен снимается только deviceTakeNames, когда все имена перенесены в индекс.
+    // Если он остался (индекс имен заполнен, ошибка SD-карты), раздел переносится за новые
+    // записи и будет перенесен при следующей индексации
+    uint8_t *names = NULL;
+    size_t namesLen = 0;
+
+    if (header.flags & CODE_FORMAT_FLAG_NAMES)
+    {
+        namesLen = file.size() > header.recordsEnd ? file.size() - header.recordsEnd : 0;
+        names = (uint8_t *)codeStoreAlloc(namesLen > 0 ? namesLen : 1);
+
+        if (names == NULL || file.read(names, namesLen) != (int)namesLen || !file.seek(header.recordsEnd))
+        {
+            if (DEBUG_CODE_STORE)
+                Serial.printf("Error: Could not keep the names section of %s\n", path);
+            free(names);
+            file.close();
+            xSemaphoreGive(xMutex);
+            return -1;
+        }
+    }
+
+    int firstId = codesMaxId + 1;
+    int lastPage = dev.count / CODE_PAGE_RECORDS;
+    bool indexed = dev.indexed;
+    CodeFileWriter writer(file, header);
+
+    for (int i = 0; i < count; i++)
+    {
+        int prevId = header.lastId;
+        records[i].id = firstId + i;
+
+        uint32_t offset = writer.put(records[i]);
+
+        if (indexed)
+            indexed = deviceAddRecord(dev, records[i], offset, prevId);
+        if (indexed)
+            dev.textBytes += codeTextLen(records[i]);
+    }
+
+    if (names != NULL)
+    {
+        writer.flush();
+        if (namesLen > 0 && file.write(names, namesLen) != namesLen)
+            writer.ok = false;
+        free(names);
+    }
+
+    bool written = writer.finish();
+    file.close();
+    dev.fileBytes = header.recordsEnd;
+
+    // ID уже записаны в файл и не должны выдаваться повторно, даже если индекс не расширится
+    codesMaxId = max(codesMaxId, firstId + count - 1);
+    cacheDrop(device, lastPage);
+
+    if (!written)
+    {
+        if (DEBUG_CODE_STORE)
+            Serial.printf("Error: Could not write codes file %s\n", path);
+        deviceDropIndex(dev);
+        xSemaphoreGive(xMutex);
+        return -1;
+    }
+
+    if (!indexed)
+    {
+        if (DEBUG_CODE_STORE)
+            Serial.println("Error: Not enough memory to index new codes");
+        deviceDropIndex(dev);
+    }
+
+    xSemaphoreGive(xMutex);
+    return firstId;
+}
+
+int codeStoreDeviceCount()
+{
+    return codeDevicesCount;
+}
+
+int codeStoreActiveDevice()
+{
+    return activeDevice;
+}
+
+int codeStoreSelectDevice(const char *name)
+{
+    char lower[DEVICE_NAME_LEN];
+    size_t len = 0;
+
+    for (; name[len] && len < sizeof(lower) - 1; len++)
+        lower[len] = tolower(name[len]);
+    lower[len] = '\0';
+
+    if (name[len] != '\0' || !deviceNameValid(lower))
+        return -1;
+
+    int device = -1;
+
+    if (xSemaphoreTake(xMutex, portMAX_DELAY) == pdTRUE)
+    {
+        device = deviceFind(lower);
+        if (device < 0)
+            device = deviceAdd(lower); // Файл появится при первой записи кода
+
+        if (device >= 0)
+            activeDevice = device;
+
+        xSemaphoreGive(xMutex);
+    }
+
+    if (device >= 0)
+    {
+        Preferences prefs;
+        if (prefs.begin(CODE_STORE_NVS_NAMESPACE, false))
+        {
+            prefs.putString("device", lower);
+            prefs.end();
+        }
+    }
+
+    return device;
+}
+
+bool codeStoreDeviceName(int device, char *name, size_t size)
+{
+    if (device < 0 || device >= codeDevicesCount)
+        return false;
+
+    snprintf(name, size, "%s", codeDevices[device].name);
+    return true;
+}
+
+bool codeStoreDevicePath(int device, char *path, size_t size)
+{
+    if (device < 0 || device >= codeDevicesCount)
+        return false;
+
+    devicePath(device, path, size);
+    return true;
+}
+
+int codeStoreDeviceCodes(int device)
+{
+    int count = 0;
+
+    if (device < 0 || device >= codeDevicesCount)
+        return 0;
+
+    if (xSemaphoreTake(xMutex, portMAX_DELAY) == pdTRUE)
+    {
+        deviceIndex(device);
+        count = codeDevices[device].count;
+        xSemaphoreGive(xMutex);
+    }
+
+    return count;
+}
+
+int codeStoreRead(int device, int start, CodeRecord *records, int count)
+{
+    int read = 0;
+
+    if (device < 0 || device >= codeDevicesCount || start < 0)
+        return 0;
+
+    if (xSemaphoreTake(xMutex, portMAX_DELAY) == pdTRUE)
+    {
+        deviceIndex(device);
+
+        while (read < count && start + read < codeDevices[device].count)
+        {
+            int index = start + read;
+            CodeCachePage *p = cachePage(device, index / CODE_PAGE_RECORDS);
+
+            if (p == NULL)
+                break;
+
+            records[read++] = p->records[index % CODE_PAGE_RECORDS];
+        }
+
+        xSemaphoreGive(xMutex);
+    }
+
+    return read;
+}
+
+uint8_t codeStoreDeviceChannel(int device)
+{
+    if (device < 0 || device >= codeDevicesCount)
+        return 0;
+
+    return codeDevices[device].channel;
+}
+
+bool codeStoreSetDeviceChannel(int device, uint8_t channel)
+{
+    if (device < 0 || device >= codeDevicesCount)
+        return false;
+
+    codeDevices[device].channel = channel;
+
+    Preferences prefs;
+    if (!prefs.begin(CODE_ROUTES_NVS_NAMESPACE, false))
+        return false;
+
+    prefs.putUChar(codeDevices[device].name, channel);
+    prefs.end();
+    return true;
+}
+
+bool codeStoreExportText(int device, int count, Print &out)
+{
+    CodeRecord records[CODE_STORE_EXPORT_RECORDS];
+    int done = 0;
+
+    // Мьютекс захватывается на каждую порцию (codeStoreRead): выгрузка идет прямо в сокет и не держит
+    // хранилище на время передачи. Формат прежних версий; длина кадра - пятым полем, если известна.
+    // Такой файл можно положить на SD вместо двоичного: он будет перенесен при загрузке
+    while (done < count)
+    {
+        int n = codeStoreRead(device, done, records, min(count - done, CODE_STORE_EXPORT_RECORDS));
+
+        if (n <= 0)
+            return false;
+
+        for (int i = 0; i < n; i++)
+        {
+            const CodeRecord &r = records[i];
+            char line[CODE_STORE_LINE_LEN];
+            int len = snprintf(line, sizeof(line), "%d %d %lu %lu", r.id, r.protocol, (unsigned long)r.address,
+                               (unsigned long)r.command);
+
+            if (r.bits != 0)
+                len += snprintf(line + len, sizeof(line) - len, " %u", r.bits);
+            len += snprintf(line + len, sizeof(line) - len, "\r\n");
+
+            out.write((const uint8_t *)line, len);
+        }
+
+        done += n;
+    }
+
+    return true;
+}
+
+void codeStoreStats(CodeStoreStats &stats)
+{
+    if (xSemaphoreTake(xMutex, portMAX_DELAY) != pdTRUE)
+        return;
+
+    stats = codeStats;
+
+    for (int i = 0; i < codeDevicesCount; i++)
+    {
+        const CodeDevice &dev = codeDevices[i];
+
+        if (!dev.indexed)
+            continue;
+
+        stats.codes += dev.count;
+        stats.fileBytes += dev.fileBytes;
+        stats.textBytes += dev.textBytes;
+        stats.indexUs += dev.indexUs;
+        if (dev.damaged)
+            stats.damaged++;
+    }
+
+    xSemaphoreGive(xMutex);
+}
\ No newline at end of file
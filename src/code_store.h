@@ -0,0 +1,56 @@
+#ifndef CODE_STORE_H
+#define CODE_STORE_H
+
+#include <Arduino.h>
+#include "code_format.h"
+
+#define CODES_FILE "/codes.bin"          // Файл кодов устройства по умолчанию
+#define CODES_TEXT_FILE "/dataCodes.txt" // Текстовый файл прежних версий, переносится при загрузке
+#define DEVICES_DIR "/devices"           // Файлы остальных устройств: /devices/<имя>.bin (прежние - .txt)
+#define DEFAULT_DEVICE "default"    // Имя устройства по умолчанию
+#define DEVICE_NAME_LEN 16          // Максимальная длина имени устройства с '\0'
+#define CODE_MAX_DEVICES 16         // Максимальное число устройств
+#define CODE_PAGE_RECORDS 64        // Записей в странице кэша
+#define CODE_CACHE_PAGES 64         // Страниц кэша в PSRAM
+#define CODE_CACHE_PAGES_NO_PSRAM 4 // Страниц кэша во внутренней памяти, если PSRAM нет
+
+// Двоичный формат против текстового: размер и время разбора
+struct CodeStoreStats
+{
+    uint32_t codes;             // Записи проиндексированных устройств
+    uint32_t fileBytes;         // Их двоичные файлы
+    uint32_t textBytes;         // Те же записи в текстовом формате
+    uint32_t indexUs;           // Чтение и разбор двоичных файлов
+    uint8_t damaged;            // Оборванные файлы или файлы с неверной CRC
+    uint8_t migrated;           // Текстовые файлы, перенесенные при загрузке
+    uint32_t migratedCodes;
+    uint32_t migratedTextBytes;
+    uint32_t migratedBytes;     // Размер получившихся двоичных файлов
+    uint32_t textParseUs;       // Чтение и разбор перенесенных текстовых файлов
+};
+
+// Хранилище кодов: у каждого устройства свой двоичный файл (code_format.h), ID уникальны
+// на всех устройствах. При загрузке читается только список устройств, текстовые файлы прежних
+// версий переносятся в двоичный формат. Файл устройства индексируется при первом обращении,
+// записи подгружаются страницами в ограниченный кэш в PSRAM.
+// Все функции потокобезопасны (xMutex)
+bool codeStoreLoad();
+bool codeStoreClear();
+bool codeStoreFind(int id, CodeRecord &record, int *device = NULL); // device - устройство, в котором найден код
+bool codeStoreContains(int protocol, uint32_t address, uint32_t command, uint16_t bits);
+int codeStoreNextId();
+int codeStoreAppend(CodeRecord *records, int count); // В активное устройство; назначает ID, возвращает первый ID или -1
+
+int codeStoreDeviceCount();
+int codeStoreActiveDevice();
+int codeStoreSelectDevice(const char *name); // Создает устройство при необходимости; -1 - неверное имя или нет места
+bool codeStoreDeviceName(int device, char *name, size_t size);
+bool codeStoreDevicePath(int device, char *path, size_t size);
+int codeStoreDeviceCodes(int device);
+int codeStoreRead(int device, int start, CodeRecord *records, int count); // Записи устройства по порядку в файле
+uint8_t codeStoreDeviceChannel(int device); // Канал излучателя для кодов устройства
+bool codeStoreSetDeviceChannel(int device, uint8_t channel);
+bool codeStoreExportText(int device, int count, Print &out); // Первые count кодов устройства в текстовом формате
+void codeStoreStats(CodeStoreStats &stats);
+
+#endif // CODE_STORE_H
@@ -0,0 +1,111 @@
+#include "command_queue.h"
+#include <string.h>
+
+void CommandQueue::clear()
+{
+    memset(_jobs, 0, sizeof(_jobs));
+    memset(_perSource, 0, sizeof(_perSource));
+    memset(&_stats, 0, sizeof(_stats));
+    _count = 0;
+    _seq = 0;
+
+    for (int p = 0; p < COMMAND_PRIORITIES; p++)
+        _lastSource[p] = COMMAND_SOURCES - 1; // Первым выдается источник 0
+}
+
+CommandPushResult CommandQueue::push(int id, uint8_t source, int8_t channel, uint8_t priority, uint32_t now,
+                                     uint8_t *repeat)
+{
+    if (source >= COMMAND_SOURCES)
+        source = COMMAND_SOURCES - 1;
+    if (priority >= COMMAND_PRIORITIES)
+        priority = COMMAND_PRIORITY_NORMAL;
+
+    // Такая же команда еще ждет: вместо нового задания - повтор в ожидающем
+    for (int i = 0; i < COMMAND_QUEUE_LEN; i++)
+    {
+        CommandJob &job = _jobs[i];
+
+        if (job.id == id && job.source == source && job.channel == channel && job.repeat < COMMAND_REPEAT_MAX)
+        {
+            job.repeat++;
+            _stats.coalesced++;
+            if (repeat != NULL)
+                *repeat = job.repeat;
+            return COMMAND_COALESCED;
+        }
+    }
+
+    if (_count >= COMMAND_QUEUE_LEN)
+    {
+        _stats.rejected++;
+        return COMMAND_QUEUE_FULL;
+    }
+
+    if (_perSource[source] >= COMMAND_SOURCE_MAX)
+    {
+        _stats.rejected++;
+        return COMMAND_SOURCE_FULL;
+    }
+
+    for (int i = 0; i < COMMAND_QUEUE_LEN; i++)
+    {
+        if (_jobs[i].id != 0)
+            continue;
+
+        _jobs[i] = {id, source, channel, priority, 1, _seq++, now};
+        _count++;
+        _perSource[source]++;
+        _stats.queued++;
+        if (_count > _stats.maxDepth)
+            _stats.maxDepth = _count;
+        if (repeat != NULL)
+            *repeat = 1;
+        return COMMAND_QUEUED;
+    }
+
+    return COMMAND_QUEUE_FULL; // Недостижимо: _count < COMMAND_QUEUE_LEN
+}
+
+bool CommandQueue::pop(uint32_t now, CommandJob &job)
+{
+    if (_count == 0)
+        return false;
+
+    // Старший приоритет; внутри него - следующий по кругу источник, у источника - самое старое задание
+    for (uint8_t p = 0; p < COMMAND_PRIORITIES; p++)
+    {
+        for (uint8_t k = 1; k <= COMMAND_SOURCES; k++)
+        {
+            uint8_t source = (_lastSource[p] + k) % COMMAND_SOURCES;
+            int oldest = -1;
+
+            for (int i = 0; i < COMMAND_QUEUE_LEN; i++)
+            {
+                const CommandJob &j = _jobs[i];
+                if (j.id != 0 && j.priority == p && j.source == source &&
+                    (oldest < 0 || (int32_t)(j.seq - _jobs[oldest].seq) < 0))
+                    oldest = i;
+            }
+
+            if (oldest < 0)
+                continue;
+
+            job = _jobs[oldest];
+            _jobs[oldest].id = 0;
+            _count--;
+            _perSource[source]--;
+            _lastSource[p] = source;
+
+            uint32_t wait = now - job.queuedAt;
+            _stats.dispatched++;
+            _stats.waitSumMs += wait;
+            if (wait > _stats.waitMaxMs)
+                _stats.waitMaxMs = wait;
+
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,75 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define COMMAND_QUEUE_LEN 16   // Заданий в очереди
+#define COMMAND_SOURCE_MAX 10  // Заданий одного источника: остальное место остается другим источникам
+#define COMMAND_REPEAT_MAX 20  // Повторов в одном задании после объединения
+#define COMMAND_SOURCES 4      // Источников команд (CommandSource)
+
+// Срочные команды (выключение, стоп) обгоняют обычные, в том числе накопленные повторы
+enum CommandPriority : uint8_t
+{
+    COMMAND_PRIORITY_HIGH,
+    COMMAND_PRIORITY_NORMAL,
+    COMMAND_PRIORITIES
+};
+
+enum CommandPushResult : uint8_t
+{
+    COMMAND_QUEUED,      // Новое задание
+    COMMAND_COALESCED,   // Добавлено повтором к ожидающему такому же заданию
+    COMMAND_QUEUE_FULL,  // Очередь заполнена
+    COMMAND_SOURCE_FULL, // Источник исчерпал свою долю очереди
+};
+
+// Задание: код, отправляемый repeat раз подряд
+struct CommandJob
+{
+    int id;
+    uint8_t source;
+    int8_t channel;
+    uint8_t priority;
+    uint8_t repeat;
+    uint32_t seq;      // Порядок постановки: внутри источника задания идут по очереди
+    uint32_t queuedAt; // Время постановки, мс
+};
+
+// Счетчики с момента запуска
+struct CommandQueueStats
+{
+    uint32_t queued;
+    uint32_t coalesced;
+    uint32_t rejected;       // Очередь заполнена или источник исчерпал долю
+    uint32_t dispatched;
+    uint32_t waitSumMs;      // Ожидание в очереди всех выданных заданий
+    uint32_t waitMaxMs;
+    uint8_t maxDepth;
+};
+
+// Очередь команд Ядра 0: приоритеты, объединение одинаковых команд в одно задание
+// с числом повторов и поочередная выдача заданий разных источников внутри приоритета.
+// Не блокирует и не зависит от Arduino: время передается параметром. Не потокобезопасна
+class CommandQueue
+{
+public:
+    void clear();
+    CommandPushResult push(int id, uint8_t source, int8_t channel, uint8_t priority, uint32_t now, uint8_t *repeat = NULL); // id > 0
+    bool pop(uint32_t now, CommandJob &job);
+
+    uint8_t count() const { return _count; }
+    uint8_t countOf(uint8_t source) const { return source < COMMAND_SOURCES ? _perSource[source] : 0; }
+    const CommandQueueStats &stats() const { return _stats; }
+
+private:
+    CommandJob _jobs[COMMAND_QUEUE_LEN]; // id == 0 - ячейка свободна
+    uint8_t _count;
+    uint8_t _perSource[COMMAND_SOURCES];
+    uint8_t _lastSource[COMMAND_PRIORITIES]; // Источник последнего выданного задания приоритета
+    uint32_t _seq;
+    CommandQueueStats _stats;
+};
+
+#endif // COMMAND_QUEUE_H
@@ -9,6 +9,18 @@
 #define BOT_TOKEN "token"
 #define CHAT_ID "chat_id"
 
+// --- Telegram Bot API Server ---
+// For load tests point these at tools/fake_telegram_server.py (see README)
+#define TELEGRAM_API_HOST "api.telegram.org"
+#define TELEGRAM_API_PORT 443
+#define TELEGRAM_API_TLS true                       // false - plain HTTP, only for a local test server
+#define TELEGRAM_API_CERT TELEGRAM_CERTIFICATE_ROOT // Root CA of the server (PEM string)
+
+// --- Time Configuration (scheduler) ---
+#define TIME_ZONE "MSK-3"            // POSIX TZ string, e.g. "CET-1CEST,M3.5.0,M10.5.0/3"
+#define NTP_SERVER_1 "pool.ntp.org"
+#define NTP_SERVER_2 "time.google.com"
+
 // --- LCD Backlight Configuration ---
 #define LCD_BACKLIGHT_TIMEOUT_S 8 // Backlight timeout in seconds
 
@@ -0,0 +1,75 @@
+#include "ir_command.h"
+#include "name_index.h"
+#include "power_manager.h"
+
+// Очередь меняют задачи Telegram и расписания и основной цикл; операции короткие
+SemaphoreHandle_t commandMutex = NULL;
+CommandQueue irCommandQueue;
+
+// Приоритет по именам кода: решается индексом имен при добавлении имени, здесь - поиск по ID
+CommandPriority commandPriority(int id)
+{
+    return nameIndexUrgent(id) ? COMMAND_PRIORITY_HIGH : COMMAND_PRIORITY_NORMAL;
+}
+
+bool commandQueueBegin()
+{
+    if (commandMutex == NULL)
+        commandMutex = xSemaphoreCreateMutex();
+
+    irCommandQueue.clear();
+    return commandMutex != NULL;
+}
+
+CommandPushResult commandEnqueue(const IrCommand &cmd, uint8_t *repeat)
+{
+    // Имя ищется до захвата мьютекса очереди: индекс имен под своим мьютексом
+    CommandPriority priority = commandPriority(cmd.id);
+    CommandPushResult result = COMMAND_QUEUE_FULL;
+
+    if (xSemaphoreTake(commandMutex, portMAX_DELAY) == pdTRUE)
+    {
+        result = irCommandQueue.push(cmd.id, cmd.source, cmd.channel, priority, millis(), repeat);
+        xSemaphoreGive(commandMutex);
+    }
+
+    if (result == COMMAND_QUEUED || result == COMMAND_COALESCED)
+        powerNotify(POWER_EVENT_COMMAND);
+
+    return result;
+}
+
+bool commandDequeue(IrCommand &cmd, uint8_t &repeat)
+{
+    CommandJob job;
+    bool found = false;
+
+    if (xSemaphoreTake(commandMutex, portMAX_DELAY) == pdTRUE)
+    {
+        found = irCommandQueue.pop(millis(), job);
+        xSemaphoreGive(commandMutex);
+    }
+
+    if (!found)
+        return false;
+
+    cmd.id = job.id;
+    cmd.source = (CommandSource)job.source;
+    cmd.channel = job.channel;
+    repeat = job.repeat;
+    return true;
+}
+
+uint8_t commandQueueDepth()
+{
+    return irCommandQueue.count();
+}
+
+void commandQueueStats(CommandQueueStats &stats)
+{
+    if (xSemaphoreTake(commandMutex, portMAX_DELAY) == pdTRUE)
+    {
+        stats = irCommandQueue.stats();
+        xSemaphoreGive(commandMutex);
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef IR_COMMAND_H
+#define IR_COMMAND_H
+
+#include <Arduino.h>
+#include "command_queue.h"
+
+// Источник команды на отправку ИК-кода
+enum CommandSource : uint8_t
+{
+    CMD_SOURCE_TEXT,     // ID или команда, набранные в чате
+    CMD_SOURCE_KEYBOARD, // Нажатие inline-кнопки пульта
+    CMD_SOURCE_SCHEDULE, // Задание расписания
+    CMD_SOURCE_REPLAY,   // Команда из воспроизводимой трассы: код не отправляется, ответ только считается
+};
+
+// Команда от задач Ядра 1 для основного цикла Ядра 0
+struct IrCommand
+{
+    int id;
+    CommandSource source;
+    int8_t channel; // Канал излучателя, -1 - канал устройства, которому принадлежит код
+};
+
+// Очередь команд Ядро 1 -> Ядро 0 поверх CommandQueue. Постановка не блокирует: при
+// заполненной очереди вызывающий сразу отвечает пользователю, а сетевая задача продолжает опрос
+bool commandQueueBegin();
+CommandPushResult commandEnqueue(const IrCommand &cmd, uint8_t *repeat = NULL); // repeat - повторов в задании
+bool commandDequeue(IrCommand &cmd, uint8_t &repeat);                          // Только Ядро 0
+uint8_t commandQueueDepth();
+void commandQueueStats(CommandQueueStats &stats);
+
+#endif // IR_COMMAND_H
@@ -0,0 +1,182 @@
+#include "ir_import.h"
+#include "ir_import_parser.h"
+#include "code_store.h"
+#include "name_index.h"
+#include <SD.h>
+
+#define IMPORT_READ_LEN 512      // Блок чтения файла
+#define IMPORT_LINE_LEN 512      // Максимальная длина строки (длинные Pronto/raw обрезаются)
+#define IMPORT_BATCH_SIZE 64     // Записей в одной дозаписи файла кодов
+#define IMPORT_PROGRESS_STEP 500 // Шаг отчета о прогрессе
+
+extern void displayInfo(int posY, String nfo, unsigned long displayTime = 0, bool clearScreen = true);
+extern void sendAnswer(String text);
+
+// Состояние импорта: коды копятся пачкой и дозаписываются одним открытием файла
+struct ImportState
+{
+    CodeRecord batch[IMPORT_BATCH_SIZE];
+    char names[IMPORT_BATCH_SIZE][IMPORT_NAME_LEN]; // Имена кнопок пачки: регистрируются после выдачи ID
+    int batchCount;
+    int firstId;
+    uint32_t imported;
+    uint32_t collisions;
+    uint32_t named;
+    uint32_t nameCollisions; // Имя уже занято другим кодом (в том числе из этого же файла)
+    bool writeError;
+};
+
+ImportState importState;
+
+bool importFlushBatch()
+{
+    if (importState.batchCount == 0)
+        return true;
+
+    int firstId = codeStoreAppend(importState.batch, importState.batchCount);
+
+    if (firstId < 0)
+    {
+        importState.writeError = true;
+        return false;
+    }
+
+    if (importState.firstId == 0)
+        importState.firstId = firstId;
+
+    // Недопустимые имена (с пробелами и т.п.) пропускаются: код доступен по ID
+    for (int i = 0; i < importState.batchCount; i++)
+    {
+        const char *name = importState.names[i];
+
+        if (!nameIndexValid(name))
+            continue;
+
+        if (nameIndexFind(name) >= 0)
+            importState.nameCollisions++;
+        else if (nameIndexAdd(name, firstId + i))
+            importState.named++;
+    }
+
+    importState.imported += importState.batchCount;
+    importState.batchCount = 0;
+
+    if (importState.imported % IMPORT_PROGRESS_STEP < IMPORT_BATCH_SIZE)
+    {
+        sendAnswer("Import: " + String(importState.imported) + " codes...");
+        displayInfo(2, "Imported: " + String(importState.imported), 0, false);
+    }
+
+    return true;
+}
+
+bool importOnCode(const ImportedCode &code, void *ctx)
+{
+    // Коллизия: такой код уже есть в хранилище или в текущей пачке
+    bool collision = codeStoreContains(code.protocol, code.address, code.command, code.bits);
+
+    for (int i = 0; i < importState.batchCount && !collision; i++)
+    {
+        const CodeRecord &r = importState.batch[i];
+        collision = (r.protocol == code.protocol && r.address == code.address && r.command == code.command &&
+                     r.bits == code.bits);
+    }
+
+    if (collision)
+    {
+        importState.collisions++;
+        return true;
+    }
+
+    CodeRecord &record = importState.batch[importState.batchCount++];
+    record.protocol = code.protocol;
+    record.address = code.address;
+    record.command = code.command;
+    record.bits = code.bits;
+    strcpy(importState.names[importState.batchCount - 1], code.name);
+
+    if (importState.batchCount == IMPORT_BATCH_SIZE)
+        return importFlushBatch();
+
+    return true;
+}
+
+bool importCodesFile(const char *path)
+{
+    File file = SD.open(path, FILE_READ);
+
+    if (!file)
+    {
+        sendAnswer("Import: cannot open " + String(path));
+        return false;
+    }
+
+    displayInfo(0, F("IMPORTING CODES:"));
+    displayInfo(1, path, 0, false);
+    sendAnswer("Import started: " + String(path));
+
+    unsigned long startTime = millis();
+
+    memset(&importState, 0, sizeof(importState));
+
+    IrImportParser parser;
+    parser.begin(importOnCode, NULL);
+
+    static char block[IMPORT_READ_LEN];
+    static char line[IMPORT_LINE_LEN];
+    size_t lineLen = 0;
+    bool truncated = false;
+    bool running = true;
+    int n;
+
+    while (running && (n = file.read((uint8_t *)block, sizeof(block))) > 0)
+    {
+        for (int i = 0; i < n && running; i++)
+        {
+            if (block[i] != '\n')
+            {
+                if (lineLen < sizeof(line) - 1)
+                    line[lineLen++] = block[i];
+                else
+                    truncated = true;
+                continue;
+            }
+
+            line[lineLen] = '\0';
+            running = parser.feedLine(line, truncated);
+            lineLen = 0;
+            truncated = false;
+        }
+    }
+
+    if (running && lineLen > 0)
+    {
+        line[lineLen] = '\0';
+        running = parser.feedLine(line, truncated);
+    }
+
+    file.close();
+
+    if (running)
+        parser.end();
+
+    importFlushBatch();
+
+    unsigned long elapsed = millis() - startTime;
+
+    String report = importState.writeError ? "Import failed: SD write error\n" : "Import done\n";
+    report += "Imported: " + String(importState.imported);
+    if (importState.imported > 0)
+        report += " (IDs " + String(importState.firstId) + "-" + String(importState.firstId + importState.imported - 1) + ")";
+    report += "\nNames: " + String(importState.named) +
+              "\nCollisions: " + String(importState.collisions) + " codes, " + String(importState.nameCollisions) + " names" +
+              "\nUnsupported: " + String(parser.unsupported()) +
+              "\nTime: " + String(elapsed) + " ms";
+    sendAnswer(report);
+
+    displayInfo(0, importState.writeError ? F("IMPORT FAILED:") : F("IMPORT DONE:"), 0, true);
+    displayInfo(1, "Imported: " + String(importState.imported), 0, false);
+    displayInfo(2, "Collisions: " + String(importState.collisions), 2000, false);
+
+    return !importState.writeError;
+}
@@ -0,0 +1,12 @@
+#ifndef IR_IMPORT_H
+#define IR_IMPORT_H
+
+#include <Arduino.h>
+
+#define IMPORT_TEMP_FILE "/import.tmp" // Документ, загруженный из Telegram
+#define IMPORT_PATH_LEN 64
+
+// Импорт библиотеки ИК-кодов с SD-карты в хранилище кодов (выполняется на Ядре 0)
+bool importCodesFile(const char *path);
+
+#endif // IR_IMPORT_H
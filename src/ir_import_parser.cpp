@@ -0,0 +1,444 @@
+#include "ir_import_parser.h"
+#include <IRremoteESP8266.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define PRONTO_UNIT_US 0.241246 // Период несущей Pronto: частота = 1 / (слово * 0.241246 мкс)
+
+char *importTrim(char *s)
+{
+    while (*s == ' ' || *s == '\t')
+        s++;
+
+    size_t len = strlen(s);
+    while (len > 0 && (s[len - 1] == ' ' || s[len - 1] == '\t' || s[len - 1] == '\r'))
+        s[--len] = '\0';
+
+    return s;
+}
+
+bool importStartsWith(const char *s, const char *prefix)
+{
+    return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+void importCopyName(char *dst, const char *src, size_t len)
+{
+    if (len >= IMPORT_NAME_LEN)
+        len = IMPORT_NAME_LEN - 1;
+
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+uint8_t importReverse8(uint8_t b)
+{
+    b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+    b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+    b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
+    return b;
+}
+
+// 32-битное значение NEC/Samsung в порядке приема -> адрес и команда, как их выдает IRrecv
+void importPulseDistanceValue(uint32_t value, int protocol, ImportedCode &code)
+{
+    uint8_t address = importReverse8(value >> 24);
+    uint8_t addressInv = importReverse8(value >> 16);
+
+    code.protocol = protocol;
+    code.command = importReverse8(value >> 8);
+    code.address = address;
+
+    // Расширенный 16-битный адрес NEC: второй байт не инверсия первого
+    if (protocol == NEC && addressInv != (uint8_t)~address)
+        code.address = ((uint32_t)addressInv << 8) | address;
+}
+
+// Поле Flipper вида "07 00 00 00": байты младшим вперед
+uint32_t importHexBytes(const char *s)
+{
+    uint32_t value = 0;
+    char *end;
+
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        unsigned long b = strtoul(s, &end, 16);
+        if (end == s)
+            break;
+
+        value |= (uint32_t)(b & 0xFF) << shift;
+        s = end;
+    }
+
+    return value;
+}
+
+// NEC42 и NEC42ext - 42-битные кадры, не NEC: такие коды пропускаются как неподдерживаемые
+int importFlipperProtocol(const char *name)
+{
+    if (!strcmp(name, "NEC") || !strcmp(name, "NECext"))
+        return NEC;
+    if (!strcmp(name, "Samsung32"))
+        return SAMSUNG;
+    if (!strcmp(name, "RC5") || !strcmp(name, "RC5X"))
+        return RC5;
+    if (!strcmp(name, "RC6"))
+        return RC6;
+    if (!strcmp(name, "SIRC") || !strcmp(name, "SIRC15") || !strcmp(name, "SIRC20"))
+        return SONY;
+    return UNKNOWN;
+}
+
+// Длина кадра по имени протокола Flipper: у Sony три варианта, которые SONY не различает
+uint16_t importFlipperBits(const char *name)
+{
+    if (!strcmp(name, "SIRC"))
+        return 12;
+    if (!strcmp(name, "SIRC15"))
+        return 15;
+    if (!strcmp(name, "SIRC20"))
+        return 20;
+    if (!strcmp(name, "NEC") || !strcmp(name, "NECext") || !strcmp(name, "Samsung32"))
+        return 32;
+    return 0;
+}
+
+// Начало данных Pronto ("0000 ...") в строке, возможно после имени кнопки
+char *importProntoStart(char *line)
+{
+    for (char *p = strstr(line, "0000 "); p != NULL; p = strstr(p + 1, "0000 "))
+    {
+        if (p == line || p[-1] == ' ' || p[-1] == ':' || p[-1] == '\t')
+            return p;
+    }
+
+    return NULL;
+}
+
+void IrImportParser::begin(ImportCodeHandler handler, void *ctx)
+{
+    _handler = handler;
+    _ctx = ctx;
+    _format = FORMAT_UNKNOWN;
+    _codes = 0;
+    _unsupported = 0;
+    _stopped = false;
+
+    _blockOpen = false;
+    _lircInCodes = false;
+    _lircInRawCodes = false;
+}
+
+bool IrImportParser::feedLine(char *line, bool truncated)
+{
+    if (_stopped)
+        return false;
+
+    line = importTrim(line);
+
+    if (_format == FORMAT_UNKNOWN)
+    {
+        if (importStartsWith(line, "Filetype:") || importStartsWith(line, "name:"))
+            _format = FORMAT_FLIPPER;
+        else if (importStartsWith(line, "begin remote"))
+            _format = FORMAT_LIRC;
+        else if (importProntoStart(line) != NULL)
+            _format = FORMAT_PRONTO;
+        else
+            return true;
+    }
+
+    // Обрезанная строка может быть только длинным raw-кодом
+    if (truncated)
+    {
+        _unsupported++;
+        return true;
+    }
+
+    switch (_format)
+    {
+    case FORMAT_FLIPPER:
+        return flipperLine(line);
+    case FORMAT_LIRC:
+        return lircLine(line);
+    case FORMAT_PRONTO:
+        return prontoLine(line);
+    default:
+        return true;
+    }
+}
+
+bool IrImportParser::end()
+{
+    if (_format == FORMAT_FLIPPER && !_stopped)
+        flipperFlush();
+
+    return !_stopped;
+}
+
+bool IrImportParser::emit()
+{
+    _codes++;
+
+    if (!_handler(_code, _ctx))
+        _stopped = true;
+
+    return !_stopped;
+}
+
+bool IrImportParser::flipperLine(char *line)
+{
+    if (line[0] == '#' || line[0] == '\0')
+        return flipperFlush();
+
+    char *value = strchr(line, ':');
+    if (value == NULL)
+        return true;
+
+    *value = '\0';
+    value = importTrim(value + 1);
+
+    if (!strcmp(line, "name"))
+    {
+        if (!flipperFlush())
+            return false;
+
+        memset(&_code, 0, sizeof(_code));
+        importCopyName(_code.name, value, strlen(value));
+        _blockOpen = true;
+        _blockValid = true;
+        _blockFields = 0;
+    }
+    else if (!_blockOpen)
+    {
+        return true; // Заголовок файла: Filetype, Version
+    }
+    else if (!strcmp(line, "type"))
+    {
+        if (strcmp(value, "parsed") != 0)
+            _blockValid = false;
+    }
+    else if (!strcmp(line, "protocol"))
+    {
+        _code.protocol = importFlipperProtocol(value);
+        _code.bits = importFlipperBits(value);
+        if (_code.protocol == UNKNOWN)
+            _blockValid = false;
+        _blockFields |= 1;
+    }
+    else if (!strcmp(line, "address"))
+    {
+        _code.address = importHexBytes(value);
+        _blockFields |= 2;
+    }
+    else if (!strcmp(line, "command"))
+    {
+        _code.command = importHexBytes(value);
+        _blockFields |= 4;
+    }
+
+    return true;
+}
+
+bool IrImportParser::flipperFlush()
+{
+    if (!_blockOpen)
+        return true;
+
+    _blockOpen = false;
+
+    if (!_blockValid || _blockFields != 7)
+    {
+        _unsupported++;
+        return true;
+    }
+
+    // У NEC и Samsung команда 8-битная, Flipper хранит ее вместе с инверсией
+    if (_code.protocol == NEC || _code.protocol == SAMSUNG)
+        _code.command &= 0xFF;
+
+    return emit();
+}
+
+bool IrImportParser::lircLine(char *line)
+{
+    char *comment = strchr(line, '#');
+    if (comment != NULL)
+        *comment = '\0';
+
+    line = importTrim(line);
+    if (line[0] == '\0')
+        return true;
+
+    char *rest = line;
+    while (*rest && *rest != ' ' && *rest != '\t')
+        rest++;
+    if (*rest)
+        *rest++ = '\0';
+    rest = importTrim(rest);
+
+    if (!strcmp(line, "begin"))
+    {
+        if (!strcmp(rest, "remote"))
+        {
+            _lircBits = 0;
+            _lircPreDataBits = 0;
+            _lircPreData = 0;
+            _lircHeaderMark = 0;
+            _lircSpaceEnc = false;
+            _lircRc5 = false;
+        }
+        else if (!strcmp(rest, "codes"))
+            _lircInCodes = true;
+        else if (!strcmp(rest, "raw_codes"))
+            _lircInRawCodes = true;
+        return true;
+    }
+
+    if (!strcmp(line, "end"))
+    {
+        _lircInCodes = false;
+        _lircInRawCodes = false;
+        return true;
+    }
+
+    if (_lircInRawCodes)
+    {
+        if (!strcmp(line, "name"))
+            _unsupported++;
+        return true;
+    }
+
+    if (_lircInCodes)
+        return lircCode(line, strtoul(rest, NULL, 0));
+
+    if (!strcmp(line, "bits"))
+        _lircBits = atoi(rest);
+    else if (!strcmp(line, "pre_data_bits"))
+        _lircPreDataBits = atoi(rest);
+    else if (!strcmp(line, "pre_data"))
+        _lircPreData = strtoul(rest, NULL, 0);
+    else if (!strcmp(line, "header"))
+        _lircHeaderMark = strtoul(rest, NULL, 10);
+    else if (!strcmp(line, "flags"))
+    {
+        _lircSpaceEnc = strstr(rest, "SPACE_ENC") != NULL;
+        _lircRc5 = strstr(rest, "RC5") != NULL;
+    }
+
+    return true;
+}
+
+bool IrImportParser::lircCode(const char *name, uint32_t code)
+{
+    uint16_t totalBits = _lircPreDataBits + _lircBits;
+    uint64_t value = ((uint64_t)_lircPreData << _lircBits) | code;
+
+    memset(&_code, 0, sizeof(_code));
+    importCopyName(_code.name, name, strlen(name));
+    _code.bits = totalBits;
+
+    if (_lircRc5 && totalBits >= 12 && totalBits <= 14)
+    {
+        _code.protocol = RC5;
+        _code.address = (value >> 6) & 0x1F;
+        _code.command = value & 0x3F;
+        return emit();
+    }
+
+    if (_lircSpaceEnc && totalBits == 32)
+    {
+        // Тип определяется по длительности заголовка: NEC - 9 мс, Samsung - 4.5 мс
+        if (_lircHeaderMark == 0 || _lircHeaderMark > 6000)
+        {
+            importPulseDistanceValue((uint32_t)value, NEC, _code);
+            return emit();
+        }
+        if (_lircHeaderMark > 3500)
+        {
+            importPulseDistanceValue((uint32_t)value, SAMSUNG, _code);
+            return emit();
+        }
+    }
+
+    _unsupported++;
+    return true;
+}
+
+bool IrImportParser::prontoLine(char *line)
+{
+    char *p = importProntoStart(line);
+
+    if (p == NULL)
+        return true;
+
+    memset(&_code, 0, sizeof(_code));
+
+    // Имя перед данными: "POWER: 0000 006D ..."
+    if (p > line)
+    {
+        size_t len = p - line;
+        while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == ':' || line[len - 1] == '\t'))
+            len--;
+        importCopyName(_code.name, line, len);
+    }
+
+    // Слова 0-3: формат, частота, число пар; далее длительности в периодах несущей
+    char *end;
+    double unitUs = 0;
+    uint32_t mark = 0;
+    uint32_t value = 0;
+    int protocol = UNKNOWN;
+    int bits = 0;
+
+    for (int word = 0; bits < 32; word++)
+    {
+        unsigned long w = strtoul(p, &end, 16);
+        if (end == p)
+            break;
+        p = end;
+
+        if (word == 0 && w != 0)
+            break; // Поддерживается только формат записанного сигнала 0000
+        if (word == 1)
+            unitUs = w * PRONTO_UNIT_US;
+        if (word < 4)
+            continue;
+
+        uint32_t us = (uint32_t)(w * unitUs);
+
+        if (word % 2 == 0)
+        {
+            mark = us;
+            continue;
+        }
+
+        if (word == 5)
+        {
+            // Заголовок: NEC 9000/4500 мкс, Samsung 4500/4500 мкс
+            if (us > 3800 && us < 5200 && mark > 7500 && mark < 10500)
+                protocol = NEC;
+            else if (us > 3800 && us < 5200 && mark > 3800 && mark < 5200)
+                protocol = SAMSUNG;
+            else
+                break;
+            continue;
+        }
+
+        if (mark > 1000)
+            break;
+
+        value = (value << 1) | (us > 1100 ? 1 : 0);
+        bits++;
+    }
+
+    if (protocol == UNKNOWN || bits != 32)
+    {
+        _unsupported++;
+        return true;
+    }
+
+    importPulseDistanceValue(value, protocol, _code);
+    _code.bits = bits;
+    return emit();
+}
@@ -0,0 +1,75 @@
+#ifndef IR_IMPORT_PARSER_H
+#define IR_IMPORT_PARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define IMPORT_NAME_LEN 24 // Имя кнопки из файла библиотеки (обрезается)
+
+// Код, извлеченный из файла библиотеки, в формате записи кода
+struct ImportedCode
+{
+    int protocol; // decode_type_t
+    uint32_t address;
+    uint32_t command;
+    uint16_t bits; // Длина кадра; 0 - по умолчанию для протокола
+    char name[IMPORT_NAME_LEN];
+};
+
+// Обработчик кода; false - прервать импорт
+typedef bool (*ImportCodeHandler)(const ImportedCode &code, void *ctx);
+
+// Построчный разбор библиотек ИК-кодов: Flipper .ir, LIRC .conf и Pronto hex.
+// Формат определяется по содержимому, память не выделяется
+class IrImportParser
+{
+public:
+    void begin(ImportCodeHandler handler, void *ctx);
+    bool feedLine(char *line, bool truncated); // Строка без '\n'; false - импорт прерван
+    bool end();                                // Завершение последнего блока Flipper
+
+    uint32_t codes() const { return _codes; }             // Передано обработчику
+    uint32_t unsupported() const { return _unsupported; } // Пропущено: raw-коды и неизвестные протоколы
+
+private:
+    enum Format : uint8_t
+    {
+        FORMAT_UNKNOWN,
+        FORMAT_FLIPPER,
+        FORMAT_LIRC,
+        FORMAT_PRONTO
+    };
+
+    bool flipperLine(char *line);
+    bool flipperFlush();
+    bool lircLine(char *line);
+    bool lircCode(const char *name, uint32_t code);
+    bool prontoLine(char *line);
+    bool emit();
+
+    ImportCodeHandler _handler;
+    void *_ctx;
+    Format _format;
+    uint32_t _codes;
+    uint32_t _unsupported;
+    bool _stopped;
+
+    ImportedCode _code; // Собираемый код
+
+    // Блок Flipper .ir
+    bool _blockOpen;
+    bool _blockValid; // Тип parsed и протокол поддерживается
+    uint8_t _blockFields;
+
+    // Пульт LIRC
+    bool _lircInCodes;
+    bool _lircInRawCodes;
+    uint16_t _lircBits;
+    uint16_t _lircPreDataBits;
+    uint32_t _lircPreData;
+    uint32_t _lircHeaderMark;
+    bool _lircSpaceEnc;
+    bool _lircRc5;
+};
+
+#endif // IR_IMPORT_PARSER_H
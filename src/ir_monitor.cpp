@@ -0,0 +1,176 @@
+#include "ir_monitor.h"
+#include "ir_transmit.h"
+#include "power_manager.h"
+#include "trace_recorder.h"
+#include <IRrecv.h>
+
+IRrecv *irMonitorReceiver = NULL;
+decode_results irMonitorResults; // Используется только задачей приемника
+
+// Кольцевой буфер: head двигает задача приемника, tail - основной цикл
+IrCapture irMonitorRing[IR_MONITOR_RING_LEN];
+uint32_t irMonitorHead = 0;
+uint32_t irMonitorTail = 0;
+
+IrMonitorStats irMonitorCounters;
+uint32_t irMonitorProtocols[IR_MONITOR_PROTOCOLS];
+
+// Посекундные счетчики за окно: ячейка хранит номер своей секунды
+uint32_t irMonitorSecondCounts[IR_MONITOR_RATE_WINDOW];
+uint32_t irMonitorSecondStamps[IR_MONITOR_RATE_WINDOW];
+
+void irMonitorCount(const IrCapture &c)
+{
+    irMonitorCounters.frames++;
+
+    if (c.protocol == UNKNOWN)
+        irMonitorCounters.failures++;
+    else if (c.protocol > 0 && c.protocol < IR_MONITOR_PROTOCOLS)
+        irMonitorProtocols[c.protocol]++;
+
+    if (c.repeat)
+        irMonitorCounters.repeats++;
+
+    uint32_t second = c.time / 1000;
+    uint32_t slot = second % IR_MONITOR_RATE_WINDOW;
+
+    if (irMonitorSecondStamps[slot] != second)
+    {
+        irMonitorSecondStamps[slot] = second;
+        irMonitorSecondCounts[slot] = 0;
+    }
+    irMonitorSecondCounts[slot]++;
+}
+
+void irMonitorPush(const IrCapture &c)
+{
+    uint32_t head = irMonitorHead;
+
+    if (head - __atomic_load_n(&irMonitorTail, __ATOMIC_ACQUIRE) >= IR_MONITOR_RING_LEN)
+    {
+        irMonitorCounters.dropped++;
+        return;
+    }
+
+    irMonitorRing[head % IR_MONITOR_RING_LEN] = c;
+    __atomic_store_n(&irMonitorHead, head + 1, __ATOMIC_RELEASE); // Запись видна читателю только после копирования
+}
+
+void irMonitorTask(void *pvParameters)
+{
+    uint32_t lastFrame = 0;
+
+    for (;;)
+    {
+        IrCapture c;
+
+        // Кадры воспроизводимой трассы только учитываются в статистике: в буфер они не идут,
+        // иначе обучение и /sniff приняли бы их за нажатия пульта
+        if (traceReplayCapture(c))
+        {
+            irMonitorCount(c);
+            powerNotify(POWER_EVENT_IR);
+            continue;
+        }
+
+        if (!irMonitorReceiver->decode(&irMonitorResults))
+        {
+            // Кадр ждет в буфере приемника до опроса, поэтому в тишине опрос можно делать реже
+            bool idle = powerLowMode() && millis() - lastFrame > IR_MONITOR_ACTIVE_MS;
+            vTaskDelay(pdMS_TO_TICKS(idle ? IR_MONITOR_IDLE_POLL_MS : IR_MONITOR_POLL_MS));
+            continue;
+        }
+
+        c.time = millis();
+        c.protocol = irMonitorResults.decode_type;
+        c.value = irMonitorResults.value;
+        c.address = irMonitorResults.address;
+        c.command = irMonitorResults.command;
+        c.bits = irMonitorResults.bits;
+        c.rawlen = irMonitorResults.rawlen;
+        c.repeat = irMonitorResults.repeat;
+
+        if (irMonitorResults.overflow)
+            irMonitorCounters.overflows++;
+
+        irMonitorReceiver->resume();
+
+        lastFrame = c.time;
+        irMonitorCount(c);
+        irMonitorPush(c);
+        traceRecordCapture(c);
+        powerNotify(POWER_EVENT_IR);
+    }
+}
+
+bool irMonitorBegin(uint16_t pin)
+{
+    // save_buffer: приемник продолжает захват, пока задача разбирает предыдущий кадр
+    irMonitorReceiver = new IRrecv(pin, IR_MONITOR_RAW_LEN, IR_MONITOR_TIMEOUT_MS, true);
+
+    if (irMonitorReceiver == NULL)
+        return false;
+
+    irMonitorReceiver->enableIRIn();
+
+    TaskHandle_t task = NULL;
+
+    if (xTaskCreatePinnedToCore(irMonitorTask, "IrMonitor", IR_MONITOR_TASK_STACK, NULL,
+                                IR_MONITOR_TASK_PRIORITY, &task, IR_MONITOR_CORE) != pdPASS)
+        return false;
+
+    // Опрос приемника не прерывает передачу каналов своего ядра: кадр ждет в буфере приемника
+    irTransmitHoldOff(task, IR_MONITOR_CORE);
+    return true;
+}
+
+bool irMonitorRead(IrCapture &capture)
+{
+    uint32_t tail = irMonitorTail;
+
+    if (tail == __atomic_load_n(&irMonitorHead, __ATOMIC_ACQUIRE))
+        return false;
+
+    capture = irMonitorRing[tail % IR_MONITOR_RING_LEN];
+    __atomic_store_n(&irMonitorTail, tail + 1, __ATOMIC_RELEASE); // Ячейка освобождается после копирования
+    return true;
+}
+
+void irMonitorFlush()
+{
+    __atomic_store_n(&irMonitorTail, __atomic_load_n(&irMonitorHead, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+void irMonitorStats(IrMonitorStats &stats)
+{
+    stats = irMonitorCounters;
+}
+
+uint32_t irMonitorProtocolCount(int protocol)
+{
+    return (protocol > 0 && protocol < IR_MONITOR_PROTOCOLS) ? irMonitorProtocols[protocol] : 0;
+}
+
+uint32_t irMonitorRate(uint8_t seconds)
+{
+    uint32_t now = millis() / 1000;
+    uint32_t total = 0;
+
+    for (int i = 0; i < IR_MONITOR_RATE_WINDOW; i++)
+        if (now - irMonitorSecondStamps[i] < seconds && irMonitorSecondCounts[i] > 0)
+            total += irMonitorSecondCounts[i];
+
+    return total;
+}
+
+uint32_t irMonitorPeakRate()
+{
+    uint32_t now = millis() / 1000;
+    uint32_t peak = 0;
+
+    for (int i = 0; i < IR_MONITOR_RATE_WINDOW; i++)
+        if (now - irMonitorSecondStamps[i] < IR_MONITOR_RATE_WINDOW && irMonitorSecondCounts[i] > peak)
+            peak = irMonitorSecondCounts[i];
+
+    return peak;
+}
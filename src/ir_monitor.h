@@ -0,0 +1,53 @@
+#ifndef IR_MONITOR_H
+#define IR_MONITOR_H
+
+#include <Arduino.h>
+#include <IRremoteESP8266.h>
+
+#define IR_MONITOR_RING_LEN 32      // Захватов в кольцевом буфере (степень двойки)
+#define IR_MONITOR_RAW_LEN 1024     // Буфер длительностей приемника (длинные коды кондиционеров)
+#define IR_MONITOR_TIMEOUT_MS 15    // Пауза, завершающая кадр
+#define IR_MONITOR_POLL_MS 5        // Период опроса приемника
+#define IR_MONITOR_IDLE_POLL_MS 20  // Период опроса в экономном режиме без кадров (меньше паузы между кадрами NEC)
+#define IR_MONITOR_ACTIVE_MS 1000   // Столько после кадра приемник опрашивается с обычным периодом
+#define IR_MONITOR_TASK_STACK 4096  // Стек задачи приемника
+#define IR_MONITOR_TASK_PRIORITY 3  // Выше задач излучателей, но на время их передачи на том же ядре задача приостанавливается
+#define IR_MONITOR_CORE 0           // Ядро задачи приемника
+#define IR_MONITOR_PROTOCOLS 128    // Учитываемые в статистике протоколы (decode_type_t)
+#define IR_MONITOR_RATE_WINDOW 60   // Окно посекундной статистики, с
+
+// Разобранный кадр приемника
+struct IrCapture
+{
+    uint32_t time; // millis() приема
+    decode_type_t protocol;
+    uint64_t value;
+    uint32_t address;
+    uint32_t command;
+    uint16_t bits;
+    uint16_t rawlen;
+    bool repeat;
+};
+
+// Счетчики с момента запуска
+struct IrMonitorStats
+{
+    uint32_t frames;    // Все кадры
+    uint32_t failures;  // Кадры, не распознанные ни одним протоколом
+    uint32_t repeats;   // Кадры повтора
+    uint32_t overflows; // Длинный кадр не поместился в буфер приемника
+    uint32_t dropped;   // Кольцевой буфер был заполнен
+};
+
+// Фоновая задача приемника: кадры непрерывно разбираются и складываются в кольцевой
+// буфер без блокировок (один писатель - задача, один читатель - основной цикл Ядра 0).
+// Статистику ведет сама задача, читать ее можно с любого ядра
+bool irMonitorBegin(uint16_t pin);
+bool irMonitorRead(IrCapture &capture); // Только Ядро 0
+void irMonitorFlush();                  // Только Ядро 0: отбросить накопленные кадры
+void irMonitorStats(IrMonitorStats &stats);
+uint32_t irMonitorProtocolCount(int protocol);
+uint32_t irMonitorRate(uint8_t seconds); // Кадров за последние seconds секунд (до IR_MONITOR_RATE_WINDOW)
+uint32_t irMonitorPeakRate();            // Максимум кадров в секунду за окно
+
+#endif // IR_MONITOR_H
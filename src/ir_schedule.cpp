@@ -0,0 +1,205 @@
+#include "ir_schedule.h"
+#include "ir_command.h"
+#include <SD.h>
+
+extern void sendAnswer(String text);
+
+// Очередь заданий меняется из задачи Telegram и из задачи расписания
+SemaphoreHandle_t scheduleMutex = NULL;
+TaskHandle_t scheduleTaskHandle = NULL;
+ScheduleQueue scheduleQueue;
+
+bool scheduleTimeValid()
+{
+    return time(NULL) >= SCHEDULE_VALID_TIME;
+}
+
+// Файл расписания небольшой - переписываем его целиком (вызывается под scheduleMutex)
+void scheduleSave()
+{
+    File file = SD.open(SCHEDULE_FILE, FILE_WRITE);
+    if (!file)
+        return;
+
+    ScheduleEntry entry;
+    time_t due;
+    char line[SCHEDULE_LINE_LEN];
+
+    for (uint8_t i = 0; scheduleQueue.get(i, entry, due); i++)
+    {
+        scheduleFormatLine(entry, line, sizeof(line));
+        file.println(line);
+    }
+
+    file.close();
+}
+
+void scheduleLoad()
+{
+    File file = SD.open(SCHEDULE_FILE, FILE_READ);
+    if (!file)
+        return;
+
+    char line[SCHEDULE_LINE_LEN];
+    ScheduleEntry entry;
+
+    while (file.available())
+    {
+        size_t len = file.readBytesUntil('\n', line, sizeof(line) - 1);
+        line[len] = '\0';
+
+        if (scheduleParseLine(line, entry))
+            scheduleQueue.add(entry, time(NULL));
+    }
+
+    file.close();
+}
+
+// Одно задание, ставшее пропущенным или наступившее
+void scheduleRun(const ScheduleEntry &entry, ScheduleResult result)
+{
+    char when[SCHEDULE_WHEN_LEN];
+    scheduleFormatWhen(entry, when, sizeof(when));
+
+    if (result == SCHEDULE_MISSED)
+    {
+        sendAnswer("Schedule #" + String(entry.id) + " (" + when + ") missed: the device was off or the clock was not set.");
+        return;
+    }
+
+    // Обычный путь отправки: основной цикл найдет код и поставит его в очередь канала
+    IrCommand cmd = {entry.code, CMD_SOURCE_SCHEDULE, entry.channel};
+    CommandPushResult pushed = commandEnqueue(cmd);
+    if (pushed == COMMAND_QUEUE_FULL || pushed == COMMAND_SOURCE_FULL)
+        sendAnswer("Schedule #" + String(entry.id) + ": command queue is full, code ID " + String(entry.code) + " skipped.");
+}
+
+void scheduleTask(void *pvParameters)
+{
+    bool clockSet = false;
+
+    for (;;)
+    {
+        uint32_t sleepMs = SCHEDULE_CLOCK_WAIT_MS;
+
+        if (scheduleTimeValid())
+        {
+            ScheduleEntry entry;
+            ScheduleResult result;
+            time_t now = time(NULL);
+            time_t next = 0;
+
+            do
+            {
+                result = SCHEDULE_IDLE;
+
+                if (xSemaphoreTake(scheduleMutex, portMAX_DELAY) == pdTRUE)
+                {
+                    // Сроки, посчитанные до синхронизации часов, неверны
+                    if (!clockSet)
+                        scheduleQueue.rebuild(now);
+                    clockSet = true;
+
+                    result = scheduleQueue.poll(now, entry);
+                    // Выполненное разовое задание удаляется из файла
+                    if (result != SCHEDULE_IDLE && entry.days == 0)
+                        scheduleSave();
+                    next = scheduleQueue.nextDue();
+
+                    xSemaphoreGive(scheduleMutex);
+                }
+
+                // Отправка - вне мьютекса: sendAnswer может ждать места в очереди Telegram
+                if (result != SCHEDULE_IDLE)
+                    scheduleRun(entry, result);
+            } while (result != SCHEDULE_IDLE);
+
+            sleepMs = SCHEDULE_MAX_SLEEP_MS;
+            if (next != 0 && (unsigned long)(next - now) < SCHEDULE_MAX_SLEEP_MS / 1000)
+                sleepMs = (next - now) * 1000UL + 10; // Срок наступает с новой секундой
+        }
+
+        // Сон до ближайшего срока; scheduleAdd/scheduleRemove будят задачу раньше
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sleepMs));
+    }
+}
+
+bool scheduleBegin()
+{
+    if (scheduleMutex == NULL)
+        scheduleMutex = xSemaphoreCreateMutex();
+
+    scheduleQueue.clear();
+    scheduleLoad();
+
+    return xTaskCreatePinnedToCore(scheduleTask, "Schedule", SCHEDULE_TASK_STACK, NULL, SCHEDULE_TASK_PRIORITY,
+                                   &scheduleTaskHandle, 1) == pdPASS;
+}
+
+int scheduleAdd(ScheduleEntry &entry)
+{
+    if (scheduleMutex == NULL || xSemaphoreTake(scheduleMutex, portMAX_DELAY) != pdTRUE)
+        return -1;
+
+    entry.id = 0;
+    int id = scheduleQueue.add(entry, time(NULL));
+    if (id > 0)
+    {
+        entry.id = id;
+        scheduleSave();
+    }
+
+    xSemaphoreGive(scheduleMutex);
+
+    if (id > 0 && scheduleTaskHandle != NULL)
+        xTaskNotifyGive(scheduleTaskHandle);
+
+    return id;
+}
+
+bool scheduleRemove(uint8_t id)
+{
+    if (scheduleMutex == NULL || xSemaphoreTake(scheduleMutex, portMAX_DELAY) != pdTRUE)
+        return false;
+
+    bool removed = scheduleQueue.remove(id);
+    if (removed)
+        scheduleSave();
+
+    xSemaphoreGive(scheduleMutex);
+
+    if (removed && scheduleTaskHandle != NULL)
+        xTaskNotifyGive(scheduleTaskHandle);
+
+    return removed;
+}
+
+uint8_t scheduleCount()
+{
+    return scheduleQueue.count();
+}
+
+bool scheduleGet(uint8_t index, ScheduleEntry &entry, time_t &due)
+{
+    bool found = false;
+
+    if (scheduleMutex != NULL && xSemaphoreTake(scheduleMutex, portMAX_DELAY) == pdTRUE)
+    {
+        found = scheduleQueue.get(index, entry, due);
+        xSemaphoreGive(scheduleMutex);
+    }
+
+    return found;
+}
+
+bool scheduleClear()
+{
+    if (scheduleMutex == NULL || xSemaphoreTake(scheduleMutex, portMAX_DELAY) != pdTRUE)
+        return false;
+
+    scheduleQueue.clear();
+    SD.remove(SCHEDULE_FILE);
+
+    xSemaphoreGive(scheduleMutex);
+    return true;
+}
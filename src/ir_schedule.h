@@ -0,0 +1,25 @@
+#ifndef IR_SCHEDULE_H
+#define IR_SCHEDULE_H
+
+#include <Arduino.h>
+#include "schedule_queue.h"
+
+#define SCHEDULE_FILE "/schedule.txt"        // Задания расписания: строка на задание
+#define SCHEDULE_TASK_STACK 4096             // Стек задачи расписания
+#define SCHEDULE_TASK_PRIORITY 1             // Задаче достаточно точности в секунду
+#define SCHEDULE_CLOCK_WAIT_MS 10000         // Период проверки часов до синхронизации SNTP
+#define SCHEDULE_MAX_SLEEP_MS 3600000UL      // Максимальный сон задачи: часы могут быть подведены SNTP
+#define SCHEDULE_VALID_TIME 1700000000L      // Время раньше этой отметки - часы еще не синхронизированы
+
+// Расписание ИК-команд: задания хранятся на SD, задача просыпается только к ближайшему
+// сроку (или при изменении расписания) и ставит код в очередь команд, как команду из чата.
+// Пока SNTP не синхронизировал часы, задания не выполняются
+bool scheduleBegin();
+bool scheduleTimeValid();
+int scheduleAdd(ScheduleEntry &entry); // Возвращает id или -1
+bool scheduleRemove(uint8_t id);
+uint8_t scheduleCount();
+bool scheduleGet(uint8_t index, ScheduleEntry &entry, time_t &due); // Задания в порядке id
+bool scheduleClear();
+
+#endif // IR_SCHEDULE_H
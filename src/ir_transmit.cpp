@@ -0,0 +1,223 @@
+#include "ir_transmit.h"
+#include <IRremoteESP8266.h>
+#include <IRsend.h>
+
+// Задание на передачу
+struct IrTxJob
+{
+    CodeRecord record;
+    uint32_t queuedAt;
+    uint8_t count; // Кадров подряд
+};
+
+struct IrTxChannel
+{
+    IrTxChannelConfig config;
+    IRsend *sender;
+    QueueHandle_t queue;
+    IrTxStats stats; // Изменяет только задача канала
+};
+
+IrTxChannel irTxChannels[IR_TX_MAX_CHANNELS];
+uint8_t irTxChannelsCount = 0;
+
+// Передачи на одном ядре не должны перекрываться: ожидающие задачи с равным
+// приоритетом получают мьютекс в порядке очереди
+SemaphoreHandle_t irTxCoreLocks[2] = {NULL, NULL};
+
+// Задачи, приостанавливаемые на время передачи на своем ядре (приемник)
+TaskHandle_t irTxHoldOffTasks[2] = {NULL, NULL};
+
+bool irTransmitSupported(int protocol)
+{
+    switch (protocol)
+    {
+    case NEC:
+    case SONY:
+    case SAMSUNG:
+    case RC5:
+    case RC6:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Адрес и команда, как их выдает IRrecv, кодируются обратно в кадр протокола
+void irTxSend(IRsend &sender, const CodeRecord &r)
+{
+    switch (r.protocol)
+    {
+    case NEC:
+        sender.sendNEC(sender.encodeNEC(r.address, r.command));
+        break;
+    case SONY:
+        // Длина кадра из записи (у 20-битных старшие биты адреса - расширение); для кодов без нее: 5-битный адрес - 12 бит, иначе 15
+        if (r.bits == kSony20Bits)
+            sender.sendSony(sender.encodeSony(kSony20Bits, r.command, r.address, r.address >> 5), kSony20Bits);
+        else if (r.bits == kSony12Bits || (r.bits == 0 && r.address <= 0x1F))
+            sender.sendSony(sender.encodeSony(kSony12Bits, r.command, r.address), kSony12Bits);
+        else
+            sender.sendSony(sender.encodeSony(kSony15Bits, r.command, r.address), kSony15Bits);
+        break;
+    case SAMSUNG:
+        sender.sendSAMSUNG(sender.encodeSAMSUNG(r.address, r.command));
+        break;
+    case RC5:
+        sender.sendRC5(sender.encodeRC5(r.address, r.command));
+        break;
+    case RC6:
+        sender.sendRC6(sender.encodeRC6(r.address, r.command));
+        break;
+    }
+}
+
+void irTxTask(void *pvParameters)
+{
+    IrTxChannel &ch = *(IrTxChannel *)pvParameters;
+    SemaphoreHandle_t lock = irTxCoreLocks[ch.config.core];
+    IrTxJob job;
+
+    for (;;)
+    {
+        if (xQueueReceive(ch.queue, &job, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        // Повторы идут отдельными кадрами; между ними ядро свободно для других каналов
+        for (uint8_t n = 0; n < job.count; n++)
+        {
+            if (n > 0)
+                vTaskDelay(pdMS_TO_TICKS(IR_TX_REPEAT_GAP_MS));
+
+            uint32_t waitStart = millis();
+            xSemaphoreTake(lock, portMAX_DELAY);
+            uint32_t airStart = millis();
+
+            // Задача с более высоким приоритетом не должна вклиниваться в отсчет импульсов
+            TaskHandle_t holdOff = irTxHoldOffTasks[ch.config.core];
+            if (holdOff != NULL)
+                vTaskSuspend(holdOff);
+
+            irTxSend(*ch.sender, job.record);
+
+            if (holdOff != NULL)
+                vTaskResume(holdOff);
+
+            uint32_t airEnd = millis();
+            xSemaphoreGive(lock);
+
+            ch.stats.airMs += airEnd - airStart;
+            ch.stats.lockWaitMs += airStart - waitStart;
+
+            if (n > 0)
+            {
+                ch.stats.repeats++;
+                continue;
+            }
+
+            uint32_t queueDelay = airStart - job.queuedAt;
+
+            ch.stats.sent++;
+            ch.stats.queueDelayMs += queueDelay;
+            if (queueDelay > ch.stats.maxQueueDelayMs)
+                ch.stats.maxQueueDelayMs = queueDelay;
+        }
+    }
+}
+
+bool irTransmitBegin(const IrTxChannelConfig *channels, uint8_t count)
+{
+    for (int core = 0; core < 2; core++)
+        if (irTxCoreLocks[core] == NULL)
+            irTxCoreLocks[core] = xSemaphoreCreateMutex();
+
+    for (uint8_t i = 0; i < count && irTxChannelsCount < IR_TX_MAX_CHANNELS; i++)
+    {
+        IrTxChannel &ch = irTxChannels[irTxChannelsCount];
+
+        ch.config = channels[i];
+        ch.config.core = min(ch.config.core, (uint8_t)1);
+        ch.sender = new IRsend(ch.config.pin);
+        ch.queue = xQueueCreate(IR_TX_QUEUE_LEN, sizeof(IrTxJob));
+        memset(&ch.stats, 0, sizeof(ch.stats));
+
+        if (ch.sender == NULL || ch.queue == NULL)
+            return false;
+
+        ch.sender->begin();
+
+        char name[12];
+        snprintf(name, sizeof(name), "IrTx%d", irTxChannelsCount);
+
+        if (xTaskCreatePinnedToCore(irTxTask, name, IR_TX_TASK_STACK, &ch, IR_TX_TASK_PRIORITY, NULL, ch.config.core) != pdPASS)
+            return false;
+
+        irTxChannelsCount++;
+    }
+
+    return irTxChannelsCount == count;
+}
+
+void irTransmitHoldOff(TaskHandle_t task, uint8_t core)
+{
+    irTxHoldOffTasks[min(core, (uint8_t)1)] = task;
+}
+
+uint8_t irTransmitChannels()
+{
+    return irTxChannelsCount;
+}
+
+uint8_t irTransmitPin(uint8_t channel)
+{
+    return channel < irTxChannelsCount ? irTxChannels[channel].config.pin : 0;
+}
+
+bool irTransmitEnqueue(uint8_t channel, const CodeRecord &record, uint8_t count)
+{
+    if (channel >= irTxChannelsCount)
+        return false;
+
+    IrTxChannel &ch = irTxChannels[channel];
+    IrTxJob job = {record, (uint32_t)millis(), max(count, (uint8_t)1)};
+
+    if (xQueueSend(ch.queue, &job, 0) != pdPASS)
+    {
+        ch.stats.rejected++;
+        return false;
+    }
+
+    return true;
+}
+
+bool irTransmitStats(uint8_t channel, IrTxStats &stats)
+{
+    if (channel >= irTxChannelsCount)
+        return false;
+
+    stats = irTxChannels[channel].stats;
+    return true;
+}
+
+float irTransmitFairness()
+{
+    float sum = 0;
+    float sumSquares = 0;
+    int n = 0;
+
+    for (uint8_t i = 0; i < irTxChannelsCount; i++)
+    {
+        const IrTxStats &s = irTxChannels[i].stats;
+
+        if (s.sent == 0)
+            continue;
+
+        // Ожидание ниже 1 мс считается равным 1 мс, чтобы простаивающие каналы не искажали индекс
+        float delay = max(1.0f, (float)s.queueDelayMs / s.sent);
+        sum += delay;
+        sumSquares += delay * delay;
+        n++;
+    }
+
+    return n > 0 ? (sum * sum) / (n * sumSquares) : 1.0f;
+}
@@ -0,0 +1,45 @@
+#ifndef IR_TRANSMIT_H
+#define IR_TRANSMIT_H
+
+#include <Arduino.h>
+#include "code_store.h"
+
+#define IR_TX_MAX_CHANNELS 4    // Максимальное число каналов-излучателей
+#define IR_TX_QUEUE_LEN 8       // Очередь передачи одного канала
+#define IR_TX_TASK_STACK 3072   // Стек задачи канала
+#define IR_TX_TASK_PRIORITY 2   // Выше основного цикла: паузы ИК-сигнала отсчитываются активным ожиданием
+#define IR_TX_REPEAT_GAP_MS 120 // Пауза между повторами одного задания: приемник видит отдельные нажатия
+
+// Канал-излучатель: пин светодиода и ядро, на котором работает его задача. IRsend отмеряет
+// импульсы программно, поэтому Ядро 0 с задачами WiFi/lwIP для каналов не подходит
+struct IrTxChannelConfig
+{
+    uint8_t pin;
+    uint8_t core;
+};
+
+// Метрики канала с момента запуска
+struct IrTxStats
+{
+    uint32_t sent;
+    uint32_t repeats;         // Дополнительные кадры заданий с повторами
+    uint32_t rejected;        // Очередь канала была заполнена
+    uint32_t airMs;           // Суммарное время передачи
+    uint32_t lockWaitMs;      // Ожидание передач других каналов на том же ядре
+    uint32_t queueDelayMs;    // Сумма задержек от постановки в очередь до начала передачи
+    uint32_t maxQueueDelayMs;
+};
+
+// Передача ИК-кодов по нескольким каналам. У каждого канала своя очередь и задача.
+// Каналы на разных ядрах передают одновременно; на одном ядре передачи идут по очереди,
+// так как IRsend отмеряет импульсы активным ожиданием
+bool irTransmitBegin(const IrTxChannelConfig *channels, uint8_t count);
+void irTransmitHoldOff(TaskHandle_t task, uint8_t core); // Задача приостанавливается на время передач каналов ядра core
+uint8_t irTransmitChannels();
+uint8_t irTransmitPin(uint8_t channel);
+bool irTransmitSupported(int protocol);
+bool irTransmitEnqueue(uint8_t channel, const CodeRecord &record, uint8_t count = 1); // Не блокирует; false - канал занят
+bool irTransmitStats(uint8_t channel, IrTxStats &stats);
+float irTransmitFairness(); // Индекс Джейна по средней задержке в очереди загруженных каналов
+
+#endif // IR_TRANSMIT_H
@@ -0,0 +1,245 @@
+#include "learn_session.h"
+#include "code_store.h"
+#include "name_index.h"
+
+#define LEARN_SESSION_SLOTS (LEARN_SESSION_MAX * 2) // Ячеек хеш-набора сессии
+
+extern void displayInfo(int posY, String nfo, unsigned long displayTime = 0, bool clearScreen = true);
+extern void sendAnswer(String text);
+extern String getProtocolName(decode_type_t protocol);
+
+// Состояние сессии: коды копятся здесь и пишутся в хранилище одним вызовом
+struct LearnSession
+{
+    CodeRecord records[LEARN_SESSION_MAX];
+    char names[LEARN_SESSION_MAX][NAME_MAX_LEN + 1];
+    int8_t slots[LEARN_SESSION_SLOTS]; // Хеш-набор (protocol, address, command, bits): индексы кодов, -1 - пусто
+    int count;
+    int awaitingName; // Код, которому предложено имя, -1 - нет
+
+    uint32_t repeats;    // Повторные кадры удерживаемой кнопки
+    uint32_t duplicates; // Код уже пойман в этой сессии
+    uint32_t stored;     // Код уже есть в хранилище
+
+    // Последний принятый кадр - для отсева повторов
+    int lastProtocol;
+    uint32_t lastAddress;
+    uint32_t lastCommand;
+    uint16_t lastBits;
+    unsigned long lastFrameTime;
+    unsigned long lastActivity;
+};
+
+volatile bool learnSessionRunning = false; // Читается Ядром 1 для маршрутизации имен
+LearnSession learnSession;
+
+uint32_t learnKeyHash(int protocol, uint32_t address, uint32_t command, uint16_t bits)
+{
+    uint32_t h = 2166136261UL;
+    uint32_t parts[4] = {(uint32_t)protocol, address, command, bits};
+
+    for (int i = 0; i < 4; i++)
+    {
+        h ^= parts[i];
+        h *= 16777619UL;
+        h ^= h >> 15;
+    }
+
+    return h;
+}
+
+// Поиск в хеш-наборе; при отсутствии - индекс свободной ячейки через slot
+bool learnSessionSeen(int protocol, uint32_t address, uint32_t command, uint16_t bits, uint32_t &slot)
+{
+    uint32_t mask = LEARN_SESSION_SLOTS - 1;
+
+    for (slot = learnKeyHash(protocol, address, command, bits) & mask; learnSession.slots[slot] >= 0; slot = (slot + 1) & mask)
+    {
+        int i = learnSession.slots[slot];
+        const CodeRecord &r = learnSession.records[i];
+
+        if (r.protocol == protocol && r.address == address && r.command == command && r.bits == bits)
+            return true;
+    }
+
+    return false;
+}
+
+void learnSessionBegin()
+{
+    memset(&learnSession, 0, sizeof(learnSession));
+    memset(learnSession.slots, 0xFF, sizeof(learnSession.slots));
+    learnSession.awaitingName = -1;
+    learnSession.lastProtocol = UNKNOWN;
+    learnSession.lastActivity = millis();
+    learnSessionRunning = true;
+
+    sendAnswer(F("BATCH LEARNING:\nPress the remote buttons one by one. After each code send a name for it or /skip.\n/done or a double click finishes the session."));
+
+    displayInfo(0, F("BATCH LEARNING:"));
+    displayInfo(1, F("Press remote buttons"), 0, false);
+    displayInfo(2, F("2 clicks - finish"), 0, false);
+}
+
+bool learnSessionActive()
+{
+    return learnSessionRunning;
+}
+
+void learnSessionCapture(const IrCapture &capture)
+{
+    LearnSession &s = learnSession;
+    int protocol = capture.protocol;
+    unsigned long now = capture.time;
+
+    // Удерживаемая кнопка: кадр повтора или тот же код сразу за предыдущим
+    bool sameAsLast = protocol == s.lastProtocol && capture.address == s.lastAddress &&
+                      capture.command == s.lastCommand && capture.bits == s.lastBits;
+    bool repeat = capture.repeat || (sameAsLast && now - s.lastFrameTime < LEARN_REPEAT_MS);
+
+    s.lastProtocol = protocol;
+    s.lastAddress = capture.address;
+    s.lastCommand = capture.command;
+    s.lastBits = capture.bits;
+    s.lastFrameTime = now;
+
+    if (repeat)
+    {
+        s.repeats++;
+        return;
+    }
+
+    // Кадр повтора NEC приходит без данных, поэтому длина проверяется после отсева повторов
+    if (capture.bits == 0 || capture.bits > 64)
+    {
+        sendAnswer(F("Invalid IR code length!"));
+        return;
+    }
+
+    s.lastActivity = now;
+
+    uint32_t slot;
+    if (learnSessionSeen(protocol, capture.address, capture.command, capture.bits, slot))
+    {
+        s.duplicates++;
+        sendAnswer(F("Already captured in this session, skipped."));
+        return;
+    }
+
+    if (codeStoreContains(protocol, capture.address, capture.command, capture.bits))
+    {
+        s.stored++;
+        sendAnswer(F("Already saved on the device, skipped."));
+        return;
+    }
+
+    int i = s.count++;
+    s.records[i] = {0, protocol, capture.address, capture.command, capture.bits};
+    s.slots[slot] = i;
+    s.awaitingName = i;
+
+    sendAnswer("Code " + String(i + 1) + ": " + getProtocolName(capture.protocol) +
+               " addr 0x" + String(capture.address, HEX) + " cmd 0x" + String(capture.command, HEX) +
+               "\nSend a name for it, /skip or click the button.");
+
+    displayInfo(1, "Codes: " + String(s.count), 0, false);
+    displayInfo(3, getProtocolName(capture.protocol) + " " + String(capture.command, HEX), 0, false);
+
+    if (s.count == LEARN_SESSION_MAX)
+    {
+        sendAnswer(F("Session buffer is full, saving..."));
+        learnSessionEnd();
+    }
+}
+
+void learnSessionName(const char *name)
+{
+    LearnSession &s = learnSession;
+    int i = s.awaitingName;
+
+    s.lastActivity = millis();
+
+    if (i < 0)
+    {
+        if (name != NULL && name[0] != '\0')
+            sendAnswer(F("No code is waiting for a name."));
+        return;
+    }
+
+    if (name == NULL || name[0] == '\0')
+    {
+        s.awaitingName = -1;
+        sendAnswer(F("Skipped."));
+        return;
+    }
+
+    // Окончательная проверка имени - при записи в индекс имен
+    bool taken = nameIndexFind(name) > 0;
+    for (int j = 0; j < s.count && !taken; j++)
+        taken = strcasecmp(s.names[j], name) == 0;
+
+    if (taken)
+    {
+        sendAnswer(F("Error: This name is already in use, send another one."));
+        return;
+    }
+
+    if (!isalpha((uint8_t)name[0]) || strlen(name) > NAME_MAX_LEN)
+    {
+        sendAnswer(F("Error: Name must start with a letter and contain up to 31 letters, digits, '.', '_' or '-'"));
+        return;
+    }
+
+    strcpy(s.names[i], name);
+    s.awaitingName = -1;
+    sendAnswer("Code " + String(i + 1) + " named " + String(name));
+}
+
+bool learnSessionExpired()
+{
+    return millis() - learnSession.lastActivity > LEARN_SESSION_TIMEOUT_MS;
+}
+
+void learnSessionEnd()
+{
+    LearnSession &s = learnSession;
+    int firstId = 0;
+    int named = 0;
+
+    learnSessionRunning = false;
+
+    // Все коды сессии - одной дозаписью
+    if (s.count > 0)
+    {
+        firstId = codeStoreAppend(s.records, s.count);
+
+        if (firstId < 0)
+        {
+            sendAnswer(F("Error: Could not save IR codes to SD card"));
+            displayInfo(1, F("Error opening file, or file is absent!"), 2000);
+            return;
+        }
+
+        for (int i = 0; i < s.count; i++)
+        {
+            if (s.names[i][0] == '\0')
+                continue;
+
+            if (nameIndexAdd(s.names[i], s.records[i].id))
+                named++;
+            else
+                sendAnswer("Error: Could not name code " + String(s.records[i].id) + " as " + String(s.names[i]));
+        }
+    }
+
+    String report = "Batch learning finished.\nSaved: " + String(s.count) + " codes";
+    if (s.count > 0)
+        report += " (IDs " + String(firstId) + "-" + String(firstId + s.count - 1) + ")";
+    report += "\nNamed: " + String(named) +
+              "\nDropped: " + String(s.repeats) + " repeat frames, " + String(s.duplicates) +
+              " captured twice, " + String(s.stored) + " already saved";
+    sendAnswer(report);
+
+    displayInfo(0, F("BATCH LEARNING DONE"));
+    displayInfo(1, "Saved: " + String(s.count), 2000, false);
+}
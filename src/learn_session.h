@@ -0,0 +1,21 @@
+#ifndef LEARN_SESSION_H
+#define LEARN_SESSION_H
+
+#include <Arduino.h>
+#include "ir_monitor.h"
+
+#define LEARN_SESSION_MAX 32              // Кодов за сессию (копятся в памяти до записи на SD)
+#define LEARN_REPEAT_MS 400               // Тот же код в этом окне - повтор удерживаемой кнопки
+#define LEARN_SESSION_TIMEOUT_MS 120000UL // Сессия завершается, если новых кодов нет
+
+// Пакетное обучение: серия кнопок за одну сессию. Повторные кадры и уже сохраненные
+// коды отбрасываются, после каждого кода предлагается дать ему имя.
+// Коды записываются в хранилище одной дозаписью при завершении. Вызывается Ядром 0
+void learnSessionBegin();
+bool learnSessionActive();
+void learnSessionCapture(const IrCapture &capture);
+void learnSessionName(const char *name); // NULL или "" - оставить код без имени
+bool learnSessionExpired();
+void learnSessionEnd();
+
+#endif // LEARN_SESSION_H
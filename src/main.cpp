@@ -1,7 +1,6 @@
 #include <Arduino.h>
 #include <IRremoteESP8266.h>
 #include <IRrecv.h>
-#include <IRsend.h>
 #include <IRutils.h>
 #include <EncButton.h>
 #include <SD.h>
@@ -10,6 +9,16 @@
 #include <GyverOLED.h>
 #include "config.h"
 #include "wifi_telegram_core.h"
+#include "ir_command.h"
+#include "code_store.h"
+#include "ir_import.h"
+#include "name_index.h"
+#include "learn_session.h"
+#include "ir_transmit.h"
+#include "ir_monitor.h"
+#include "ir_schedule.h"
+#include "power_manager.h"
+#include "trace_recorder.h"
 
 // --- Выбор типа дисплея ---
 #define USE_LCD_DISPLAY // Использовать LCD 20x4
@@ -17,7 +26,9 @@
 
 // --- Пины для ESP32 WROWER ---
 #define IR_RECEIVE_PIN 15 // GPIO15 для ИК-приемника
-#define IR_SEND_PIN 2     // GPIO2 для ИК-передатчика
+#define IR_SEND_PIN 2     // GPIO2 для ИК-передатчика (канал 1)
+#define IR_SEND_PIN_2 26  // GPIO26 для второго ИК-передатчика (канал 2)
+#define IR_SEND_PIN_3 27  // GPIO27 для третьего ИК-передатчика (канал 3)
 #define BUTTON_PIN 25     // GPIO25 для кнопки
 #define SD_CS_PIN 4       // GPIO4 для CS SD-карты
 
@@ -29,23 +40,28 @@
 #define OLED_WIDTH 128  // Ширина OLED
 #define OLED_HEIGHT 64  // Высота OLED
 
+#define SNIFF_INTERVAL_MS 1000 // Кадры режима прослушивания отправляются одним сообщением не чаще раза в период
+#define SNIFF_TEXT_LEN 512     // Буфер сообщения режима прослушивания
+
 #define LCD_COLS 20 // Ширина LCD
 #define LCD_ROWS 4  // Высота LCD
 
 // --- Переменные ---
 volatile bool btnPressed = false;    // Флаг нажатия кнопки
 volatile bool clearAllCodes = false; // Флаг для очистки кодов по команде
+volatile bool importRequested = false; // Флаг импорта библиотеки кодов из importPath
+char importPath[IMPORT_PATH_LEN];
+volatile bool learnSessionRequested = false; // Запуск пакетного обучения
+volatile bool learnSessionStop = false;      // Завершение пакетного обучения
+volatile bool learnNameReady = false;        // В learnName имя для последнего кода сессии ("" - пропустить)
+char learnName[NAME_MAX_LEN + 1];
+volatile bool sniffMode = false; // Вывод всех принятых ИК-кадров в Telegram
 
 // Флаг готовности сетевого подключения на втором ядре
 volatile bool networkInitialized = false;
 
 #include "freertos/queue.h"
 QueueHandle_t telegramQueue;
-QueueHandle_t commandQueue;
-
-// Кэш данных с SD-карты
-String *codesData = NULL;
-int codesCount = 0;
 
 // Мьютекс для синхронизации доступа к общим ресурсам
 SemaphoreHandle_t xMutex;
@@ -54,9 +70,14 @@ SemaphoreHandle_t xMutex;
 LiquidCrystal_I2C lcd(0x27, LCD_COLS, LCD_ROWS);
 GyverOLED<SSH1106_128x64> oled;
 Button btn(BUTTON_PIN, INPUT_PULLUP, LOW);
-IRrecv irrecv(IR_RECEIVE_PIN);
-IRsend irsend(IR_SEND_PIN);
-decode_results results;
+
+// Каналы ИК-передатчиков: пин и ядро задачи канала. Все на Ядре 1: на Ядре 0 задачи WiFi/lwIP
+// с более высоким приоритетом вытесняли бы канал посреди импульса и искажали кадр
+const IrTxChannelConfig irTxConfig[] = {
+    {IR_SEND_PIN, 1},
+    {IR_SEND_PIN_2, 1},
+    {IR_SEND_PIN_3, 1},
+};
 
 // Функции
 void initDisplay();
@@ -66,10 +87,11 @@ void displayMainMenu();
 void DisplayLcdInfoCenter(int posY, String nfo, unsigned long displayTime = 0, bool clearScreen = true);
 void BackToLcdMainMenu();
 void sendAnswer(String text);
-int getNextID();
 String getProtocolName(decode_type_t protocol);
 void lcdBacklightControl();
 void resetBacklightTimer();
+void sniffCapture(const IrCapture &capture);
+void sniffFlush(bool force);
 
 // Переменные для управления подсветкой
 unsigned long lastActivityTime;
@@ -99,6 +121,20 @@ void setup()
     else
         displayInfo(1, F("SD passed"), 1000);
 
+    // Режим питания из NVS; прерывание кнопки будит основной цикл в экономном режиме
+    powerBegin(BUTTON_PIN);
+
+    // Очереди и мьютекс создаются до запуска сетевой задачи: она обращается к ним сразу после подключения
+    // Создание очереди для сообщений в Telegram
+    // Очередь будет содержать указатели на строки (String*)
+    telegramQueue = xQueueCreate(10, sizeof(String *));
+
+    // Очередь команд (IrCommand) с приоритетами и объединением повторов
+    commandQueueBegin();
+
+    // Создание мьютекса для синхронизации
+    xMutex = xSemaphoreCreateMutex();
+
     // Создаем задачу для WiFi и Telegram на втором ядре
     xTaskCreatePinnedToCore(
         wifiTelegramTask,   // Функция задачи
@@ -116,62 +152,37 @@ void setup()
         delay(10);
     }
 
-    // Создание очереди для сообщений в Telegram
-    // Очередь будет содержать указатели на строки (String*)
-    telegramQueue = xQueueCreate(10, sizeof(String *));
-
-    // Создание очереди для ID команд
-    commandQueue = xQueueCreate(10, sizeof(int));
-
-    // Создание мьютекса для синхронизации
-    xMutex = xSemaphoreCreateMutex();
-
     // Кэширование данных с SD-карты
     displayInfo(1, F("Loading codes from SD..."), 1000);
 
-    File file = SD.open("/dataCodes.txt", FILE_READ);
+    // Имена кодов (tv.power и т.п.) загружаются первыми: индексация файла устройства переносит в них его раздел имен
+    nameIndexLoad();
 
-    if (file)
+    // Читается только список устройств: коды подгружаются по требованию
+    if (codeStoreLoad())
     {
-        int lines = 0;
-
-        while (file.available())
-        {
-            file.readStringUntil('\n');
-            lines++;
-        }
-
-        file.close();
-
-        codesData = new String[lines];
-        codesCount = lines;
-
-        file = SD.open("/dataCodes.txt", FILE_READ);
-
-        for (int i = 0; i < lines && file.available(); i++)
-        {
-            codesData[i] = file.readStringUntil('\n');
-        }
-
-        file.close();
-
-        sendAnswer("Codes loaded " + String(codesCount));
-        displayInfo(1, String("Codes loaded ") + String(codesCount), 1000);
+        sendAnswer("Code devices found: " + String(codeStoreDeviceCount()));
+        displayInfo(1, String("Devices: ") + String(codeStoreDeviceCount()), 1000);
     }
     else
     {
         sendAnswer(F("No codes file found!"));
         displayInfo(1, F("No codes file found!"), 1000);
-
-        codesData = NULL;
-        codesCount = 0;
     }
 
+    // Задания выполняются после синхронизации часов по SNTP в сетевой задаче
+    if (scheduleBegin())
+        sendAnswer("Scheduled actions: " + String(scheduleCount()));
+    else
+        sendAnswer(F("Error: Scheduler task did not start"));
+
     sendAnswer(F("READY"));
 
     // Инициализация ИК-приемника и передатчика
-    irrecv.enableIRIn();
-    irsend.begin();
+    if (!irMonitorBegin(IR_RECEIVE_PIN))
+        sendAnswer(F("Error: IR receiver task did not start"));
+    if (!irTransmitBegin(irTxConfig, sizeof(irTxConfig) / sizeof(irTxConfig[0])))
+        sendAnswer(F("Error: Not all IR emitter channels started"));
 
     displayMainMenu();
 
@@ -194,8 +205,16 @@ void loop()
 
         switch (btnCnt)
         {
+        case 1:
+            // В пакетном обучении: оставить последний код без имени
+            if (learnSessionActive())
+                learnSessionName(NULL);
+            break;
         case 2:
-            btnPressed = true;
+            if (learnSessionActive())
+                learnSessionStop = true;
+            else
+                btnPressed = true;
             break;
         default:
             displayInfo(0, F("Other clicks not implemented."));
@@ -208,21 +227,12 @@ void loop()
     if (btn.hold() || clearAllCodes)
     {
         resetBacklightTimer(); // Сбрасываем таймер при активности
-        displayInfo(1, F("Deleting dataCodes.txt..."), 1000);
-        sendAnswer(F("Deleting dataCodes.txt..."));
-        if (SD.exists("/dataCodes.txt"))
+        displayInfo(1, F("Deleting codes..."), 1000);
+        sendAnswer(F("Deleting codes..."));
+        nameIndexClear(); // Имена и расписание ссылаются на удаляемые ID
+        scheduleClear();
+        if (codeStoreClear())
         {
-            SD.remove("/dataCodes.txt");
-
-            // Очищаем кэш
-            if (codesData != NULL && xSemaphoreTake(xMutex, portMAX_DELAY) == pdTRUE)
-            {
-                delete[] codesData;
-                codesData = NULL;
-                codesCount = 0;
-                xSemaphoreGive(xMutex);
-            }
-
             displayInfo(2, F("File deleted."), 1000, false);
             sendAnswer(F("IR codes file deleted. Cache cleared."));
         }
@@ -238,6 +248,57 @@ void loop()
             clearAllCodes = false;
     }
 
+    // Импорт библиотеки кодов: файл на SD-карте или документ из Telegram
+    if (importRequested)
+    {
+        resetBacklightTimer(); // Сбрасываем таймер при активности
+        importCodesFile(importPath);
+
+        if (strcmp(importPath, IMPORT_TEMP_FILE) == 0)
+            SD.remove(IMPORT_TEMP_FILE);
+
+        displayMainMenu();
+        importRequested = false;
+    }
+
+    // Пакетное обучение: серия кодов за одну сессию
+    if (learnSessionRequested)
+    {
+        learnSessionRequested = false;
+
+        if (!learnSessionActive() && !btnPressed)
+        {
+            resetBacklightTimer(); // Сбрасываем таймер при активности
+            learnSessionBegin();
+            irMonitorFlush(); // Кадры, принятые до начала сессии, не учитываются
+        }
+    }
+
+    if (learnSessionActive())
+    {
+        IrCapture capture;
+        while (learnSessionActive() && irMonitorRead(capture))
+        {
+            resetBacklightTimer(); // Сбрасываем таймер при активности
+            learnSessionCapture(capture);
+        }
+
+        if (learnNameReady)
+        {
+            learnSessionName(learnName);
+            learnNameReady = false;
+        }
+
+        if (learnSessionActive() && (learnSessionStop || learnSessionExpired()))
+            learnSessionEnd();
+
+        if (!learnSessionActive())
+        {
+            learnSessionStop = false;
+            displayMainMenu();
+        }
+    }
+
     // Режим обучения: активируется двойным нажатием
     if (btnPressed)
     {
@@ -251,70 +312,36 @@ void loop()
             displayInfo(0, F("LEARNING MODE:"));
             displayInfo(1, F("Point your remote and press a button..."), 0, false);
 
-            irrecv.resume();
+            irMonitorFlush();
 
             part++;
             break;
         case 1:
-            // Запись ИК-кода при получении
-            if (irrecv.decode(&results))
+            // Запись ИК-кода при получении (кадры повтора пропускаются)
+            IrCapture capture;
+            bool received = false;
+
+            while (!received && irMonitorRead(capture))
+                received = !capture.repeat;
+
+            if (received)
             {
                 resetBacklightTimer(); // Сбрасываем таймер при активности
                 // Проверяем, не слишком ли длинный код
-                if (results.bits > 0 && results.bits <= 64)
+                if (capture.bits > 0 && capture.bits <= 64)
                 {
                     displayInfo(1, F("Code received!"), 1000);
                     sendAnswer(F("Code received!"));
 
-                    int newID = getNextID();
+                    decode_type_t protocol = capture.protocol;
+                    uint32_t address = capture.address;
+                    uint32_t command = capture.command;
 
-                    // ИСПРАВЛЕНО: Режим открытия файла для ESP32
-                    File dataFile = SD.open("/dataCodes.txt", FILE_APPEND);
+                    CodeRecord record = {0, (int)protocol, address, command, capture.bits};
+                    int newID = codeStoreAppend(&record, 1);
 
-                    if (dataFile)
+                    if (newID > 0)
                     {
-                        decode_type_t protocol = results.decode_type;
-                        uint32_t address = results.address;
-                        uint32_t command = results.command;
-
-                        dataFile.print(newID);
-                        dataFile.print(" ");
-                        dataFile.print((int)protocol);
-                        dataFile.print(" ");
-                        dataFile.print(address);
-                        dataFile.print(" ");
-                        dataFile.println(command);
-                        dataFile.close();
-
-                        // Обновляем кэш
-                        // Обновляем кэш
-                        if (xSemaphoreTake(xMutex, portMAX_DELAY) == pdTRUE)
-                        {
-                            // Создаем новый кэш с увеличенным размером
-                            String *newCache = new String[codesCount + 1];
-
-                            // Копируем старые данные, если они есть
-                            for (int i = 0; i < codesCount; i++)
-                            {
-                                newCache[i] = codesData[i];
-                            }
-
-                            // Добавляем новую запись
-                            newCache[codesCount] = String(newID) + " " + String((int)protocol) + " " + String(address) + " " + String(command);
-
-                            // Удаляем старый кэш, если он был
-                            if (codesData != NULL)
-                            {
-                                delete[] codesData;
-                            }
-
-                            // Обновляем указатель на кэш и счетчик
-                            codesData = newCache;
-                            codesCount++;
-
-                            xSemaphoreGive(xMutex);
-                        }
-
                         // Отправляем данные в Telegram
                         String codeData = "CODE DATA:\nID: " + String(newID) +
                                           "\nProtocol: " + getProtocolName(protocol) +
@@ -339,8 +366,6 @@ void loop()
                     displayInfo(1, F("Invalid IR code length!"), 2000);
                 }
 
-                irrecv.resume();
-
                 displayMainMenu();
 
                 btnPressed = false;
@@ -350,124 +375,95 @@ void loop()
         }
     }
 
+    // Режим прослушивания; без потребителей кадры приемника только учитываются в статистике
+    if (!btnPressed && !learnSessionActive())
+    {
+        IrCapture capture;
+        while (irMonitorRead(capture))
+            if (sniffMode && !capture.repeat)
+                sniffCapture(capture);
+    }
+
+    sniffFlush(!sniffMode);
+
     // Режим воспроизведения: активируется по данным из очереди
-    int commandID = 0;
-    if (xQueueReceive(commandQueue, &commandID, 0) == pdTRUE)
+    IrCommand cmd;
+    uint8_t repeat;
+    if (commandDequeue(cmd, repeat))
     {
+        int commandID = cmd.id;
+
         if (commandID > 0)
         {
             resetBacklightTimer(); // Сбрасываем таймер при активности
             // Используем кэшированные данные вместо чтения с SD-карты
-            bool found = false;
-            decode_type_t protocol = NEC;
-            uint32_t address = 0;
-            uint32_t command = 0;
-
-            // Защищаем доступ к кэшу мьютексом
-            if (xSemaphoreTake(xMutex, portMAX_DELAY) == pdTRUE)
-            {
-                for (int i = 0; i < codesCount && !found; i++)
-                {
-                    String line = codesData[i];
-                    if (line.startsWith(String(commandID) + " "))
-                    {
-                        int firstSpace = line.indexOf(' ');
-                        int secondSpace = line.indexOf(' ', firstSpace + 1);
-                        int thirdSpace = line.indexOf(' ', secondSpace + 1);
+            CodeRecord record = {};
+            int device = 0;
+            bool found = codeStoreFind(commandID, record, &device);
+            decode_type_t protocol = (decode_type_t)record.protocol;
+            uint32_t address = record.address;
+            uint32_t command = record.command;
 
-                        String protocolStr = line.substring(firstSpace + 1, secondSpace);
-                        String addressStr = line.substring(secondSpace + 1, thirdSpace);
-                        String commandStr = line.substring(thirdSpace + 1);
+            // Канал из команды или канал устройства, которому принадлежит код
+            uint8_t channel = cmd.channel >= 0 ? cmd.channel : codeStoreDeviceChannel(device);
 
-                        protocol = (decode_type_t)protocolStr.toInt();
-                        address = (uint32_t)addressStr.toInt();
-                        command = (uint32_t)commandStr.toInt();
-
-                        found = true;
-                    }
-                }
-                xSemaphoreGive(xMutex);
-            }
+            // Команды трассы обрабатываются до передачи, но не отвечают в чат и не управляют техникой
+            bool replay = cmd.source == CMD_SOURCE_REPLAY;
 
             if (found)
             {
-                char buffer[128];
-                snprintf(buffer, sizeof(buffer), "Sending code ID: %d\nProtocol: %s\nAddr: %s\nCmd: %s",
-                         commandID, getProtocolName(protocol).c_str(),
-                         String(address, HEX).c_str(), String(command, HEX).c_str());
-                sendAnswer(String(buffer));
+                // Нажатие inline-кнопки уже подтверждено через answerCallbackQuery
+                if (replay)
+                {
+                    traceReplayReply();
+                }
+                else if (cmd.source != CMD_SOURCE_KEYBOARD)
+                {
+                    char buffer[140];
+                    char times[8] = "";
+                    if (repeat > 1)
+                        snprintf(times, sizeof(times), " x%u", repeat); // Одинаковые команды объединены в очереди
+                    snprintf(buffer, sizeof(buffer), "%sSending code ID: %d%s\nProtocol: %s\nAddr: %s\nCmd: %s\nChannel: %u",
+                             cmd.source == CMD_SOURCE_SCHEDULE ? "Scheduled: " : "", commandID, times, getProtocolName(protocol).c_str(),
+                             String(address, HEX).c_str(), String(command, HEX).c_str(), channel + 1);
+                    sendAnswer(String(buffer));
+                }
 
                 displayInfo(0, F("Sending code ID:"));
-                displayInfo(1, String(commandID), 0, false);
+                displayInfo(1, String(commandID) + "  CH" + String(channel + 1) + (repeat > 1 ? " x" + String(repeat) : String()), 0, false);
                 displayInfo(2, "Protocol:" + getProtocolName(protocol), 0, false);
                 displayInfo(3, "Addr:" + String(address, HEX) + "   Cmd:" + String(command, HEX), 0, false);
 
-                switch (protocol)
+                // Передачу выполняет задача канала, основной цикл не ждет ее окончания
+                if (!irTransmitSupported(protocol))
                 {
-                case NEC:
-                    irsend.sendNEC(address, command);
-                    break;
-                case SONY:
-                    irsend.sendSony(address, command, 12);
-                    break;
-                case SAMSUNG:
-                    irsend.sendSAMSUNG(address, command);
-                    break;
-                case RC5:
-                    irsend.sendRC5(address, command);
-                    break;
-                case RC6:
-                    irsend.sendRC6(address, command);
-                    break;
-                default:
                     displayInfo(1, F("Unsupported protocol"), 1000);
-                    break;
+                }
+                else if (replay)
+                {
+                    traceReplayCode();
+                }
+                else if (!irTransmitEnqueue(channel, record, repeat))
+                {
+                    sendAnswer("Channel " + String(channel + 1) + " is busy or not available, code ID " + String(commandID) + " dropped.");
+                    displayInfo(1, F("Channel busy"), 1000);
                 }
             }
             else
             {
-                sendAnswer("Code ID " + String(commandID) + " not found.");
+                if (replay)
+                    traceReplayReply();
+                else
+                    sendAnswer("Code ID " + String(commandID) + " not found.");
                 displayInfo(1, "Code ID " + String(commandID) + " not found.", 1000);
             }
 
             displayMainMenu();
         }
     }
-}
-
-int getNextID()
-{
-    if (!SD.exists("/dataCodes.txt"))
-        return 1;
-
-    File file = SD.open("/dataCodes.txt", FILE_READ);
-
-    if (!file)
-        return 1; // Запасной вариант при ошибке
-
-    int maxID = 0;
-
-    while (file.available())
-    {
-        String line = file.readStringUntil('\n');
-
-        if (line.length() > 0)
-        {
-            int spaceIndex = line.indexOf(' ');
-
-            if (spaceIndex > 0)
-            {
-                int id = line.substring(0, spaceIndex).toInt();
-
-                if (id > maxID)
-                    maxID = id;
-            }
-        }
-    }
 
-    file.close();
-
-    return maxID + 1;
+    // В экономном режиме - сон до события; пока кнопка разбирает нажатия, период короткий
+    powerWait(btn.busy());
 }
 
 String getProtocolName(decode_type_t protocol)
@@ -661,6 +657,57 @@ void sendAnswer(String text)
     }
 }
 
+// Кадры режима прослушивания копятся в буфере: поток кадров не должен забить очередь telegramQueue
+char sniffText[SNIFF_TEXT_LEN];
+size_t sniffLen = 0;
+uint32_t sniffSkipped = 0;
+unsigned long sniffLastSend = 0;
+
+void sniffCapture(const IrCapture &capture)
+{
+    char line[96];
+
+    if (capture.protocol == UNKNOWN)
+        snprintf(line, sizeof(line), "UNKNOWN, %u timings", capture.rawlen);
+    else
+        snprintf(line, sizeof(line), "%s addr 0x%lX cmd 0x%lX, %u bits", typeToString(capture.protocol).c_str(),
+                 (unsigned long)capture.address, (unsigned long)capture.command, capture.bits);
+
+    displayInfo(1, line, 0, false);
+
+    size_t len = strlen(line);
+
+    if (sniffLen + len + 1 >= sizeof(sniffText))
+    {
+        sniffSkipped++;
+        return;
+    }
+
+    memcpy(sniffText + sniffLen, line, len);
+    sniffLen += len;
+    sniffText[sniffLen++] = '\n';
+    sniffText[sniffLen] = '\0';
+}
+
+void sniffFlush(bool force)
+{
+    if (sniffLen == 0 && sniffSkipped == 0)
+        return;
+    if (!force && millis() - sniffLastSend < SNIFF_INTERVAL_MS)
+        return;
+
+    String text = "SNIFF:\n" + String(sniffText);
+    if (sniffSkipped > 0)
+        text += "+" + String(sniffSkipped) + " more";
+
+    sendAnswer(text);
+
+    sniffLen = 0;
+    sniffText[0] = '\0';
+    sniffSkipped = 0;
+    sniffLastSend = millis();
+}
+
 void lcdBacklightControl()
 {
 #ifdef USE_LCD_DISPLAY
@@ -0,0 +1,644 @@
+#include "name_index.h"
+#include <SD.h>
+
+#define NAME_READ_LEN 256               // Блок чтения файла имен
+#define NAMES_TEMP_FILE NAMES_FILE ".tmp" // Новый файл имен до замены старого
+
+// Ячейка таблицы: id > 0 - занята, 0 - пуста, -1 - удалена
+struct NameEntry
+{
+    uint32_t hash;
+    uint32_t offset; // Смещение имени в namePool
+    int id;
+};
+
+// Собственный мьютекс: имена читаются под xMutex при выводе кэша кодов
+SemaphoreHandle_t namesMutex = NULL;
+
+NameEntry *nameTable = NULL;
+uint32_t nameTableCapacity = 0;
+uint32_t nameTableUsed = 0; // Занятые и удаленные ячейки
+
+char *namePool = NULL;
+uint32_t namePoolLen = 0;
+uint32_t namePoolCapacity = 0;
+
+// Обратный индекс id -> имя кода для nameIndexNameOf. Удаленных ячеек нет:
+// при удалении имени таблица перестраивается целиком
+struct IdEntry
+{
+    int id;          // 0 - пусто
+    uint32_t offset; // Первое имя кода в namePool
+    bool urgent;     // Высокий приоритет в очереди команд (NAME_URGENT_WORDS)
+};
+
+IdEntry *idTable = NULL;
+uint32_t idTableCapacity = 0;
+uint32_t idTableUsed = 0;
+
+// FNV-1a без учета регистра
+uint32_t nameHash(const char *name)
+{
+    uint32_t h = 2166136261UL;
+
+    while (*name)
+    {
+        h ^= (uint8_t)tolower(*name++);
+        h *= 16777619UL;
+    }
+
+    return h;
+}
+
+// Имя: латинская буква, затем буквы, цифры, '.', '_', '-'
+bool nameNormalize(const char *name, char *out)
+{
+    size_t len = 0;
+
+    if (!isalpha((uint8_t)name[0]))
+        return false;
+
+    for (; name[len]; len++)
+    {
+        char c = tolower(name[len]);
+
+        if (len >= NAME_MAX_LEN || !(isalnum((uint8_t)c) || c == '.' || c == '_' || c == '-'))
+            return false;
+
+        out[len] = c;
+    }
+
+    out[len] = '\0';
+    return true;
+}
+
+// Вызывается под namesMutex
+NameEntry *nameLookup(const char *name)
+{
+    if (nameTableCapacity == 0)
+        return NULL;
+
+    uint32_t hash = nameHash(name);
+    uint32_t mask = nameTableCapacity - 1;
+
+    for (uint32_t slot = hash & mask; nameTable[slot].id != 0; slot = (slot + 1) & mask)
+    {
+        NameEntry &e = nameTable[slot];
+
+        if (e.id > 0 && e.hash == hash && strcasecmp(namePool + e.offset, name) == 0)
+            return &e;
+    }
+
+    return NULL;
+}
+
+uint32_t idHash(int id)
+{
+    return (uint32_t)id * 2654435761UL;
+}
+
+// Вызывается под namesMutex
+IdEntry *idLookup(int id)
+{
+    if (idTableCapacity == 0)
+        return NULL;
+
+    uint32_t mask = idTableCapacity - 1;
+
+    for (uint32_t slot = idHash(id) & mask; idTable[slot].id != 0; slot = (slot + 1) & mask)
+    {
+        if (idTable[slot].id == id)
+            return &idTable[slot];
+    }
+
+    return NULL;
+}
+
+// Слово из NAME_URGENT_WORDS среди частей имени, разделенных '.', '_' или '-'
+bool nameUrgent(const char *name)
+{
+    char copy[NAME_MAX_LEN + 1];
+    char *save;
+
+    strncpy(copy, name, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = '\0';
+
+    for (char *part = strtok_r(copy, "._-", &save); part != NULL; part = strtok_r(NULL, "._-", &save))
+    {
+        const char *word = NAME_URGENT_WORDS;
+        size_t len = strlen(part);
+
+        while (*word)
+        {
+            size_t wordLen = strcspn(word, ",");
+            if (wordLen == len && strncasecmp(word, part, len) == 0)
+                return true;
+
+            word += wordLen;
+            if (*word == ',')
+                word++;
+        }
+    }
+
+    return false;
+}
+
+// Вызывается под namesMutex; место в таблице уже есть (idTableReserve)
+IdEntry *idPlace(int id)
+{
+    uint32_t mask = idTableCapacity - 1;
+    uint32_t slot = idHash(id) & mask;
+
+    while (idTable[slot].id != 0)
+        slot = (slot + 1) & mask;
+
+    idTableUsed++;
+    return &idTable[slot];
+}
+
+// Вызывается под namesMutex; имя уже лежит в namePool по смещению offset
+void idInsert(int id, uint32_t offset)
+{
+    bool urgent = nameUrgent(namePool + offset);
+    IdEntry *e = idLookup(id);
+
+    if (e == NULL)
+    {
+        e = idPlace(id);
+        e->id = id;
+        e->offset = offset;
+        e->urgent = false;
+    }
+    else if (offset < e->offset)
+        e->offset = offset; // Имя кода - добавленное первым, то есть с меньшим смещением
+
+    // Приоритет решается один раз при добавлении имени: срочен код, у которого срочно любое имя
+    e->urgent = e->urgent || urgent;
+}
+
+// Вызывается под namesMutex: место для еще одного кода, заполненность не выше 50%
+bool idTableReserve()
+{
+    if ((idTableUsed + 1) * 2 <= idTableCapacity)
+        return true;
+
+    uint32_t capacity = idTableCapacity ? idTableCapacity * 2 : 64;
+    IdEntry *table = (IdEntry *)calloc(capacity, sizeof(IdEntry));
+
+    if (table == NULL)
+        return false;
+
+    IdEntry *old = idTable;
+    uint32_t oldCapacity = idTableCapacity;
+
+    idTable = table;
+    idTableCapacity = capacity;
+    idTableUsed = 0;
+
+    for (uint32_t i = 0; i < oldCapacity; i++)
+    {
+        if (old[i].id != 0)
+            *idPlace(old[i].id) = old[i];
+    }
+
+    free(old);
+    return true;
+}
+
+// Вызывается под namesMutex
+bool nameTableRehash(uint32_t capacity)
+{
+    NameEntry *table = (NameEntry *)calloc(capacity, sizeof(NameEntry));
+
+    if (table == NULL)
+        return false;
+
+    uint32_t mask = capacity - 1;
+    uint32_t used = 0;
+
+    for (uint32_t i = 0; i < nameTableCapacity; i++)
+    {
+        if (nameTable[i].id <= 0)
+            continue; // Удаленные ячейки при перестроении отбрасываются
+
+        uint32_t slot = nameTable[i].hash & mask;
+        while (table[slot].id != 0)
+            slot = (slot + 1) & mask;
+
+        table[slot] = nameTable[i];
+        used++;
+    }
+
+    free(nameTable);
+    nameTable = table;
+    nameTableCapacity = capacity;
+    nameTableUsed = used;
+    return true;
+}
+
+// Вызывается под namesMutex; имя уже нормализовано и отсутствует в таблице
+bool nameInsert(const char *name, int id)
+{
+    size_t len = strlen(name) + 1;
+
+    if (namePoolLen + len > namePoolCapacity)
+    {
+        uint32_t capacity = max((uint32_t)256, namePoolCapacity * 2);
+        while (capacity < namePoolLen + len)
+            capacity *= 2;
+
+        char *pool = (char *)realloc(namePool, capacity);
+        if (pool == NULL)
+            return false;
+
+        namePool = pool;
+        namePoolCapacity = capacity;
+    }
+
+    // Заполненность таблицы (с удаленными ячейками) не выше 50%
+    if ((nameTableUsed + 1) * 2 > nameTableCapacity &&
+        !nameTableRehash(nameTableCapacity ? nameTableCapacity * 2 : 64))
+        return false;
+
+    if (!idTableReserve())
+        return false;
+
+    uint32_t hash = nameHash(name);
+    uint32_t mask = nameTableCapacity - 1;
+    uint32_t slot = hash & mask;
+
+    while (nameTable[slot].id > 0)
+        slot = (slot + 1) & mask;
+
+    if (nameTable[slot].id == 0)
+        nameTableUsed++;
+
+    nameTable[slot].hash = hash;
+    nameTable[slot].offset = namePoolLen;
+    nameTable[slot].id = id;
+
+    memcpy(namePool + namePoolLen, name, len);
+    idInsert(id, namePoolLen);
+
+    namePoolLen += len;
+    return true;
+}
+
+// Вызывается под namesMutex после удаления имени: строки удаленных имен убираются
+// из namePool со сдвигом остальных (порядок добавления сохраняется), удаленные
+// ячейки - из таблицы, обратный индекс строится заново
+void nameCompact()
+{
+    uint32_t len = 0;
+
+    for (uint32_t pos = 0; pos < namePoolLen;)
+    {
+        const char *name = namePool + pos;
+        uint32_t size = strlen(name) + 1;
+        NameEntry *e = nameLookup(name);
+
+        if (e != NULL && e->offset == pos)
+        {
+            memmove(namePool + len, name, size);
+            e->offset = len;
+            len += size;
+        }
+
+        pos += size;
+    }
+
+    namePoolLen = len;
+    nameTableRehash(nameTableCapacity);
+
+    // Кодов не больше, чем было, - места в таблице хватает
+    memset(idTable, 0, idTableCapacity * sizeof(IdEntry));
+    idTableUsed = 0;
+
+    for (uint32_t i = 0; i < nameTableCapacity; i++)
+    {
+        if (nameTable[i].id > 0)
+            idInsert(nameTable[i].id, nameTable[i].offset);
+    }
+}
+
+// Вызывается под namesMutex
+void nameLoadLine(char *line, size_t len)
+{
+    char name[NAME_MAX_LEN + 1];
+
+    line[len] = '\0';
+
+    char *space = strchr(line, ' ');
+    if (space == NULL)
+        return;
+
+    *space = '\0';
+    int id = atoi(space + 1);
+
+    if (id > 0 && nameNormalize(line, name) && nameLookup(name) == NULL)
+        nameInsert(name, id);
+}
+
+bool nameIndexLoad()
+{
+    if (namesMutex == NULL)
+        namesMutex = xSemaphoreCreateMutex();
+
+    File file = SD.open(NAMES_FILE, FILE_READ);
+
+    if (!file)
+        return false;
+
+    char block[NAME_READ_LEN];
+    char line[NAME_MAX_LEN + 16];
+    size_t lineLen = 0;
+    int n;
+
+    if (xSemaphoreTake(namesMutex, portMAX_DELAY) == pdTRUE)
+    {
+        while ((n = file.read((uint8_t *)block, sizeof(block))) > 0)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                if (block[i] == '\r')
+                    continue;
+
+                if (block[i] != '\n')
+                {
+                    if (lineLen < sizeof(line) - 1)
+                        line[lineLen++] = block[i];
+                    continue;
+                }
+
+                nameLoadLine(line, lineLen);
+                lineLen = 0;
+            }
+        }
+
+        if (lineLen > 0)
+            nameLoadLine(line, lineLen);
+
+        xSemaphoreGive(namesMutex);
+    }
+
+    file.close();
+    return true;
+}
+
+void nameIndexClear()
+{
+    if (namesMutex == NULL || xSemaphoreTake(namesMutex, portMAX_DELAY) != pdTRUE)
+        return;
+
+    free(nameTable);
+    nameTable = NULL;
+    nameTableCapacity = 0;
+    nameTableUsed = 0;
+
+    free(namePool);
+    namePool = NULL;
+    namePoolLen = 0;
+    namePoolCapacity = 0;
+
+    free(idTable);
+    idTable = NULL;
+    idTableCapacity = 0;
+    idTableUsed = 0;
+
+    SD.remove(NAMES_FILE);
+
+    xSemaphoreGive(namesMutex);
+}
+
+int nameIndexFind(const char *name)
+{
+    int id = -1;
+
+    if (namesMutex != NULL && xSemaphoreTake(namesMutex, portMAX_DELAY) == pdTRUE)
+    {
+        NameEntry *e = nameLookup(name);
+        if (e != NULL)
+            id = e->id;
+
+        xSemaphoreGive(namesMutex);
+    }
+
+    return id;
+}
+
+bool nameIndexValid(const char *name)
+{
+    char normalized[NAME_MAX_LEN + 1];
+    return nameNormalize(name, normalized);
+}
+
+bool nameIndexAdd(const char *name, int id)
+{
+    char normalized[NAME_MAX_LEN + 1];
+
+    if (id <= 0 || namesMutex == NULL || !nameNormalize(name, normalized))
+        return false;
+
+    bool added = false;
+
+    if (xSemaphoreTake(namesMutex, portMAX_DELAY) == pdTRUE)
+    {
+        // Сначала файл: имя, не записанное на карту, пропало бы после перезагрузки
+        File file = nameLookup(normalized) == NULL ? SD.open(NAMES_FILE, FILE_APPEND) : File();
+        if (file)
+        {
+            file.print(normalized);
+            file.print(' ');
+            added = file.println(id) > 0;
+            file.close();
+        }
+
+        if (added)
+            added = nameInsert(normalized, id);
+
+        xSemaphoreGive(namesMutex);
+    }
+
+    return added;
+}
+
+// Вызывается под namesMutex. Файл имен небольшой - переписывается целиком, без имени removed.
+// Строки идут в порядке namePool, то есть добавления: после загрузки первым именем кода
+// останется то же имя. Новый файл пишется рядом и заменяет старый, только если записан целиком
+bool nameWriteFile(const NameEntry *removed)
+{
+    File file = SD.open(NAMES_TEMP_FILE, FILE_WRITE);
+
+    if (!file)
+        return false;
+
+    bool ok = true;
+
+    for (uint32_t pos = 0; pos < namePoolLen && ok;)
+    {
+        const char *name = namePool + pos;
+        NameEntry *e = nameLookup(name);
+
+        if (e != NULL && e != removed && e->offset == pos)
+            ok = file.print(name) > 0 && file.print(' ') > 0 && file.println(e->id) > 0;
+
+        pos += strlen(name) + 1;
+    }
+
+    file.close();
+
+    if (!ok)
+    {
+        SD.remove(NAMES_TEMP_FILE);
+        return false;
+    }
+
+    SD.remove(NAMES_FILE);
+    return SD.rename(NAMES_TEMP_FILE, NAMES_FILE);
+}
+
+bool nameIndexRemove(const char *name)
+{
+    if (namesMutex == NULL || xSemaphoreTake(namesMutex, portMAX_DELAY) != pdTRUE)
+        return false;
+
+    // Сначала файл: имя, удаленное только из памяти, вернулось бы после перезагрузки
+    NameEntry *e = nameLookup(name);
+    bool removed = e != NULL && nameWriteFile(e);
+
+    if (removed)
+    {
+        e->id = -1;
+        nameCompact();
+    }
+
+    xSemaphoreGive(namesMutex);
+    return removed;
+}
+
+bool nameIndexNameOf(int id, char *name, size_t size)
+{
+    bool found = false;
+
+    if (namesMutex == NULL || xSemaphoreTake(namesMutex, portMAX_DELAY) != pdTRUE)
+        return false;
+
+    IdEntry *e = idLookup(id);
+
+    if (e != NULL)
+    {
+        strncpy(name, namePool + e->offset, size - 1);
+        name[size - 1] = '\0';
+        found = true;
+    }
+
+    xSemaphoreGive(namesMutex);
+    return found;
+}
+
+bool nameIndexUrgent(int id)
+{
+    bool urgent = false;
+
+    if (namesMutex == NULL || xSemaphoreTake(namesMutex, portMAX_DELAY) != pdTRUE)
+        return false;
+
+    IdEntry *e = idLookup(id);
+    if (e != NULL)
+        urgent = e->urgent;
+
+    xSemaphoreGive(namesMutex);
+    return urgent;
+}
+
+// Расстояние Левенштейна между короткими строками (до NAME_MAX_LEN символов)
+uint8_t nameDistance(const char *a, const char *b)
+{
+    uint8_t row[NAME_MAX_LEN + 1];
+    size_t lenB = strlen(b);
+
+    for (size_t j = 0; j <= lenB; j++)
+        row[j] = j;
+
+    for (size_t i = 1; a[i - 1]; i++)
+    {
+        uint8_t diagonal = row[0];
+        row[0] = i;
+
+        for (size_t j = 1; j <= lenB; j++)
+        {
+            uint8_t above = row[j];
+            uint8_t cost = (a[i - 1] == b[j - 1]) ? 0 : 1;
+            row[j] = min(min(row[j - 1] + 1, above + 1), diagonal + cost);
+            diagonal = above;
+        }
+    }
+
+    return row[lenB];
+}
+
+size_t nameIndexSuggest(const char *name, char *out, size_t size)
+{
+    char query[NAME_MAX_LEN + 1];
+    size_t len = 0;
+
+    for (; name[len] && len < NAME_MAX_LEN; len++)
+        query[len] = tolower(name[len]);
+    query[len] = '\0';
+
+    // Допустимое число правок растет с длиной имени
+    uint8_t maxDistance = 1 + len / 4;
+    uint32_t best[NAME_SUGGESTIONS];
+    uint8_t bestDistance[NAME_SUGGESTIONS];
+    int bestCount = 0;
+
+    out[0] = '\0';
+
+    if (namesMutex == NULL || xSemaphoreTake(namesMutex, portMAX_DELAY) != pdTRUE)
+        return 0;
+
+    for (uint32_t i = 0; i < nameTableCapacity; i++)
+    {
+        if (nameTable[i].id <= 0)
+            continue;
+
+        const char *candidate = namePool + nameTable[i].offset;
+
+        // Вхождение запроса в имя ("power" -> "tv.power") считаем близким совпадением
+        uint8_t distance = (len >= 3 && strstr(candidate, query) != NULL) ? 1 : nameDistance(query, candidate);
+        if (distance > maxDistance)
+            continue;
+
+        // Вставка в короткий отсортированный список лучших
+        int pos = bestCount;
+        while (pos > 0 && bestDistance[pos - 1] > distance)
+            pos--;
+
+        if (pos >= NAME_SUGGESTIONS)
+            continue;
+
+        for (int j = min(bestCount, NAME_SUGGESTIONS - 1); j > pos; j--)
+        {
+            best[j] = best[j - 1];
+            bestDistance[j] = bestDistance[j - 1];
+        }
+
+        best[pos] = nameTable[i].offset;
+        bestDistance[pos] = distance;
+        if (bestCount < NAME_SUGGESTIONS)
+            bestCount++;
+    }
+
+    size_t pos = 0;
+
+    for (int i = 0; i < bestCount; i++)
+    {
+        int written = snprintf(out + pos, size - pos, "%s%s", i ? ", " : "", namePool + best[i]);
+        if (written < 0 || pos + written >= size)
+            break;
+        pos += written;
+    }
+
+    xSemaphoreGive(namesMutex);
+    return pos;
+}
@@ -0,0 +1,24 @@
+#ifndef NAME_INDEX_H
+#define NAME_INDEX_H
+
+#include <Arduino.h>
+
+#define NAMES_FILE "/codeNames.txt"             // Строки "имя id"
+#define NAME_MAX_LEN 31                         // Максимальная длина имени
+#define NAME_SUGGESTIONS 3                      // Сколько похожих имен предлагать
+#define NAME_URGENT_WORDS "power,off,stop,mute" // Слова в имени кода (tv.power, ac.off), дающие высокий приоритет
+
+// Имена и псевдонимы кодов (tv.power, ac.cool22): хеш-таблица с открытой адресацией
+// над общим буфером строк и обратный индекс по ID. Поиск в обе стороны без выделения
+// памяти, регистр не учитывается
+bool nameIndexLoad();
+void nameIndexClear();
+int nameIndexFind(const char *name);                                // ID кода или -1
+bool nameIndexValid(const char *name);                              // Допустимое имя: латинская буква, затем буквы, цифры, '.', '_', '-'
+bool nameIndexAdd(const char *name, int id);                        // false, если имя занято или не записано на карту
+bool nameIndexRemove(const char *name);
+bool nameIndexNameOf(int id, char *name, size_t size);              // Первое имя кода
+bool nameIndexUrgent(int id);                                       // Есть имя со словом из NAME_URGENT_WORDS
+size_t nameIndexSuggest(const char *name, char *out, size_t size);  // Похожие имена через запятую
+
+#endif // NAME_INDEX_H
@@ -0,0 +1,168 @@
+#include "power_manager.h"
+#include "ir_transmit.h"
+#include <WiFi.h>
+#include <Preferences.h>
+#include "freertos/event_groups.h"
+#include "esp_pm.h"
+
+EventGroupHandle_t powerEvents = NULL;
+volatile bool powerLow = false;
+bool powerDfs = false;
+
+// Счетчики: каждый ведет одна задача, поэтому без блокировок
+uint64_t powerActiveUs[POWER_DOMAINS];
+uint32_t powerWakeups[4];
+uint32_t powerRequests = 0;
+uint32_t powerConnects = 0;
+uint32_t powerAbortedPolls = 0;
+uint32_t powerStatsStart = 0;
+uint32_t powerTxAirBase = 0;
+
+uint32_t powerLoopResume = 0; // micros() выхода из последнего ожидания
+uint32_t powerLastEvent = 0;  // millis() последнего события
+
+void IRAM_ATTR powerButtonIsr()
+{
+    BaseType_t woken = pdFALSE;
+
+    if (xEventGroupSetBitsFromISR(powerEvents, POWER_EVENT_BUTTON, &woken) == pdPASS)
+        portYIELD_FROM_ISR(woken);
+}
+
+uint32_t powerTxAirMs()
+{
+    uint32_t total = 0;
+
+    for (uint8_t i = 0; i < irTransmitChannels(); i++)
+    {
+        IrTxStats s;
+        irTransmitStats(i, s);
+        total += s.airMs;
+    }
+
+    return total;
+}
+
+void powerBegin(uint8_t buttonPin)
+{
+    powerEvents = xEventGroupCreate();
+    powerResetStats();
+
+    // Прерывание только будит основной цикл, нажатия по-прежнему разбирает EncButton
+    attachInterrupt(digitalPinToInterrupt(buttonPin), powerButtonIsr, CHANGE);
+
+    Preferences prefs;
+    prefs.begin(POWER_NVS_NAMESPACE, true);
+    bool low = prefs.getUChar("low", 0) != 0;
+    prefs.end();
+
+    if (low)
+        powerSetLowMode(true);
+}
+
+bool powerLowMode()
+{
+    return powerLow;
+}
+
+bool powerSetLowMode(bool low)
+{
+    // MAX_MODEM: радио просыпается реже (по listen interval), запросы long polling от этого не страдают
+    WiFi.setSleep(low ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+
+    // Без light sleep: он останавливает таймер ИК-приемника и LEDC излучателей
+    esp_pm_config_esp32_t pm = {POWER_CPU_MAX_MHZ, low ? POWER_CPU_MIN_MHZ : POWER_CPU_MAX_MHZ, false};
+    powerDfs = esp_pm_configure(&pm) == ESP_OK && low;
+
+    powerLow = low;
+
+    Preferences prefs;
+    prefs.begin(POWER_NVS_NAMESPACE, false);
+    bool saved = prefs.putUChar("low", low ? 1 : 0) > 0;
+    prefs.end();
+
+    // Счетчики нового режима не смешиваются со старыми
+    powerResetStats();
+    powerNotify(POWER_EVENT_COMMAND);
+
+    return saved;
+}
+
+bool powerFrequencyScaling()
+{
+    return powerDfs;
+}
+
+void powerNotify(uint32_t events)
+{
+    if (powerEvents != NULL)
+        xEventGroupSetBits(powerEvents, events);
+}
+
+void powerWait(bool busy)
+{
+    powerAddActive(POWER_DOMAIN_LOOP, micros() - powerLoopResume);
+
+    if (powerLow && powerEvents != NULL)
+    {
+        // После события кнопка, сессия обучения и т.п. еще некоторое время требуют частых итераций
+        bool recent = millis() - powerLastEvent < POWER_ACTIVE_HOLD_MS;
+        uint32_t waitMs = (busy || recent) ? POWER_ACTIVE_TICK_MS : POWER_IDLE_WAIT_MS;
+
+        EventBits_t bits = xEventGroupWaitBits(powerEvents, POWER_EVENTS_ALL, pdTRUE, pdFALSE, pdMS_TO_TICKS(waitMs));
+
+        if (bits & POWER_EVENT_BUTTON)
+            powerWakeups[0]++;
+        if (bits & POWER_EVENT_IR)
+            powerWakeups[1]++;
+        if (bits & POWER_EVENT_COMMAND)
+            powerWakeups[2]++;
+        if ((bits & POWER_EVENTS_ALL) == 0)
+            powerWakeups[3]++;
+        else
+            powerLastEvent = millis();
+    }
+
+    powerLoopResume = micros();
+}
+
+void powerAddActive(PowerDomain domain, uint32_t us)
+{
+    powerActiveUs[domain] += us;
+}
+
+void powerCountRequest(bool connected, bool aborted)
+{
+    powerRequests++;
+    if (connected)
+        powerConnects++;
+    if (aborted)
+        powerAbortedPolls++;
+}
+
+void powerStats(PowerStats &stats)
+{
+    stats.uptimeMs = millis() - powerStatsStart;
+
+    for (uint8_t i = 0; i < POWER_DOMAINS; i++)
+        stats.activeMs[i] = powerActiveUs[i] / 1000;
+    for (uint8_t i = 0; i < 4; i++)
+        stats.wakeups[i] = powerWakeups[i];
+
+    stats.requests = powerRequests;
+    stats.connects = powerConnects;
+    stats.abortedPolls = powerAbortedPolls;
+    stats.irTxAirMs = powerTxAirMs() - powerTxAirBase;
+}
+
+void powerResetStats()
+{
+    memset(powerActiveUs, 0, sizeof(powerActiveUs));
+    memset(powerWakeups, 0, sizeof(powerWakeups));
+    powerRequests = 0;
+    powerConnects = 0;
+    powerAbortedPolls = 0;
+    powerStatsStart = millis();
+    powerTxAirBase = powerTxAirMs();
+    powerLoopResume = micros();
+}
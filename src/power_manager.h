@@ -0,0 +1,63 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+
+#define POWER_NVS_NAMESPACE "power" // Режим питания сохраняется в NVS
+#define POWER_LONG_POLL_S 25        // Long polling getUpdates в экономном режиме (сервер держит запрос до прихода сообщения)
+#define POWER_IDLE_WAIT_MS 1000     // Сон основного цикла без событий (таймер подсветки, отчеты раз в секунду)
+#define POWER_ACTIVE_TICK_MS 10     // Период основного цикла, пока кнопка обрабатывает нажатия
+#define POWER_ACTIVE_HOLD_MS 1500   // Столько после события основной цикл работает с коротким периодом
+#define POWER_CPU_MIN_MHZ 80        // Нижняя частота DFS: при 80 МГц и выше шина APB остается 80 МГц
+#define POWER_CPU_MAX_MHZ 240
+
+// Оценочные токи для отчета /power, мА (по данным ESP32 datasheet, плата и дисплей не учтены)
+#define POWER_MA_ACTIVE 110      // CPU 240 МГц, радио принимает/передает
+#define POWER_MA_IDLE_LOW 22     // Экономный режим: modem sleep, CPU простаивает на 80 МГц
+#define POWER_MA_IDLE_NORMAL 100 // Обычный режим: радио включено, основной цикл крутится без сна
+#define POWER_MA_IR_LED 100      // Один излучатель во время передачи
+#define POWER_BATTERY_MAH 2000   // Емкость батареи для оценки времени работы
+
+// События, будящие основной цикл в экономном режиме
+#define POWER_EVENT_BUTTON 0x01  // Фронт на пине кнопки
+#define POWER_EVENT_IR 0x02      // Кадр в кольцевом буфере приемника
+#define POWER_EVENT_COMMAND 0x04 // Команда в очереди команд или флаг от задачи Telegram
+#define POWER_EVENTS_ALL 0x07
+
+// Части системы, время активности которых учитывается
+enum PowerDomain : uint8_t
+{
+    POWER_DOMAIN_LOOP,    // Основной цикл между ожиданиями
+    POWER_DOMAIN_NETWORK, // Запросы к Telegram без ожидания ответа сервера
+    POWER_DOMAINS
+};
+
+// Счетчики с момента запуска или смены режима
+struct PowerStats
+{
+    uint32_t uptimeMs;
+    uint32_t activeMs[POWER_DOMAINS];
+    uint32_t wakeups[4]; // Кнопка, ИК, команда, таймаут
+    uint32_t requests;   // Запросы к Telegram
+    uint32_t connects;   // TLS-подключения (самая дорогая часть запроса)
+    uint32_t abortedPolls; // Long polling прерван ради отправки ответа
+    uint32_t irTxAirMs;  // Время передачи всех излучателей
+};
+
+// Экономный режим: modem sleep между long polling запросами, DFS 80-240 МГц
+// и основной цикл, который спит до события (кнопка, ИК-кадр, команда) вместо опроса.
+// Автоматический light sleep не используется: он останавливает таймер ИК-приемника
+void powerBegin(uint8_t buttonPin);
+bool powerLowMode();
+bool powerSetLowMode(bool low);
+bool powerFrequencyScaling(); // DFS включен (ядро Arduino собрано с CONFIG_PM_ENABLE)
+
+void powerNotify(uint32_t events);
+void powerWait(bool busy); // Конец итерации основного цикла; busy - нужен короткий период
+
+void powerAddActive(PowerDomain domain, uint32_t us);
+void powerCountRequest(bool connected, bool aborted);
+void powerStats(PowerStats &stats);
+void powerResetStats();
+
+#endif // POWER_MANAGER_H
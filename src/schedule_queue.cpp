@@ -0,0 +1,389 @@
+#include "schedule_queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+static const char *const scheduleDayNames[7] = {"mon", "tue", "wed", "thu", "fri", "sat", "sun"};
+
+void ScheduleQueue::clear()
+{
+    memset(_entries, 0, sizeof(_entries));
+    _size = 0;
+    _lastPoll = 0;
+}
+
+int ScheduleQueue::add(const ScheduleEntry &entry, time_t now)
+{
+    if (entry.minute >= 24 * 60 || entry.days > SCHEDULE_DAILY || (entry.days == 0 && entry.at <= 0) ||
+        entry.code <= 0 || _size >= SCHEDULE_MAX_ENTRIES)
+        return -1;
+
+    // Наименьший свободный id, чтобы номера в /schedule оставались короткими
+    uint8_t id = entry.id;
+    if (id == 0)
+    {
+        for (id = 1; id != 0 && slotOf(id) >= 0; id++)
+            ;
+        if (id == 0)
+            return -1;
+    }
+    else if (slotOf(id) >= 0)
+        return -1;
+
+    int slot = slotOf(0);
+
+    _entries[slot] = entry;
+    _entries[slot].id = id;
+    place(slot, now);
+
+    _heap[_size] = slot;
+    _pos[slot] = _size;
+    siftUp(_size++);
+
+    return id;
+}
+
+bool ScheduleQueue::remove(uint8_t id)
+{
+    int slot = slotOf(id);
+
+    if (id == 0 || slot < 0)
+        return false;
+
+    removeAt(_pos[slot]);
+    _entries[slot].id = 0;
+    return true;
+}
+
+void ScheduleQueue::rebuild(time_t now)
+{
+    for (uint8_t i = 0; i < _size; i++)
+        place(_heap[i], now);
+
+    // Построение кучи снизу вверх
+    for (int i = _size / 2 - 1; i >= 0; i--)
+        siftDown(i);
+
+    _lastPoll = now;
+}
+
+ScheduleResult ScheduleQueue::poll(time_t now, ScheduleEntry &entry)
+{
+    // Часы переведены назад (например, первая синхронизация SNTP после неверного времени):
+    // сроки, посчитанные от старого времени, могли перескочить через сегодняшнее срабатывание
+    if (_lastPoll != 0 && now + SCHEDULE_GRACE_SEC < _lastPoll)
+        rebuild(now);
+    _lastPoll = now;
+
+    if (_size == 0 || _due[_heap[0]] > now)
+        return SCHEDULE_IDLE;
+
+    uint8_t slot = _heap[0];
+    ScheduleResult result = now - _due[slot] <= SCHEDULE_GRACE_SEC ? SCHEDULE_FIRE : SCHEDULE_MISSED;
+
+    entry = _entries[slot];
+
+    if (entry.days != 0)
+    {
+        // Повторяющееся задание переносится на следующее срабатывание после now,
+        // пропущенные за время простоя срабатывания не накапливаются
+        _due[slot] = scheduleNextTime(entry, now);
+        siftDown(0);
+    }
+    else
+    {
+        removeAt(0);
+        _entries[slot].id = 0;
+    }
+
+    return result;
+}
+
+bool ScheduleQueue::get(uint8_t index, ScheduleEntry &entry, time_t &due) const
+{
+    for (uint8_t i = 0; i < _size; i++)
+    {
+        uint8_t slot = _heap[i];
+        uint8_t rank = 0;
+
+        for (uint8_t j = 0; j < _size; j++)
+            if (_entries[_heap[j]].id < _entries[slot].id)
+                rank++;
+
+        if (rank == index)
+        {
+            entry = _entries[slot];
+            due = _due[slot];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int ScheduleQueue::slotOf(uint8_t id) const
+{
+    for (uint8_t slot = 0; slot < SCHEDULE_MAX_ENTRIES; slot++)
+        if (_entries[slot].id == id)
+            return slot;
+
+    return -1;
+}
+
+void ScheduleQueue::place(uint8_t slot, time_t now)
+{
+    const ScheduleEntry &entry = _entries[slot];
+
+    // Разовое задание остается со своим временем, даже если оно прошло: poll сообщит о пропуске
+    _due[slot] = entry.days != 0 ? scheduleNextTime(entry, now) : entry.at;
+}
+
+void ScheduleQueue::siftUp(uint8_t pos)
+{
+    while (pos > 0)
+    {
+        uint8_t parent = (pos - 1) / 2;
+
+        if (_due[_heap[parent]] <= _due[_heap[pos]])
+            break;
+
+        swap(parent, pos);
+        pos = parent;
+    }
+}
+
+void ScheduleQueue::siftDown(uint8_t pos)
+{
+    for (;;)
+    {
+        uint8_t smallest = pos;
+        uint8_t left = pos * 2 + 1;
+        uint8_t right = left + 1;
+
+        if (left < _size && _due[_heap[left]] < _due[_heap[smallest]])
+            smallest = left;
+        if (right < _size && _due[_heap[right]] < _due[_heap[smallest]])
+            smallest = right;
+
+        if (smallest == pos)
+            break;
+
+        swap(pos, smallest);
+        pos = smallest;
+    }
+}
+
+void ScheduleQueue::swap(uint8_t a, uint8_t b)
+{
+    uint8_t slot = _heap[a];
+
+    _heap[a] = _heap[b];
+    _heap[b] = slot;
+    _pos[_heap[a]] = a;
+    _pos[_heap[b]] = b;
+}
+
+void ScheduleQueue::removeAt(uint8_t pos)
+{
+    swap(pos, --_size);
+
+    if (pos < _size)
+    {
+        siftDown(pos);
+        siftUp(pos);
+    }
+}
+
+time_t scheduleNextTime(const ScheduleEntry &entry, time_t after)
+{
+    if (entry.days == 0)
+        return entry.at > after ? entry.at : 0;
+
+    struct tm base;
+    localtime_r(&after, &base);
+
+    // Через mktime, чтобы переходы на летнее время учитывались по правилам TZ
+    for (int day = 0; day <= 7; day++)
+    {
+        struct tm t = base;
+        t.tm_mday += day;
+        t.tm_hour = entry.minute / 60;
+        t.tm_min = entry.minute % 60;
+        t.tm_sec = 0;
+        t.tm_isdst = -1;
+
+        time_t time = mktime(&t);
+        uint8_t weekday = (t.tm_wday + 6) % 7; // tm_wday: 0 - воскресенье
+
+        if (time > after && (entry.days & (1 << weekday)))
+            return time;
+    }
+
+    return 0;
+}
+
+// Слово без учета регистра
+static bool scheduleWordIs(const char *text, size_t len, const char *word)
+{
+    if (strlen(word) != len)
+        return false;
+
+    for (size_t i = 0; i < len; i++)
+        if (tolower((unsigned char)text[i]) != word[i])
+            return false;
+
+    return true;
+}
+
+// Список дней "mon,wed,fri"
+static uint8_t scheduleParseDays(const char *text, size_t len)
+{
+    uint8_t days = 0;
+
+    while (len > 0)
+    {
+        size_t word = 0;
+        while (word < len && text[word] != ',')
+            word++;
+
+        uint8_t day = 0;
+        while (day < 7 && !scheduleWordIs(text, word, scheduleDayNames[day]))
+            day++;
+        if (day == 7)
+            return 0;
+
+        days |= 1 << day;
+
+        text += word;
+        len -= word;
+        if (len > 0)
+        {
+            text++;
+            len--;
+        }
+    }
+
+    return days;
+}
+
+bool scheduleParseWhen(const char *text, ScheduleEntry &entry, time_t now, const char **end)
+{
+    while (*text == ' ')
+        text++;
+
+    const char *word = text;
+    while (*text && *text != ' ')
+        text++;
+    size_t wordLen = text - word;
+
+    while (*text == ' ')
+        text++;
+
+    // Время HH:MM
+    char *next;
+    long hour = strtol(text, &next, 10);
+    if (next == text || *next != ':' || hour < 0 || hour > 23)
+        return false;
+
+    const char *minuteText = next + 1;
+    long minute = strtol(minuteText, &next, 10);
+    if (next - minuteText != 2 || minute < 0 || minute > 59 || (*next != '\0' && *next != ' '))
+        return false;
+
+    while (*next == ' ')
+        next++;
+    if (end != NULL)
+        *end = next;
+
+    entry.minute = hour * 60 + minute;
+    entry.days = 0;
+    entry.at = 0;
+
+    struct tm t;
+    localtime_r(&now, &t);
+    int year, month, mday;
+
+    if (scheduleWordIs(word, wordLen, "daily"))
+        entry.days = SCHEDULE_DAILY;
+    else if (scheduleWordIs(word, wordLen, "weekdays"))
+        entry.days = SCHEDULE_WEEKDAYS;
+    else if (scheduleWordIs(word, wordLen, "weekends"))
+        entry.days = SCHEDULE_WEEKENDS;
+    else if (scheduleWordIs(word, wordLen, "today") || scheduleWordIs(word, wordLen, "tomorrow"))
+        t.tm_mday += scheduleWordIs(word, wordLen, "tomorrow") ? 1 : 0;
+    else if (wordLen == 10 && sscanf(word, "%4d-%2d-%2d", &year, &month, &mday) == 3 &&
+             month >= 1 && month <= 12 && mday >= 1 && mday <= 31)
+    {
+        t.tm_year = year - 1900;
+        t.tm_mon = month - 1;
+        t.tm_mday = mday;
+    }
+    else if ((entry.days = scheduleParseDays(word, wordLen)) == 0)
+        return false;
+
+    if (entry.days != 0)
+        return true;
+
+    // Разовое задание: дата и время в местном времени, только в будущем
+    t.tm_hour = hour;
+    t.tm_min = minute;
+    t.tm_sec = 0;
+    t.tm_isdst = -1;
+    entry.at = mktime(&t);
+
+    return entry.at > now;
+}
+
+void scheduleFormatWhen(const ScheduleEntry &entry, char *buf, size_t size)
+{
+    char days[SCHEDULE_WHEN_LEN] = "";
+    size_t len = 0;
+
+    if (entry.days == SCHEDULE_DAILY)
+        strcpy(days, "daily");
+    else if (entry.days == SCHEDULE_WEEKDAYS)
+        strcpy(days, "weekdays");
+    else if (entry.days == SCHEDULE_WEEKENDS)
+        strcpy(days, "weekends");
+    else if (entry.days == 0)
+    {
+        struct tm t;
+        localtime_r(&entry.at, &t);
+        strftime(days, sizeof(days), "%Y-%m-%d", &t);
+    }
+    else
+    {
+        for (uint8_t day = 0; day < 7; day++)
+            if (entry.days & (1 << day))
+                len += snprintf(days + len, sizeof(days) - len, "%s%s", len ? "," : "", scheduleDayNames[day]);
+    }
+
+    snprintf(buf, size, "%s %02u:%02u", days, entry.minute / 60, entry.minute % 60);
+}
+
+bool scheduleParseLine(const char *line, ScheduleEntry &entry)
+{
+    unsigned id, days, minute;
+    long long at;
+    int code, channel;
+
+    if (sscanf(line, "%u %u %u %lld %d %d", &id, &days, &minute, &at, &code, &channel) != 6)
+        return false;
+    if (id == 0 || id > 255 || days > SCHEDULE_DAILY || minute >= 24 * 60 || code <= 0 || channel < -1 || channel > 127)
+        return false;
+
+    entry.id = id;
+    entry.days = days;
+    entry.minute = minute;
+    entry.at = (time_t)at;
+    entry.code = code;
+    entry.channel = channel;
+    return true;
+}
+
+void scheduleFormatLine(const ScheduleEntry &entry, char *buf, size_t size)
+{
+    snprintf(buf, size, "%u %u %u %lld %d %d", entry.id, entry.days, entry.minute, (long long)entry.at, entry.code,
+             entry.channel);
+}
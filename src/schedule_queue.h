@@ -0,0 +1,80 @@
+#ifndef SCHEDULE_QUEUE_H
+#define SCHEDULE_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#define SCHEDULE_MAX_ENTRIES 32 // Максимум заданий расписания
+#define SCHEDULE_GRACE_SEC 120  // Опоздавшее задание выполняется, если опоздание не больше (иначе пропускается)
+#define SCHEDULE_LINE_LEN 64    // Строка файла расписания
+#define SCHEDULE_WHEN_LEN 40    // Текст "когда": "mon,tue,wed,thu,fri,sat 07:00"
+
+// Маска дней недели: бит 0 - понедельник ... бит 6 - воскресенье
+#define SCHEDULE_DAILY 0x7F
+#define SCHEDULE_WEEKDAYS 0x1F
+#define SCHEDULE_WEEKENDS 0x60
+
+// Задание: код, отправляемый в заданное местное время
+struct ScheduleEntry
+{
+    uint8_t id;      // 1..255, 0 - ячейка свободна
+    uint8_t days;    // Маска дней недели; 0 - разовое задание
+    uint16_t minute; // Минута суток местного времени
+    time_t at;       // Время разового задания
+    int code;        // ID кода
+    int8_t channel;  // Канал излучателя, -1 - канал устройства кода
+};
+
+enum ScheduleResult : uint8_t
+{
+    SCHEDULE_IDLE,   // Нет наступивших заданий
+    SCHEDULE_FIRE,   // Задание нужно выполнить
+    SCHEDULE_MISSED, // Задание опоздало больше чем на SCHEDULE_GRACE_SEC (часы были не синхронизированы или стояли)
+};
+
+// Очередь заданий: двоичная min-куча по времени следующего срабатывания.
+// Не зависит от Arduino и часов устройства: текущее время передается параметром,
+// поэтому логику можно проверять на хосте с имитацией часов. Не потокобезопасна
+class ScheduleQueue
+{
+public:
+    void clear();
+    int add(const ScheduleEntry &entry, time_t now); // id == 0 - назначить новый; возвращает id или -1
+    bool remove(uint8_t id);
+    void rebuild(time_t now); // Пересчет всех сроков после перевода часов
+
+    ScheduleResult poll(time_t now, ScheduleEntry &entry); // Одно наступившее задание; вызывать до SCHEDULE_IDLE
+    time_t nextDue() const { return _size ? _due[_heap[0]] : 0; } // 0 - заданий нет
+
+    uint8_t count() const { return _size; }
+    bool get(uint8_t index, ScheduleEntry &entry, time_t &due) const; // Задания в порядке id
+
+private:
+    int slotOf(uint8_t id) const; // id 0 - свободная ячейка
+    void place(uint8_t slot, time_t now);
+    void siftUp(uint8_t pos);
+    void siftDown(uint8_t pos);
+    void swap(uint8_t a, uint8_t b);
+    void removeAt(uint8_t pos);
+
+    ScheduleEntry _entries[SCHEDULE_MAX_ENTRIES];
+    time_t _due[SCHEDULE_MAX_ENTRIES];
+    uint8_t _heap[SCHEDULE_MAX_ENTRIES]; // Ячейки _entries, упорядоченные по _due
+    uint8_t _pos[SCHEDULE_MAX_ENTRIES];  // Позиция ячейки в _heap
+    uint8_t _size;
+    time_t _lastPoll;
+};
+
+// Следующее срабатывание строго после after (местное время по TZ), 0 - больше не сработает
+time_t scheduleNextTime(const ScheduleEntry &entry, time_t after);
+
+// "<daily|weekdays|weekends|mon,wed,...|YYYY-MM-DD> <HH:MM>"; end - текст после времени
+bool scheduleParseWhen(const char *text, ScheduleEntry &entry, time_t now, const char **end);
+void scheduleFormatWhen(const ScheduleEntry &entry, char *buf, size_t size);
+
+// Строка файла расписания: "id days minute at code channel"
+bool scheduleParseLine(const char *line, ScheduleEntry &entry);
+void scheduleFormatLine(const ScheduleEntry &entry, char *buf, size_t size);
+
+#endif // SCHEDULE_QUEUE_H
@@ -0,0 +1,643 @@
+#include "telegram_api.h"
+#include "config.h"
+#include <WiFiClientSecure.h>
+#include <UniversalTelegramBot.h> // TELEGRAM_CERTIFICATE_ROOT
+#include <SD.h>
+#include "power_manager.h"
+#include "freertos/queue.h"
+
+#define TELEGRAM_HTTP_TIMEOUT_MS 3000 // Таймаут ожидания данных от сервера
+#define TELEGRAM_HTTP_LINE_LEN 96     // Буфер строки заголовка HTTP
+#define TELEGRAM_HTTP_CHUNK_LEN 128   // Порция тела ответа, передаваемая обработчику
+#define TELEGRAM_LONG_POLL_WAIT_MS 20 // Период проверки сокета и очереди ответов во время long polling
+#define TELEGRAM_BODY_CHUNK_LEN 256   // Буфер отправки тела POST (каждая запись в TLS-клиент - отдельная TLS-запись)
+#define TELEGRAM_BODY_PARTS 16        // Частей тела JSON-запроса
+#define TELEGRAM_BOUNDARY "----IrRemoteBoundary7MA4YWxk"
+
+extern QueueHandle_t telegramQueue;
+
+// Клиент сервера Bot API: TLS с корневым сертификатом из config.h или обычный TCP для локального тестового сервера
+WiFiClientSecure secured_client;
+WiFiClient plainClient;
+Client *httpClient = &secured_client;
+
+// Текущий запрос: long polling (таймаут сервера, с) и учет времени для отчета /power
+uint16_t httpLongPollS = 0;
+uint32_t httpWaitUs = 0;
+bool httpConnected = false;
+bool httpAborted = false;
+
+// Статистика памяти за один запрос
+uint32_t httpHeapStart = 0;
+uint32_t httpHeapMin = 0;
+uint32_t pollHeapPeak = 0;
+
+uint16_t retryAfterS = 0; // Пауза из последнего ответа 429
+uint32_t httpRetries = 0; // Повторы запросов после закрытия соединения сервером
+
+void telegramBegin()
+{
+    if (TELEGRAM_API_TLS)
+    {
+        secured_client.setCACert(TELEGRAM_API_CERT);
+        httpClient = &secured_client;
+    }
+    else
+    {
+        httpClient = &plainClient;
+    }
+}
+
+// Срок истек; сравнение разности переживает переполнение millis() через 49.7 суток
+bool deadlinePassed(unsigned long deadline)
+{
+    return (long)(millis() - deadline) > 0;
+}
+
+int readByte(unsigned long &deadline)
+{
+    while (!httpClient->available())
+    {
+        if (!httpClient->connected() || deadlinePassed(deadline))
+            return -1;
+
+        // Ответ с Ядра 0 не ждет окончания long polling: запрос прерывается, соединение закрывается
+        if (httpLongPollS > 0 && uxQueueMessagesWaiting(telegramQueue) > 0)
+        {
+            httpAborted = true;
+            return -1;
+        }
+
+        uint32_t start = micros();
+        vTaskDelay(httpLongPollS > 0 ? pdMS_TO_TICKS(TELEGRAM_LONG_POLL_WAIT_MS) : 1);
+        httpWaitUs += micros() - start;
+    }
+
+    deadline = millis() + TELEGRAM_HTTP_TIMEOUT_MS;
+    httpLongPollS = 0; // Ответ пошел: дальше обычное ожидание, прерывать его уже нельзя
+    return httpClient->read();
+}
+
+bool readLine(char *buf, size_t size, unsigned long &deadline)
+{
+    size_t len = 0;
+
+    for (;;)
+    {
+        int c = readByte(deadline);
+
+        if (c < 0)
+            return false;
+        if (c == '\n')
+            break;
+        if (c != '\r' && len < size - 1)
+            buf[len++] = (char)c;
+    }
+
+    buf[len] = '\0';
+    return true;
+}
+
+// Чтение length байт тела (SIZE_MAX - до закрытия соединения) с передачей обработчику
+bool readBody(size_t length, TelegramBodyHandler handler, void *ctx, unsigned long &deadline)
+{
+    uint8_t buf[TELEGRAM_HTTP_CHUNK_LEN];
+
+    while (length > 0)
+    {
+        int avail = httpClient->available();
+
+        if (avail <= 0)
+        {
+            if (!httpClient->connected())
+                return length == SIZE_MAX;
+            if (deadlinePassed(deadline))
+                return false;
+
+            uint32_t start = micros();
+            vTaskDelay(1);
+            httpWaitUs += micros() - start;
+            continue;
+        }
+
+        size_t toRead = min((size_t)avail, min(length, sizeof(buf)));
+        int n = httpClient->read(buf, toRead);
+
+        if (n <= 0)
+            continue;
+
+        deadline = millis() + TELEGRAM_HTTP_TIMEOUT_MS;
+
+        uint32_t freeHeap = ESP.getFreeHeap();
+        if (freeHeap < httpHeapMin)
+            httpHeapMin = freeHeap;
+
+        if (!handler(buf, n, ctx))
+            return false;
+
+        if (length != SIZE_MAX)
+            length -= n;
+    }
+
+    return true;
+}
+
+// Тело POST-запроса: writer вызывается с client == NULL для подсчета длины, затем для отправки
+typedef size_t (*TelegramBodyWriter)(Client *client, void *ctx);
+
+struct HttpBody
+{
+    const char *contentType;
+    TelegramBodyWriter write;
+    void *ctx;
+};
+
+// Отправка запроса и чтение строки статуса. Сервер мог закрыть соединение keep-alive
+// в паузе между запросами - тогда запрос один раз повторяется на новом соединении
+bool httpSendRequest(const char *path, const HttpBody *body, char *line, size_t size, unsigned long &deadline)
+{
+    for (int attempt = 0;; attempt++)
+    {
+        bool reused = httpClient->connected();
+
+        if (!reused)
+        {
+            httpConnected = true;
+            if (!httpClient->connect(TELEGRAM_API_HOST, TELEGRAM_API_PORT))
+                return false;
+        }
+
+        // Остатки предыдущего ответа сбили бы разбор
+        while (httpClient->available())
+            httpClient->read();
+
+        httpClient->print(body ? F("POST ") : F("GET "));
+        httpClient->print(path);
+        httpClient->print(F(" HTTP/1.1\r\nHost: " TELEGRAM_API_HOST "\r\nConnection: keep-alive\r\n"));
+
+        if (body)
+        {
+            httpClient->print(F("Content-Type: "));
+            httpClient->print(body->contentType);
+            httpClient->print(F("\r\nContent-Length: "));
+            httpClient->print((unsigned long)body->write(NULL, body->ctx));
+            httpClient->print(F("\r\n\r\n"));
+            body->write(httpClient, body->ctx);
+        }
+        else
+        {
+            httpClient->print(F("\r\n"));
+        }
+
+        // При long polling сервер отвечает, когда придет сообщение или истечет его таймаут
+        deadline = millis() + TELEGRAM_HTTP_TIMEOUT_MS + httpLongPollS * 1000UL;
+
+        if (readLine(line, size, deadline) && strncmp(line, "HTTP/1.", 7) == 0)
+            return true;
+
+        // Повтор только для закрытого сервером соединения: по таймауту запрос мог быть уже выполнен
+        bool closed = !httpClient->connected();
+        httpClient->stop();
+
+        if (!reused || !closed || httpAborted || attempt > 0)
+            return false;
+
+        httpRetries++;
+    }
+}
+
+int httpRequest(const char *path, const HttpBody *body, TelegramBodyHandler handler, void *ctx)
+{
+    httpHeapStart = ESP.getFreeHeap();
+    httpHeapMin = httpHeapStart;
+
+    char line[TELEGRAM_HTTP_LINE_LEN];
+    unsigned long deadline;
+
+    if (!httpSendRequest(path, body, line, sizeof(line), deadline))
+        return -1;
+
+    int status = atoi(line + 9);
+    size_t contentLength = SIZE_MAX;
+    bool chunked = false;
+
+    // Заголовки
+    for (;;)
+    {
+        if (!readLine(line, sizeof(line), deadline))
+        {
+            httpClient->stop();
+            return -1;
+        }
+
+        if (line[0] == '\0')
+            break;
+
+        if (strncasecmp(line, "Content-Length:", 15) == 0)
+            contentLength = strtoul(line + 15, NULL, 10);
+        else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line + 18, "chunked") != NULL)
+            chunked = true;
+    }
+
+    bool success = true;
+
+    if (chunked)
+    {
+        for (;;)
+        {
+            if (!readLine(line, sizeof(line), deadline))
+            {
+                success = false;
+                break;
+            }
+
+            size_t chunkLen = strtoul(line, NULL, 16);
+
+            if (chunkLen == 0)
+            {
+                // Завершающие заголовки до пустой строки
+                while (readLine(line, sizeof(line), deadline) && line[0] != '\0')
+                    ;
+                break;
+            }
+
+            if (!readBody(chunkLen, handler, ctx, deadline) || !readLine(line, sizeof(line), deadline))
+            {
+                success = false;
+                break;
+            }
+        }
+    }
+    else
+    {
+        success = readBody(contentLength, handler, ctx, deadline);
+    }
+
+    if (!success || contentLength == SIZE_MAX)
+        httpClient->stop(); // Поток ответа не выровнен, соединение повторно не используем
+
+    return success ? status : -1;
+}
+
+int telegramHttpRequest(const char *path, const HttpBody *body, TelegramBodyHandler handler, void *ctx)
+{
+    uint32_t start = micros();
+
+    httpWaitUs = 0;
+    httpConnected = false;
+    httpAborted = false;
+
+    int status = httpRequest(path, body, handler, ctx);
+
+    // Активное время - запрос без ожидания данных от сервера
+    powerAddActive(POWER_DOMAIN_NETWORK, micros() - start - httpWaitUs);
+    powerCountRequest(httpConnected, httpAborted);
+
+    return status;
+}
+
+int telegramHttpGet(const char *path, TelegramBodyHandler handler, void *ctx)
+{
+    return telegramHttpRequest(path, NULL, handler, ctx);
+}
+
+bool feedUpdateParser(const uint8_t *data, size_t len, void *ctx)
+{
+    return ((TelegramUpdateParser *)ctx)->feed(data, len);
+}
+
+int telegramGetUpdates(long offset, TelegramUpdate *updates, uint8_t maxUpdates, long &lastUpdateId, uint16_t timeoutS)
+{
+    char path[192];
+    snprintf(path, sizeof(path), "/bot%s/getUpdates?offset=%ld&limit=%u&timeout=%u&allowed_updates=%%5B%%22message%%22%%2C%%22callback_query%%22%%5D",
+             BOT_TOKEN, offset, maxUpdates, timeoutS);
+
+    TelegramUpdateParser parser;
+    parser.begin(updates, maxUpdates);
+
+    httpLongPollS = timeoutS;
+    int status = telegramHttpGet(path, feedUpdateParser, &parser);
+    httpLongPollS = 0;
+
+    uint32_t heapUsed = httpHeapStart - httpHeapMin;
+    if (heapUsed > pollHeapPeak)
+        pollHeapPeak = heapUsed;
+
+    if (status != 200 || !parser.ok())
+        return 0;
+
+    if (parser.count() > 0)
+        lastUpdateId = parser.lastUpdateId();
+
+    return parser.count();
+}
+
+uint32_t telegramPollHeapPeak()
+{
+    return pollHeapPeak;
+}
+
+// Поиск значения по ключу в потоке ответа: строки ("file_path":") или числа ("retry_after":)
+struct JsonValueMatch
+{
+    const char *pattern;
+    char *out;
+    size_t size;
+    size_t len;
+    uint8_t matched;
+    bool capturing;
+    bool done;
+};
+
+bool feedJsonValueMatch(const uint8_t *data, size_t len, void *ctx)
+{
+    JsonValueMatch *m = (JsonValueMatch *)ctx;
+    bool isString = m->pattern[strlen(m->pattern) - 1] == '"';
+
+    for (size_t i = 0; i < len && !m->done; i++)
+    {
+        char c = (char)data[i];
+
+        if (m->capturing)
+        {
+            if (isString ? c == '"' : !isdigit(c))
+                m->done = true;
+            else if (c != '\\' && m->len < m->size - 1) // "\/" в JSON - это "/"
+                m->out[m->len++] = c;
+        }
+        else if (c == m->pattern[m->matched])
+        {
+            if (m->pattern[++m->matched] == '\0')
+                m->capturing = true;
+        }
+        else
+        {
+            m->matched = (c == m->pattern[0]) ? 1 : 0;
+        }
+    }
+
+    m->out[m->len] = '\0';
+    return true;
+}
+
+bool telegramGetFilePath(const char *fileId, char *filePath, size_t size)
+{
+    char path[TG_FILE_ID_LEN + 96];
+    snprintf(path, sizeof(path), "/bot%s/getFile?file_id=%s", BOT_TOKEN, fileId);
+
+    JsonValueMatch match = {"\"file_path\":\"", filePath, size, 0, 0, false, false};
+    filePath[0] = '\0';
+
+    return telegramHttpGet(path, feedJsonValueMatch, &match) == 200 && match.done && match.len > 0;
+}
+
+// Буферизованный вывод тела запроса; client == NULL - только подсчет длины.
+// Как Print передается источнику документа (TelegramDocumentWriter)
+struct BodyOut : public Print
+{
+    Client *client;
+    uint8_t buf[TELEGRAM_BODY_CHUNK_LEN];
+    size_t len;
+    size_t total;
+
+    size_t write(uint8_t b) override
+    {
+        put(b);
+        return 1;
+    }
+
+    size_t write(const uint8_t *data, size_t size) override
+    {
+        for (size_t i = 0; i < size; i++)
+            put(data[i]);
+        return size;
+    }
+
+    void flush()
+    {
+        if (client != NULL && len > 0)
+            client->write(buf, len);
+        len = 0;
+    }
+
+    void put(uint8_t b)
+    {
+        total++;
+        if (client == NULL)
+            return;
+
+        buf[len++] = b;
+        if (len == sizeof(buf))
+            flush();
+    }
+
+    void print(const char *s)
+    {
+        while (*s)
+            put(*s++);
+    }
+
+    // Строка JSON: кавычки, обратная косая черта и управляющие символы экранируются
+    void printEscaped(const char *s)
+    {
+        for (; *s; s++)
+        {
+            uint8_t c = *s;
+
+            if (c == '"' || c == '\\')
+            {
+                put('\\');
+                put(c);
+            }
+            else if (c == '\n')
+            {
+                put('\\');
+                put('n');
+            }
+            else if (c < 0x20)
+            {
+                char hex[8];
+                snprintf(hex, sizeof(hex), "\\u%04x", c);
+                print(hex);
+            }
+            else
+            {
+                put(c);
+            }
+        }
+    }
+};
+
+// Тело JSON из частей: части с данными пользователя экранируются при выводе
+struct JsonBody
+{
+    const char *parts[TELEGRAM_BODY_PARTS];
+    bool escape[TELEGRAM_BODY_PARTS];
+    uint8_t count;
+
+    void add(const char *part, bool escaped = false)
+    {
+        if (count < TELEGRAM_BODY_PARTS)
+        {
+            parts[count] = part;
+            escape[count++] = escaped;
+        }
+    }
+};
+
+size_t writeJsonBody(Client *client, void *ctx)
+{
+    JsonBody *body = (JsonBody *)ctx;
+    BodyOut out;
+    out.client = client;
+    out.len = out.total = 0;
+
+    for (uint8_t i = 0; i < body->count; i++)
+    {
+        if (body->escape[i])
+            out.printEscaped(body->parts[i]);
+        else
+            out.print(body->parts[i]);
+    }
+
+    out.flush();
+    return out.total;
+}
+
+// Документ: multipart/form-data, содержимое пишет источник порциями прямо в сокет
+struct DocumentBody
+{
+    TelegramDocumentWriter write;
+    void *ctx;
+    const char *fileName;
+};
+
+size_t writeDocumentBody(Client *client, void *ctx)
+{
+    DocumentBody *doc = (DocumentBody *)ctx;
+    BodyOut out;
+    out.client = client;
+    out.len = out.total = 0;
+
+    out.print("--" TELEGRAM_BOUNDARY "\r\nContent-Disposition: form-data; name=\"chat_id\"\r\n\r\n" CHAT_ID
+              "\r\n--" TELEGRAM_BOUNDARY "\r\nContent-Disposition: form-data; name=\"document\"; filename=\"");
+    out.printEscaped(doc->fileName);
+    out.print("\"\r\nContent-Type: text/plain\r\n\r\n");
+
+    doc->write(out, doc->ctx);
+
+    out.print("\r\n--" TELEGRAM_BOUNDARY "--\r\n");
+    out.flush();
+    return out.total;
+}
+
+// POST к методу Bot API; из ответа 429 запоминается пауза retry_after
+int telegramPost(const char *method, const char *contentType, TelegramBodyWriter writer, void *ctx)
+{
+    char path[96];
+    snprintf(path, sizeof(path), "/bot%s/%s", BOT_TOKEN, method);
+
+    char value[8];
+    JsonValueMatch match = {"\"retry_after\":", value, sizeof(value), 0, 0, false, false};
+    HttpBody body = {contentType, writer, ctx};
+
+    int status = telegramHttpRequest(path, &body, feedJsonValueMatch, &match);
+    retryAfterS = (status == 429 && match.len > 0) ? atoi(value) : 0;
+
+    return status;
+}
+
+int telegramSendMessage(const char *text, const char *parseMode, const char *keyboard, long messageId)
+{
+    char id[16];
+    JsonBody body;
+    body.count = 0;
+
+    body.add("{\"chat_id\":\"" CHAT_ID "\",\"text\":\"");
+    body.add(text, true);
+    body.add("\"");
+
+    if (parseMode != NULL && parseMode[0] != '\0')
+    {
+        body.add(",\"parse_mode\":\"");
+        body.add(parseMode, true);
+        body.add("\"");
+    }
+
+    if (keyboard != NULL)
+    {
+        body.add(",\"reply_markup\":{\"inline_keyboard\":");
+        body.add(keyboard);
+        body.add("}");
+    }
+
+    if (messageId != 0)
+    {
+        snprintf(id, sizeof(id), "%ld", messageId);
+        body.add(",\"message_id\":");
+        body.add(id);
+    }
+
+    body.add("}");
+
+    return telegramPost(messageId != 0 ? "editMessageText" : "sendMessage", "application/json", writeJsonBody, &body);
+}
+
+int telegramAnswerCallback(const char *callbackId, const char *text)
+{
+    JsonBody body;
+    body.count = 0;
+
+    body.add("{\"callback_query_id\":\"");
+    body.add(callbackId, true);
+    body.add("\",\"text\":\"");
+    body.add(text, true);
+    body.add("\"}");
+
+    return telegramPost("answerCallbackQuery", "application/json", writeJsonBody, &body);
+}
+
+bool telegramSendDocument(const char *fileName, TelegramDocumentWriter writer, void *ctx)
+{
+    DocumentBody doc = {writer, ctx, fileName};
+
+    return telegramPost("sendDocument", "multipart/form-data; boundary=" TELEGRAM_BOUNDARY, writeDocumentBody, &doc) == 200;
+}
+
+uint16_t telegramRetryAfter()
+{
+    return retryAfterS;
+}
+
+uint32_t telegramRetries()
+{
+    return httpRetries;
+}
+
+bool writeFileChunk(const uint8_t *data, size_t len, void *ctx)
+{
+    return ((File *)ctx)->write(data, len) == len;
+}
+
+// Загрузка файла с серверов Telegram прямо на SD-карту
+bool telegramDownloadFile(const char *filePath, const char *destPath)
+{
+    File file = SD.open(destPath, FILE_WRITE);
+
+    if (!file)
+        return false;
+
+    char path[192];
+    snprintf(path, sizeof(path), "/file/bot%s/%s", BOT_TOKEN, filePath);
+
+    int status = telegramHttpGet(path, writeFileChunk, &file);
+    file.close();
+
+    if (status != 200)
+    {
+        SD.remove(destPath);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,30 @@
+#ifndef TELEGRAM_API_H
+#define TELEGRAM_API_H
+
+#include <Arduino.h>
+#include "telegram_update_parser.h"
+
+// Обработчик тела HTTP-ответа: получает данные порциями по мере приема
+typedef bool (*TelegramBodyHandler)(const uint8_t *data, size_t len, void *ctx);
+
+// Источник документа: пишет содержимое в out. Вызывается дважды - для подсчета Content-Length
+// и для отправки - и оба раза должен выдать одни и те же байты
+typedef void (*TelegramDocumentWriter)(Print &out, void *ctx);
+
+// Прямые запросы к Bot API без буферизации ответа целиком. Сервер, порт, TLS и сертификат -
+// TELEGRAM_API_* в config.h (например, локальный тестовый сервер tools/fake_telegram_server.py)
+void telegramBegin();
+int telegramHttpGet(const char *path, TelegramBodyHandler handler, void *ctx);
+int telegramGetUpdates(long offset, TelegramUpdate *updates, uint8_t maxUpdates, long &lastUpdateId, uint16_t timeoutS = 0); // timeoutS > 0 - long polling
+uint32_t telegramPollHeapPeak();
+bool telegramGetFilePath(const char *fileId, char *filePath, size_t size);
+bool telegramDownloadFile(const char *filePath, const char *destPath);
+
+// Отправка в CHAT_ID; возвращают HTTP-статус (-1 - нет связи), после 429 - пауза в telegramRetryAfter()
+int telegramSendMessage(const char *text, const char *parseMode = "", const char *keyboard = NULL, long messageId = 0); // keyboard - массив inline_keyboard; messageId != 0 - editMessageText
+int telegramAnswerCallback(const char *callbackId, const char *text = "");
+bool telegramSendDocument(const char *fileName, TelegramDocumentWriter writer, void *ctx);
+uint16_t telegramRetryAfter();
+uint32_t telegramRetries(); // Запросы, повторенные после закрытия соединения сервером
+
+#endif // TELEGRAM_API_H
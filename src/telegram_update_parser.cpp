@@ -0,0 +1,439 @@
+#include "telegram_update_parser.h"
+#include <string.h>
+
+void TelegramUpdateParser::begin(TelegramUpdate *updates, uint8_t maxUpdates)
+{
+    _updates = updates;
+    _maxUpdates = maxUpdates;
+    _count = 0;
+    _lastUpdateId = 0;
+    _ok = false;
+    _error = false;
+
+    _state = ST_VALUE;
+    _depth = 0;
+
+    _field = FIELD_NONE;
+    _stringIsKey = false;
+    _stringLen = 0;
+    _highSurrogate = 0;
+
+    _current = NULL;
+}
+
+bool TelegramUpdateParser::feed(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len && !_error; i++)
+    {
+        if (!feedChar((char)data[i]))
+            _error = true;
+    }
+
+    return !_error;
+}
+
+bool TelegramUpdateParser::feedChar(char c)
+{
+    bool isSpace = (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+
+    switch (_state)
+    {
+    case ST_VALUE:
+        if (isSpace)
+            return true;
+
+        _field = fieldAtCursor();
+
+        if (c == '{')
+        {
+            if (!openContainer(false))
+                return false;
+            _state = ST_KEY;
+            return true;
+        }
+        if (c == '[')
+            return openContainer(true);
+        if (c == ']') // Пустой массив
+            return closeContainer(true);
+        if (c == '"')
+        {
+            _stringIsKey = false;
+            _stringLen = 0;
+            _highSurrogate = 0;
+            _state = ST_STRING;
+            return true;
+        }
+        if (c == '-' || (c >= '0' && c <= '9'))
+        {
+            _negative = (c == '-');
+            _number = _negative ? 0 : c - '0';
+            _state = ST_NUMBER;
+            return true;
+        }
+        if (c == 't' || c == 'f' || c == 'n')
+        {
+            _literalTrue = (c == 't');
+            _state = ST_LITERAL;
+            return true;
+        }
+        return false;
+
+    case ST_KEY:
+        if (isSpace)
+            return true;
+        if (c == '"')
+        {
+            _stringIsKey = true;
+            _stringLen = 0;
+            _highSurrogate = 0;
+            _stack[_depth - 1].key[0] = '\0';
+            _state = ST_STRING;
+            return true;
+        }
+        if (c == '}')
+            return closeContainer(false);
+        return false;
+
+    case ST_COLON:
+        if (isSpace)
+            return true;
+        if (c == ':')
+        {
+            _state = ST_VALUE;
+            return true;
+        }
+        return false;
+
+    case ST_AFTER_VALUE:
+        if (isSpace)
+            return true;
+        if (c == ',')
+        {
+            _state = _stack[_depth - 1].isArray ? ST_VALUE : ST_KEY;
+            return true;
+        }
+        if (c == '}')
+            return closeContainer(false);
+        if (c == ']')
+            return closeContainer(true);
+        return false;
+
+    case ST_STRING:
+        if (c == '"')
+        {
+            if (_stringIsKey)
+                _state = ST_COLON;
+            else
+                endValue();
+            return true;
+        }
+        if (c == '\\')
+        {
+            _state = ST_STRING_ESC;
+            return true;
+        }
+        putStringByte((uint8_t)c);
+        return true;
+
+    case ST_STRING_ESC:
+        _state = ST_STRING;
+        switch (c)
+        {
+        case '"':
+        case '\\':
+        case '/':
+            putStringByte((uint8_t)c);
+            return true;
+        case 'b':
+            putStringByte('\b');
+            return true;
+        case 'f':
+            putStringByte('\f');
+            return true;
+        case 'n':
+            putStringByte('\n');
+            return true;
+        case 'r':
+            putStringByte('\r');
+            return true;
+        case 't':
+            putStringByte('\t');
+            return true;
+        case 'u':
+            _hex = 0;
+            _hexDigits = 0;
+            _state = ST_STRING_HEX;
+            return true;
+        default:
+            return false;
+        }
+
+    case ST_STRING_HEX:
+    {
+        uint8_t digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            return false;
+
+        _hex = (_hex << 4) | digit;
+
+        if (++_hexDigits < 4)
+            return true;
+
+        _state = ST_STRING;
+
+        if (_hex >= 0xD800 && _hex <= 0xDBFF)
+        {
+            _highSurrogate = _hex; // Ждем вторую половину суррогатной пары
+        }
+        else if (_hex >= 0xDC00 && _hex <= 0xDFFF && _highSurrogate)
+        {
+            putCodepoint(0x10000 + ((_highSurrogate - 0xD800) << 10) + (_hex - 0xDC00));
+            _highSurrogate = 0;
+        }
+        else
+        {
+            putCodepoint(_hex);
+        }
+        return true;
+    }
+
+    case ST_NUMBER:
+        if (c >= '0' && c <= '9')
+        {
+            if (_number < 100000000000000000LL)
+                _number = _number * 10 + (c - '0');
+            return true;
+        }
+        if (c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-')
+        {
+            _field = FIELD_NONE; // Дробные числа нам не нужны
+            return true;
+        }
+
+        if (_negative)
+            _number = -_number;
+
+        if (_field == FIELD_UPDATE_ID)
+            _current->updateId = (long)_number;
+        else if (_field == FIELD_CHAT_ID)
+            _current->chatId = _number;
+        else if (_field == FIELD_MESSAGE_ID)
+            _current->messageId = (long)_number;
+
+        endValue();
+        return feedChar(c); // Символ после числа обрабатываем заново
+
+    case ST_LITERAL:
+        if (c >= 'a' && c <= 'z')
+            return true;
+
+        if (_field == FIELD_OK)
+            _ok = _literalTrue;
+
+        endValue();
+        return feedChar(c);
+
+    case ST_DONE:
+        return isSpace;
+    }
+
+    return false;
+}
+
+bool TelegramUpdateParser::openContainer(bool isArray)
+{
+    if (_depth >= TG_PARSER_MAX_DEPTH)
+        return false;
+
+    // Элемент массива "result" - очередное обновление
+    if (!isArray && _depth == 2 && keyIs(0, "result") && _stack[1].isArray)
+        startUpdate();
+    else if (!isArray && _depth == 3 && _current != NULL && keyIs(2, "callback_query"))
+        _current->isCallback = true;
+
+    _stack[_depth].isArray = isArray;
+    _stack[_depth].key[0] = '\0';
+    _depth++;
+
+    _state = isArray ? ST_VALUE : ST_KEY;
+    return true;
+}
+
+bool TelegramUpdateParser::closeContainer(bool isArray)
+{
+    if (_depth == 0 || _stack[_depth - 1].isArray != isArray)
+        return false;
+
+    _depth--;
+
+    if (!isArray && _depth == 2 && keyIs(0, "result") && _stack[1].isArray)
+        commitUpdate();
+
+    endValue();
+    return true;
+}
+
+void TelegramUpdateParser::endValue()
+{
+    _field = FIELD_NONE;
+    _state = (_depth == 0) ? ST_DONE : ST_AFTER_VALUE;
+}
+
+TelegramUpdateParser::Field TelegramUpdateParser::fieldAtCursor() const
+{
+    if (_depth == 1 && keyIs(0, "ok"))
+        return FIELD_OK;
+
+    if (_current == NULL || _depth < 3 || !keyIs(0, "result") || !_stack[1].isArray)
+        return FIELD_NONE;
+
+    if (_depth == 3 && keyIs(2, "update_id"))
+        return FIELD_UPDATE_ID;
+
+    if (keyIs(2, "message"))
+    {
+        if (_depth == 4 && keyIs(3, "text"))
+            return FIELD_TEXT;
+        if (_depth == 5 && keyIs(3, "chat") && keyIs(4, "id"))
+            return FIELD_CHAT_ID;
+        if (_depth == 5 && keyIs(3, "document") && keyIs(4, "file_id"))
+            return FIELD_FILE_ID;
+    }
+    else if (keyIs(2, "callback_query"))
+    {
+        if (_depth == 4 && keyIs(3, "id"))
+            return FIELD_CALLBACK_ID;
+        if (_depth == 4 && keyIs(3, "data"))
+            return FIELD_TEXT;
+        if (_depth == 5 && keyIs(3, "message") && keyIs(4, "message_id"))
+            return FIELD_MESSAGE_ID;
+        if (_depth == 6 && keyIs(3, "message") && keyIs(4, "chat") && keyIs(5, "id"))
+            return FIELD_CHAT_ID;
+    }
+
+    return FIELD_NONE;
+}
+
+bool TelegramUpdateParser::keyIs(uint8_t level, const char *key) const
+{
+    return !_stack[level].isArray && strcmp(_stack[level].key, key) == 0;
+}
+
+void TelegramUpdateParser::putStringByte(uint8_t b)
+{
+    if (_stringIsKey)
+    {
+        char *key = _stack[_depth - 1].key;
+
+        if (_stringLen < TG_PARSER_KEY_LEN - 1)
+        {
+            key[_stringLen] = (char)b;
+            key[_stringLen + 1] = '\0';
+        }
+        else
+        {
+            key[0] = '\0'; // Слишком длинный ключ нам не интересен
+        }
+        _stringLen++;
+        return;
+    }
+
+    if (_field == FIELD_TEXT)
+    {
+        if (_stringLen < TG_MAX_TEXT_LEN)
+        {
+            _current->text[_stringLen++] = (char)b;
+            _current->text[_stringLen] = '\0';
+        }
+        else
+        {
+            _current->oversized = true;
+        }
+    }
+    else if (_field == FIELD_CALLBACK_ID)
+    {
+        if (_stringLen < TG_CALLBACK_ID_LEN)
+        {
+            _current->callbackId[_stringLen++] = (char)b;
+            _current->callbackId[_stringLen] = '\0';
+        }
+        else
+        {
+            _current->oversized = true;
+        }
+    }
+    else if (_field == FIELD_FILE_ID)
+    {
+        if (_stringLen < TG_FILE_ID_LEN)
+        {
+            _current->fileId[_stringLen++] = (char)b;
+            _current->fileId[_stringLen] = '\0';
+        }
+        else
+        {
+            _current->oversized = true;
+        }
+    }
+}
+
+void TelegramUpdateParser::putCodepoint(uint32_t cp)
+{
+    if (cp < 0x80)
+    {
+        putStringByte((uint8_t)cp);
+    }
+    else if (cp < 0x800)
+    {
+        putStringByte(0xC0 | (cp >> 6));
+        putStringByte(0x80 | (cp & 0x3F));
+    }
+    else if (cp < 0x10000)
+    {
+        putStringByte(0xE0 | (cp >> 12));
+        putStringByte(0x80 | ((cp >> 6) & 0x3F));
+        putStringByte(0x80 | (cp & 0x3F));
+    }
+    else
+    {
+        putStringByte(0xF0 | (cp >> 18));
+        putStringByte(0x80 | ((cp >> 12) & 0x3F));
+        putStringByte(0x80 | ((cp >> 6) & 0x3F));
+        putStringByte(0x80 | (cp & 0x3F));
+    }
+}
+
+void TelegramUpdateParser::startUpdate()
+{
+    // Обновления сверх буфера пропускаем: их update_id не учитывается и они придут снова
+    _current = (_count < _maxUpdates) ? &_updates[_count] : NULL;
+
+    if (_current != NULL)
+    {
+        _current->updateId = 0;
+        _current->chatId = 0;
+        _current->text[0] = '\0';
+        _current->oversized = false;
+        _current->isCallback = false;
+        _current->callbackId[0] = '\0';
+        _current->messageId = 0;
+        _current->fileId[0] = '\0';
+        _current->replayed = false;
+    }
+}
+
+void TelegramUpdateParser::commitUpdate()
+{
+    if (_current != NULL && _current->updateId > 0)
+    {
+        _lastUpdateId = _current->updateId;
+        _count++;
+    }
+
+    _current = NULL;
+}
@@ -0,0 +1,110 @@
+#ifndef TELEGRAM_UPDATE_PARSER_H
+#define TELEGRAM_UPDATE_PARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// --- Ограничения парсера ---
+#define TG_MAX_UPDATES 4       // Максимум обновлений за один запрос getUpdates
+#define TG_MAX_TEXT_LEN 256    // Максимальная длина текста сообщения (байт UTF-8)
+#define TG_PARSER_MAX_DEPTH 12 // Максимальная вложенность JSON (клавиатура в callback - 9 уровней)
+#define TG_PARSER_KEY_LEN 16   // Длина буфера для имени ключа JSON
+#define TG_CALLBACK_ID_LEN 32  // Длина ID callback-запроса
+#define TG_FILE_ID_LEN 128     // Длина file_id документа
+
+// Одно обновление Telegram: только нужные нам поля в фиксированных буферах
+struct TelegramUpdate
+{
+    long updateId;
+    long long chatId;
+    char text[TG_MAX_TEXT_LEN + 1]; // Текст сообщения или data нажатой inline-кнопки
+    bool oversized;                 // Текст длиннее TG_MAX_TEXT_LEN и был обрезан
+    bool isCallback;                // Обновление - нажатие inline-кнопки
+    char callbackId[TG_CALLBACK_ID_LEN + 1];
+    long messageId; // Сообщение с клавиатурой, в котором нажата кнопка
+    char fileId[TG_FILE_ID_LEN + 1]; // Приложенный документ, пусто - нет документа
+    bool replayed;                   // Из воспроизводимой трассы: ответы и отправка кодов подавляются
+};
+
+// Потоковый разбор ответа getUpdates: байты подаются по мере приема,
+// память не выделяется, объем ответа не ограничен
+class TelegramUpdateParser
+{
+public:
+    void begin(TelegramUpdate *updates, uint8_t maxUpdates);
+    bool feed(const uint8_t *data, size_t len); // false при ошибке синтаксиса
+
+    bool ok() const { return _ok && !_error && _state == ST_DONE; } // Ответ полный и "ok": true
+    uint8_t count() const { return _count; }                        // Принятые обновления
+    long lastUpdateId() const { return _lastUpdateId; }              // update_id последнего принятого
+
+private:
+    enum State : uint8_t
+    {
+        ST_VALUE,       // Ожидается значение
+        ST_KEY,         // Ожидается ключ объекта или '}'
+        ST_COLON,       // Ожидается ':'
+        ST_AFTER_VALUE, // Ожидается ',' или закрывающая скобка
+        ST_STRING,
+        ST_STRING_ESC,
+        ST_STRING_HEX,
+        ST_NUMBER,
+        ST_LITERAL,
+        ST_DONE
+    };
+
+    enum Field : uint8_t
+    {
+        FIELD_NONE,
+        FIELD_OK,
+        FIELD_UPDATE_ID,
+        FIELD_CHAT_ID,
+        FIELD_TEXT,
+        FIELD_CALLBACK_ID,
+        FIELD_MESSAGE_ID,
+        FIELD_FILE_ID
+    };
+
+    struct Frame
+    {
+        bool isArray;
+        char key[TG_PARSER_KEY_LEN];
+    };
+
+    bool feedChar(char c);
+    bool openContainer(bool isArray);
+    bool closeContainer(bool isArray);
+    void endValue();
+    Field fieldAtCursor() const;
+    bool keyIs(uint8_t level, const char *key) const;
+    void putStringByte(uint8_t b);
+    void putCodepoint(uint32_t cp);
+    void startUpdate();
+    void commitUpdate();
+
+    TelegramUpdate *_updates;
+    uint8_t _maxUpdates;
+    uint8_t _count;
+    long _lastUpdateId;
+    bool _ok;
+    bool _error;
+
+    State _state;
+    Frame _stack[TG_PARSER_MAX_DEPTH];
+    uint8_t _depth;
+
+    // Текущее значение
+    Field _field;
+    bool _stringIsKey;
+    size_t _stringLen;
+    uint32_t _hex;
+    uint8_t _hexDigits;
+    uint32_t _highSurrogate;
+    long long _number;
+    bool _negative;
+    bool _literalTrue;
+
+    TelegramUpdate *_current; // NULL, если обновление не помещается в буфер
+};
+
+#endif // TELEGRAM_UPDATE_PARSER_H
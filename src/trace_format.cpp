@@ -0,0 +1,293 @@
+#include "trace_format.h"
+#include "varint.h"
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+// Буфер записи: при нехватке места запись отбрасывается целиком
+struct TraceOut
+{
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    bool full;
+
+    void putByte(uint8_t b)
+    {
+        if (len < size)
+            buf[len++] = b;
+        else
+            full = true;
+    }
+
+    void putVarint(uint64_t value)
+    {
+        size_t n = full ? 0 : varintPut(buf + len, size - len, value);
+        if (n == 0)
+            full = true;
+        len += n;
+    }
+
+    void putString(const char *s)
+    {
+        size_t n = strlen(s);
+        putVarint(n);
+        if (full || len + n > size)
+        {
+            full = true;
+            return;
+        }
+        memcpy(buf + len, s, n);
+        len += n;
+    }
+};
+
+// Чтение данных одной записи
+struct TraceIn
+{
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+    bool error;
+
+    uint64_t getVarint()
+    {
+        uint64_t value = 0;
+        size_t n = error ? 0 : varintGet(buf + pos, len - pos, value);
+        if (n == 0)
+            error = true;
+        pos += n;
+        return value;
+    }
+
+    uint8_t getByte()
+    {
+        if (pos >= len)
+        {
+            error = true;
+            return 0;
+        }
+        return buf[pos++];
+    }
+
+    void getString(char *out, size_t size)
+    {
+        uint64_t n = getVarint();
+        if (error || n >= size || n > len - pos)
+        {
+            error = true;
+            out[0] = '\0';
+            return;
+        }
+        memcpy(out, buf + pos, n);
+        out[n] = '\0';
+        pos += n;
+    }
+};
+
+size_t traceEncodeHeader(uint8_t *buf, size_t size, uint32_t startTime)
+{
+    if (size < TRACE_HEADER_LEN)
+        return 0;
+
+    memcpy(buf, TRACE_MAGIC, 4);
+    buf[4] = TRACE_VERSION;
+    buf[5] = buf[6] = buf[7] = 0;
+    for (int i = 0; i < 4; i++)
+        buf[8 + i] = startTime >> (8 * i);
+
+    return TRACE_HEADER_LEN;
+}
+
+bool traceDecodeHeader(const uint8_t *buf, size_t len, uint32_t &startTime)
+{
+    if (len < TRACE_HEADER_LEN || memcmp(buf, TRACE_MAGIC, 4) != 0 || buf[4] != TRACE_VERSION)
+        return false;
+
+    startTime = 0;
+    for (int i = 0; i < 4; i++)
+        startTime |= (uint32_t)buf[8 + i] << (8 * i);
+
+    return true;
+}
+
+// Тип и длина записи перед данными: длина известна только после кодирования данных,
+// поэтому данные пишутся со смещением и затем сдвигаются к заголовку записи
+static size_t traceFinish(uint8_t *buf, size_t size, TraceRecordType type, TraceOut &out, size_t reserved)
+{
+    if (out.full)
+        return 0;
+
+    uint8_t head[1 + VARINT_MAX_LEN];
+    size_t dataLen = out.len - reserved;
+
+    head[0] = type;
+    size_t headLen = 1 + varintPut(head + 1, sizeof(head) - 1, dataLen);
+
+    // Заголовок записи длиннее зарезервированного места сдвигает данные вправо
+    if (headLen + dataLen > size)
+        return 0;
+
+    memmove(buf + headLen, buf + reserved, dataLen);
+    memcpy(buf, head, headLen);
+
+    return headLen + dataLen;
+}
+
+size_t traceEncodeUpdate(uint8_t *buf, size_t size, uint32_t deltaMs, uint8_t batchIndex, uint8_t batchSize,
+                         const TelegramUpdate &update)
+{
+    const size_t reserved = 1 + 3; // Тип и длина до 2 МБ
+    TraceOut out = {buf, size, reserved, size < reserved};
+
+    out.putVarint(deltaMs);
+    out.putByte(batchIndex);
+    out.putByte(batchSize);
+    out.putVarint(update.updateId);
+    out.putVarint(zigzagEncode(update.chatId));
+    out.putByte((update.isCallback ? 1 : 0) | (update.oversized ? 2 : 0));
+    out.putVarint(update.messageId);
+    out.putString(update.text);
+    out.putString(update.callbackId);
+    out.putString(update.fileId);
+
+    return traceFinish(buf, size, TRACE_RECORD_UPDATE, out, reserved);
+}
+
+size_t traceEncodeCapture(uint8_t *buf, size_t size, uint32_t deltaMs, const TraceCapture &capture)
+{
+    const size_t reserved = 1 + 3;
+    TraceOut out = {buf, size, reserved, size < reserved};
+
+    out.putVarint(deltaMs);
+    out.putVarint(zigzagEncode(capture.protocol)); // UNKNOWN = -1
+    out.putVarint(capture.value);
+    out.putVarint(capture.address);
+    out.putVarint(capture.command);
+    out.putVarint(capture.bits);
+    out.putVarint(capture.rawlen);
+    out.putByte(capture.repeat ? 1 : 0);
+
+    return traceFinish(buf, size, TRACE_RECORD_CAPTURE, out, reserved);
+}
+
+int traceDecodeRecord(const uint8_t *buf, size_t len, TraceRecord &record)
+{
+    if (len < 2)
+        return 0;
+
+    uint64_t dataLen;
+    size_t headLen = varintGet(buf + 1, len - 1, dataLen);
+
+    if (headLen == 0)
+        return len - 1 >= VARINT_MAX_LEN ? -1 : 0;
+    if (dataLen > TRACE_RECORD_MAX_LEN)
+        return -1;
+
+    headLen += 1;
+    if (len < headLen + dataLen)
+        return 0;
+
+    TraceIn in = {buf + headLen, (size_t)dataLen, 0, false};
+    record.type = (TraceRecordType)buf[0];
+    record.deltaMs = 0;
+
+    if (record.type == TRACE_RECORD_UPDATE)
+    {
+        TelegramUpdate &u = record.update;
+
+        record.deltaMs = in.getVarint();
+        record.batchIndex = in.getByte();
+        record.batchSize = in.getByte();
+        u.updateId = in.getVarint();
+        u.chatId = zigzagDecode(in.getVarint());
+        uint8_t flags = in.getByte();
+        u.isCallback = flags & 1;
+        u.oversized = flags & 2;
+        u.replayed = false;
+        u.messageId = in.getVarint();
+        in.getString(u.text, sizeof(u.text));
+        in.getString(u.callbackId, sizeof(u.callbackId));
+        in.getString(u.fileId, sizeof(u.fileId));
+    }
+    else if (record.type == TRACE_RECORD_CAPTURE)
+    {
+        TraceCapture &c = record.capture;
+
+        record.deltaMs = in.getVarint();
+        c.protocol = zigzagDecode(in.getVarint());
+        c.value = in.getVarint();
+        c.address = in.getVarint();
+        c.command = in.getVarint();
+        c.bits = in.getVarint();
+        c.rawlen = in.getVarint();
+        c.repeat = in.getByte() & 1;
+    }
+    else
+    {
+        record.type = (TraceRecordType)0;
+    }
+
+    if (in.error)
+        return -1;
+
+    return headLen + dataLen;
+}
+
+TraceReplayKind traceReplayKind(const TelegramUpdate &update, int &id, char *name, size_t size)
+{
+    static const char *const commands[] = {"/help", "/status", "/memory", "/channels", "/irstats",
+                                           "/schedule", "/device", "/power"};
+    const char *text = update.text;
+
+    id = 0;
+
+    if (update.fileId[0] != '\0' || update.oversized)
+        return TRACE_REPLAY_SKIP;
+
+    if (update.isCallback)
+    {
+        id = strncmp(text, "c:", 2) == 0 ? atoi(text + 2) : 0;
+        return id > 0 ? TRACE_REPLAY_CODE_ID : TRACE_REPLAY_SKIP;
+    }
+
+    if (text[0] == '/')
+    {
+        for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+            if (strcasecmp(text, commands[i]) == 0)
+                return TRACE_REPLAY_COMMAND;
+
+        return TRACE_REPLAY_SKIP;
+    }
+
+    // Код по ID или имени с необязательным "@канал"; остальной текст (например, имя кода
+    // для пакетного обучения) мог бы изменить состояние и не воспроизводится
+    size_t len = strcspn(text, "@");
+    const char *at = text + len;
+
+    if (*at == '@' && (at[1] < '1' || at[1] > '9' || strspn(at + 1, "0123456789") != strlen(at + 1)))
+        return TRACE_REPLAY_SKIP;
+
+    if (len > 0 && strspn(text, "0123456789") == len)
+    {
+        id = atoi(text);
+        return id > 0 ? TRACE_REPLAY_CODE_ID : TRACE_REPLAY_SKIP;
+    }
+
+    // Правило имен индекса: латинская буква, затем буквы, цифры, '.', '_', '-'
+    if (len == 0 || len >= size || !isalpha((uint8_t)text[0]))
+        return TRACE_REPLAY_SKIP;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = text[i];
+
+        if (!isalnum((uint8_t)c) && c != '.' && c != '_' && c != '-')
+            return TRACE_REPLAY_SKIP;
+
+        name[i] = tolower((uint8_t)c);
+    }
+
+    name[len] = '\0';
+    return TRACE_REPLAY_CODE_NAME;
+}
@@ -0,0 +1,69 @@
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telegram_update_parser.h"
+
+#define TRACE_MAGIC "IRTR"       // Начало файла трассы
+#define TRACE_VERSION 1          // Версия формата
+#define TRACE_HEADER_LEN 12      // Магия, версия, 3 резервных байта, время начала (unix, LE)
+#define TRACE_RECORD_MAX_LEN 512 // Запись целиком: обновление с самым длинным текстом и file_id
+
+enum TraceRecordType : uint8_t
+{
+    TRACE_RECORD_UPDATE = 1,  // Обновление Telegram из пакета getUpdates
+    TRACE_RECORD_CAPTURE = 2, // Разобранный кадр ИК-приемника
+};
+
+// Кадр приемника без зависимостей от IRremoteESP8266
+struct TraceCapture
+{
+    int protocol; // decode_type_t
+    uint64_t value;
+    uint32_t address;
+    uint32_t command;
+    uint16_t bits;
+    uint16_t rawlen;
+    bool repeat;
+};
+
+struct TraceRecord
+{
+    TraceRecordType type;
+    uint32_t deltaMs;   // От предыдущей записи
+    uint8_t batchIndex; // Обновления: номер в пакете getUpdates и размер пакета
+    uint8_t batchSize;
+    TelegramUpdate update;
+    TraceCapture capture;
+};
+
+// Двоичная трасса: заголовок, затем записи "тип, длина (varint), данные".
+// Числа - varint, строки - длина и байты. Записи неизвестного типа пропускаются по длине.
+// Без зависимостей от Arduino: трассу можно разбирать и на компьютере
+size_t traceEncodeHeader(uint8_t *buf, size_t size, uint32_t startTime);
+bool traceDecodeHeader(const uint8_t *buf, size_t len, uint32_t &startTime);
+
+// Возвращают длину записи или 0, если она не помещается в buf
+size_t traceEncodeUpdate(uint8_t *buf, size_t size, uint32_t deltaMs, uint8_t batchIndex, uint8_t batchSize,
+                         const TelegramUpdate &update);
+size_t traceEncodeCapture(uint8_t *buf, size_t size, uint32_t deltaMs, const TraceCapture &capture);
+
+// Разбор записи: длина; 0 - данных недостаточно; -1 - ошибка формата. Запись неизвестного типа
+// возвращает свою длину с record.type == 0
+int traceDecodeRecord(const uint8_t *buf, size_t len, TraceRecord &record);
+
+// Что из обновления трассы воспроизводится: только коды и команды, не меняющие состояние устройства,
+// чтобы трассу можно было повторять сколько угодно раз без последствий
+enum TraceReplayKind : uint8_t
+{
+    TRACE_REPLAY_SKIP,      // Документы, команды, меняющие состояние, и прочий текст
+    TRACE_REPLAY_CODE_ID,   // Код по ID ("5", "5@2") или кнопка пульта ("c:5"); id - ID кода
+    TRACE_REPLAY_CODE_NAME, // Текст в форме имени кода ("tv.power@2"); воспроизводится, если имя известно
+    TRACE_REPLAY_COMMAND,   // Команда только для чтения (/status и т.п.)
+};
+
+// name - имя кода без "@канал" для TRACE_REPLAY_CODE_NAME
+TraceReplayKind traceReplayKind(const TelegramUpdate &update, int &id, char *name, size_t size);
+
+#endif // TRACE_FORMAT_H
@@ -0,0 +1,534 @@
+#include "trace_recorder.h"
+#include "power_manager.h"
+#include "name_index.h"
+#include <SD.h>
+#include <time.h>
+#include "freertos/queue.h"
+
+extern void sendAnswer(String text);
+
+// Обновление в очереди воспроизведения
+struct TraceReplayItem
+{
+    TelegramUpdate update;
+    uint8_t batchIndex;
+    uint32_t injectedUs; // micros() подачи в очередь
+};
+
+// Буферы и счетчики меняются задачами Telegram, ИК-приемника и трассы
+SemaphoreHandle_t traceMutex = NULL;
+TaskHandle_t traceTaskHandle = NULL;
+QueueHandle_t traceUpdateQueue = NULL;
+QueueHandle_t traceCaptureQueue = NULL;
+
+volatile bool traceRecordingFlag = false;
+volatile bool traceReplayingFlag = false;
+volatile bool traceStopRequested = false;
+
+char tracePath[TRACE_PATH_LEN];
+uint16_t traceSpeed = TRACE_REPLAY_SPEED;
+File traceFile;
+
+// Запись: в один буфер пишут задачи, второй задача трассы сбрасывает на SD
+uint8_t *traceBuffers = NULL;
+uint8_t *traceActive = NULL;
+size_t traceActiveLen = 0;
+uint32_t traceLastMs = 0; // Время последней записи: от него считается delta следующей
+
+TraceStats traceCounters;
+
+// Текущий воспроизводимый пакет (только задача Telegram)
+TraceReplayItem traceBatchItem;
+uint32_t traceBatchInjected[TG_MAX_UPDATES];
+uint8_t traceBatchLen = 0;
+volatile uint8_t traceBatchPending = 0; // Пакет выдан, но еще не обработан
+
+// Запись под traceMutex: не поместившаяся в буфер запись отбрасывается и считается
+void traceAppend(size_t len)
+{
+    if (len == 0)
+    {
+        traceCounters.dropped++;
+        return;
+    }
+
+    traceActiveLen += len;
+    traceCounters.records++;
+    traceCounters.bytes += len;
+    traceLastMs = millis();
+}
+
+uint32_t traceDelta()
+{
+    return millis() - traceLastMs;
+}
+
+void traceRecordUpdates(const TelegramUpdate *updates, uint8_t count)
+{
+    if (!traceRecordingFlag || xSemaphoreTake(traceMutex, portMAX_DELAY) != pdTRUE)
+        return;
+
+    // Повторная проверка: запись могла остановиться, пока задача ждала мьютекс
+    for (uint8_t i = 0; traceRecordingFlag && i < count; i++)
+    {
+        // delta есть только у первого обновления пакета, остальные пришли тем же ответом
+        traceAppend(traceEncodeUpdate(traceActive + traceActiveLen, TRACE_BUFFER_LEN - traceActiveLen, traceDelta(),
+                                      i, count, updates[i]));
+    }
+
+    xSemaphoreGive(traceMutex);
+}
+
+void traceRecordCapture(const IrCapture &capture)
+{
+    if (!traceRecordingFlag || xSemaphoreTake(traceMutex, portMAX_DELAY) != pdTRUE)
+        return;
+
+    if (traceRecordingFlag)
+    {
+        TraceCapture c = {capture.protocol, capture.value, capture.address, capture.command,
+                          capture.bits, capture.rawlen, capture.repeat};
+        traceAppend(traceEncodeCapture(traceActive + traceActiveLen, TRACE_BUFFER_LEN - traceActiveLen, traceDelta(), c));
+    }
+
+    xSemaphoreGive(traceMutex);
+}
+
+// Сброс накопленного буфера на SD: буферы меняются местами под мьютексом, запись - вне его
+void traceFlush()
+{
+    uint8_t *full = NULL;
+    size_t len = 0;
+
+    if (xSemaphoreTake(traceMutex, portMAX_DELAY) == pdTRUE)
+    {
+        full = traceActive;
+        len = traceActiveLen;
+        traceActive = (traceActive == traceBuffers) ? traceBuffers + TRACE_BUFFER_LEN : traceBuffers;
+        traceActiveLen = 0;
+        xSemaphoreGive(traceMutex);
+    }
+
+    if (len > 0)
+    {
+        traceFile.write(full, len);
+        traceFile.flush();
+    }
+}
+
+void traceRecordTask(void *pvParameters)
+{
+    uint32_t start = millis();
+
+    while (!traceStopRequested)
+    {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TRACE_FLUSH_MS));
+        traceFlush();
+    }
+
+    if (xSemaphoreTake(traceMutex, portMAX_DELAY) == pdTRUE)
+    {
+        traceRecordingFlag = false;
+        xSemaphoreGive(traceMutex);
+    }
+
+    traceFlush();
+    traceFile.close();
+
+    traceCounters.traceMs = millis() - start;
+    free(traceBuffers);
+    traceBuffers = traceActive = NULL;
+
+    traceTaskHandle = NULL;
+    vTaskDelete(NULL);
+}
+
+bool traceStart(const char *path)
+{
+    if (traceMutex == NULL)
+        traceMutex = xSemaphoreCreateMutex();
+
+    if (traceTaskHandle != NULL || strlen(path) >= TRACE_PATH_LEN)
+        return false;
+
+    traceBuffers = (uint8_t *)malloc(2 * TRACE_BUFFER_LEN);
+    if (traceBuffers == NULL)
+        return false;
+
+    strcpy(tracePath, path);
+    traceFile = SD.open(tracePath, FILE_WRITE);
+
+    uint8_t header[TRACE_HEADER_LEN];
+    traceEncodeHeader(header, sizeof(header), time(NULL));
+
+    if (!traceFile || traceFile.write(header, sizeof(header)) != sizeof(header))
+    {
+        if (traceFile)
+            traceFile.close();
+        free(traceBuffers);
+        traceBuffers = NULL;
+        return false;
+    }
+
+    memset(&traceCounters, 0, sizeof(traceCounters));
+    traceCounters.bytes = sizeof(header);
+    traceActive = traceBuffers;
+    traceActiveLen = 0;
+    traceLastMs = millis();
+    traceStopRequested = false;
+    traceRecordingFlag = true;
+
+    if (xTaskCreatePinnedToCore(traceRecordTask, "Trace", TRACE_TASK_STACK, NULL, TRACE_TASK_PRIORITY,
+                                &traceTaskHandle, 1) != pdPASS)
+    {
+        traceRecordingFlag = false;
+        traceFile.close();
+        free(traceBuffers);
+        traceBuffers = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+bool traceRecording()
+{
+    return traceRecordingFlag;
+}
+
+bool traceStop(TraceStats &stats)
+{
+    if (traceTaskHandle == NULL)
+        return false;
+
+    traceStopRequested = true;
+    xTaskNotifyGive(traceTaskHandle);
+
+    // Задача дописывает буфер и закрывает файл
+    for (int i = 0; traceTaskHandle != NULL && i < 300; i++)
+        vTaskDelay(pdMS_TO_TICKS(10));
+
+    stats = traceCounters;
+    return traceTaskHandle == NULL;
+}
+
+// Воспроизводятся только коды и команды, не меняющие состояние устройства (см. traceReplayKind).
+// Текст в форме имени - только известное имя кода: иначе при активном /learn batch он стал бы
+// именем нового кода
+bool traceReplayAllowed(const TelegramUpdate &update)
+{
+    char name[NAME_MAX_LEN + 1];
+    int id;
+
+    switch (traceReplayKind(update, id, name, sizeof(name)))
+    {
+    case TRACE_REPLAY_CODE_ID:
+    case TRACE_REPLAY_COMMAND:
+        return true;
+    case TRACE_REPLAY_CODE_NAME:
+        return nameIndexFind(name) > 0;
+    default:
+        return false;
+    }
+}
+
+// Ожидание момента записи в ускоренном времени трассы
+void traceReplayWait(uint32_t startUs)
+{
+    if (traceSpeed == 0)
+        return;
+
+    uint64_t dueUs = (uint64_t)traceCounters.traceMs * 1000 / traceSpeed;
+
+    for (;;)
+    {
+        uint32_t elapsed = micros() - startUs;
+        if (elapsed >= dueUs || traceStopRequested)
+            return;
+
+        uint32_t waitMs = (dueUs - elapsed) / 1000;
+        vTaskDelay(waitMs > 0 ? pdMS_TO_TICKS(waitMs) : 1);
+    }
+}
+
+// Подача в очередь с ожиданием места: воспроизведение не обгоняет обработку команд
+void traceReplaySend(QueueHandle_t queue, const void *item)
+{
+    while (!traceStopRequested && xQueueSend(queue, item, pdMS_TO_TICKS(100)) != pdPASS)
+    {
+    }
+
+    powerNotify(POWER_EVENT_COMMAND);
+}
+
+void traceReplayReport(bool error)
+{
+    TraceStats s;
+    traceStats(s);
+
+    char text[384];
+    uint32_t handled = s.updates > 0 ? s.updates : 1;
+    float speedup = s.replayMs > 0 ? (float)s.traceMs / s.replayMs : 0;
+    float rate = s.replayMs > 0 ? s.updates * 1000.0f / s.replayMs : 0;
+
+    snprintf(text, sizeof(text),
+             "Trace replay %s: %s\nRecords: %lu (%lu updates, %lu IR frames, %lu skipped)\n"
+             "Trace time: %lu ms, replay time: %lu ms (x%.1f)\nUpdates/s: %.1f\n"
+             "Latency: avg %lu us, max %lu us\nMuted: %lu replies, %lu IR codes",
+             error ? "stopped at a corrupt record" : (traceStopRequested ? "stopped" : "done"), tracePath,
+             (unsigned long)s.records, (unsigned long)s.updates, (unsigned long)s.captures, (unsigned long)s.skipped,
+             (unsigned long)s.traceMs, (unsigned long)s.replayMs, speedup, rate,
+             (unsigned long)(s.latencySumUs / handled), (unsigned long)s.latencyMaxUs, (unsigned long)s.replies,
+             (unsigned long)s.codes);
+
+    sendAnswer(String(text));
+}
+
+void traceReplayTask(void *pvParameters)
+{
+    uint8_t *buf = traceBuffers;
+    size_t len = 0;
+    bool eof = false;
+    bool error = false;
+    uint32_t startUs = micros();
+    TraceRecord *record = (TraceRecord *)malloc(sizeof(TraceRecord));
+    TraceReplayItem *item = (TraceReplayItem *)malloc(sizeof(TraceReplayItem));
+
+    error = record == NULL || item == NULL;
+
+    while (!error && !traceStopRequested)
+    {
+        int n = traceDecodeRecord(buf, len, *record);
+
+        if (n < 0)
+        {
+            error = true;
+            break;
+        }
+
+        if (n == 0)
+        {
+            // Запись разорвана границей буфера: дочитываем файл
+            if (eof)
+                break;
+
+            int got = traceFile.read(buf + len, TRACE_READ_LEN - len);
+            if (got <= 0)
+                eof = true;
+            else
+                len += got;
+            continue;
+        }
+
+        memmove(buf, buf + n, len - n);
+        len -= n;
+
+        if (record->type == 0)
+            continue; // Запись более новой версии формата
+
+        traceCounters.records++;
+        traceCounters.traceMs += record->deltaMs;
+        traceReplayWait(startUs);
+
+        if (record->type == TRACE_RECORD_UPDATE)
+        {
+            if (!traceReplayAllowed(record->update))
+            {
+                traceCounters.skipped++;
+                continue;
+            }
+
+            item->update = record->update;
+            item->batchIndex = record->batchIndex;
+            item->injectedUs = micros();
+            traceReplaySend(traceUpdateQueue, item);
+        }
+        else
+        {
+            const TraceCapture &c = record->capture;
+            IrCapture capture = {0, (decode_type_t)c.protocol, c.value, c.address, c.command, c.bits, c.rawlen, c.repeat};
+            traceReplaySend(traceCaptureQueue, &capture);
+        }
+    }
+
+    // Последние записи еще обрабатываются: ждем опустошения очередей и ответов на них
+    while (!traceStopRequested &&
+           (uxQueueMessagesWaiting(traceUpdateQueue) > 0 || uxQueueMessagesWaiting(traceCaptureQueue) > 0 ||
+            traceBatchPending > 0))
+        vTaskDelay(pdMS_TO_TICKS(10));
+
+    traceCounters.replayMs = (micros() - startUs) / 1000;
+
+    if (!traceStopRequested)
+        vTaskDelay(pdMS_TO_TICKS(TRACE_REPLAY_SETTLE_MS));
+
+    xQueueReset(traceUpdateQueue);
+    xQueueReset(traceCaptureQueue);
+    traceReplayingFlag = false;
+
+    traceFile.close();
+    free(record);
+    free(item);
+    free(traceBuffers);
+    traceBuffers = NULL;
+
+    traceReplayReport(error);
+
+    traceTaskHandle = NULL;
+    vTaskDelete(NULL);
+}
+
+bool traceReplayStart(const char *path, uint16_t speed)
+{
+    if (traceMutex == NULL)
+        traceMutex = xSemaphoreCreateMutex();
+    if (traceUpdateQueue == NULL)
+        traceUpdateQueue = xQueueCreate(TRACE_REPLAY_QUEUE_LEN, sizeof(TraceReplayItem));
+    if (traceCaptureQueue == NULL)
+        traceCaptureQueue = xQueueCreate(TRACE_REPLAY_QUEUE_LEN, sizeof(IrCapture));
+
+    if (traceTaskHandle != NULL || traceUpdateQueue == NULL || traceCaptureQueue == NULL ||
+        strlen(path) >= TRACE_PATH_LEN)
+        return false;
+
+    strcpy(tracePath, path);
+    traceFile = SD.open(tracePath, FILE_READ);
+
+    uint8_t header[TRACE_HEADER_LEN];
+    uint32_t startTime;
+
+    if (!traceFile || traceFile.read(header, sizeof(header)) != sizeof(header) ||
+        !traceDecodeHeader(header, sizeof(header), startTime))
+    {
+        if (traceFile)
+            traceFile.close();
+        return false;
+    }
+
+    traceBuffers = (uint8_t *)malloc(TRACE_READ_LEN);
+    if (traceBuffers == NULL)
+    {
+        traceFile.close();
+        return false;
+    }
+
+    memset(&traceCounters, 0, sizeof(traceCounters));
+    traceSpeed = speed;
+    traceBatchLen = 0;
+    traceBatchPending = 0;
+    traceStopRequested = false;
+    traceReplayingFlag = true;
+
+    if (xTaskCreatePinnedToCore(traceReplayTask, "Trace", TRACE_TASK_STACK, NULL, TRACE_TASK_PRIORITY,
+                                &traceTaskHandle, 1) != pdPASS)
+    {
+        traceReplayingFlag = false;
+        traceFile.close();
+        free(traceBuffers);
+        traceBuffers = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+bool traceReplaying()
+{
+    return traceReplayingFlag;
+}
+
+uint8_t traceReplayBatch(TelegramUpdate *updates, uint8_t max)
+{
+    if (!traceReplayingFlag)
+        return 0;
+
+    // Пакет собирается из подряд идущих обновлений одного ответа getUpdates
+    uint8_t count = 0;
+
+    traceBatchPending = 1; // До приема: задача трассы не должна увидеть пустую очередь без пакета
+    while (count < max && xQueueReceive(traceUpdateQueue, &traceBatchItem, 0) == pdTRUE)
+    {
+        updates[count] = traceBatchItem.update;
+        updates[count].replayed = true; // Живой опрос идет параллельно: подавляется только трасса
+        traceBatchInjected[count] = traceBatchItem.injectedUs;
+        count++;
+
+        if (xQueuePeek(traceUpdateQueue, &traceBatchItem, 0) != pdTRUE || traceBatchItem.batchIndex == 0)
+            break;
+    }
+
+    traceBatchLen = count;
+    traceBatchPending = count > 0;
+    return count;
+}
+
+void traceReplayBatchDone()
+{
+    uint32_t now = micros();
+
+    if (xSemaphoreTake(traceMutex, portMAX_DELAY) == pdTRUE)
+    {
+        for (uint8_t i = 0; i < traceBatchLen; i++)
+        {
+            uint32_t latency = now - traceBatchInjected[i];
+
+            traceCounters.latencySumUs += latency;
+            if (latency > traceCounters.latencyMaxUs)
+                traceCounters.latencyMaxUs = latency;
+        }
+        traceCounters.updates += traceBatchLen;
+        xSemaphoreGive(traceMutex);
+    }
+
+    traceBatchLen = 0;
+    traceBatchPending = 0;
+}
+
+bool traceReplayCapture(IrCapture &capture)
+{
+    if (!traceReplayingFlag || xQueueReceive(traceCaptureQueue, &capture, 0) != pdTRUE)
+        return false;
+
+    capture.time = millis();
+
+    if (xSemaphoreTake(traceMutex, portMAX_DELAY) == pdTRUE)
+    {
+        traceCounters.captures++;
+        xSemaphoreGive(traceMutex);
+    }
+
+    return true;
+}
+
+void traceReplayReply()
+{
+    if (xSemaphoreTake(traceMutex, portMAX_DELAY) == pdTRUE)
+    {
+        traceCounters.replies++;
+        xSemaphoreGive(traceMutex);
+    }
+}
+
+void traceReplayCode()
+{
+    if (xSemaphoreTake(traceMutex, portMAX_DELAY) == pdTRUE)
+    {
+        traceCounters.codes++;
+        xSemaphoreGive(traceMutex);
+    }
+}
+
+void traceStats(TraceStats &stats)
+{
+    if (traceMutex == NULL)
+    {
+        memset(&stats, 0, sizeof(stats));
+        return;
+    }
+
+    if (xSemaphoreTake(traceMutex, portMAX_DELAY) == pdTRUE)
+    {
+        stats = traceCounters;
+        xSemaphoreGive(traceMutex);
+    }
+}
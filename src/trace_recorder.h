@@ -0,0 +1,54 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <Arduino.h>
+#include "trace_format.h"
+#include "ir_monitor.h"
+
+#define TRACE_FILE "/trace.bin"      // Файл трассы по умолчанию
+#define TRACE_PATH_LEN 64
+#define TRACE_BUFFER_LEN 4096        // Каждый из двух буферов записи
+#define TRACE_FLUSH_MS 1000          // Период записи буфера на SD
+#define TRACE_READ_LEN 1024          // Буфер чтения при воспроизведении (не меньше двух записей)
+#define TRACE_TASK_STACK 6144        // Стек задачи трассы
+#define TRACE_TASK_PRIORITY 1
+#define TRACE_REPLAY_SPEED 10        // Ускорение воспроизведения по умолчанию
+#define TRACE_REPLAY_QUEUE_LEN 8     // Очереди воспроизводимых обновлений и кадров
+#define TRACE_REPLAY_SETTLE_MS 500   // Ожидание обработки последних записей перед отчетом
+
+struct TraceStats
+{
+    uint32_t records;  // Записано (при записи) или воспроизведено (при воспроизведении)
+    uint32_t bytes;
+    uint32_t dropped;  // Записи, не поместившиеся в буфер
+    uint32_t updates;  // Воспроизведено обновлений Telegram
+    uint32_t captures; // Воспроизведено ИК-кадров
+    uint32_t skipped;  // Не воспроизводятся все команды, кроме кодов и отчетов (см. traceReplayAllowed)
+    uint32_t replies;  // Подавленные ответы в Telegram
+    uint32_t codes;    // Подавленные отправки ИК-кодов
+    uint32_t traceMs;  // Длительность трассы
+    uint32_t replayMs; // Длительность воспроизведения
+    uint64_t latencySumUs; // Задержка от подачи обновления до окончания его обработки
+    uint32_t latencyMaxUs;
+};
+
+// Запись входящих пакетов обновлений Telegram и кадров ИК-приемника в двоичную трассу на SD
+// и ее ускоренное воспроизведение через обычный путь обработки команд.
+// Во время воспроизведения ответы в Telegram и передача ИК подавляются и только считаются
+bool traceStart(const char *path);
+bool traceStop(TraceStats &stats);
+bool traceRecording();
+void traceRecordUpdates(const TelegramUpdate *updates, uint8_t count); // Задача Telegram
+void traceRecordCapture(const IrCapture &capture);                    // Задача ИК-приемника
+
+bool traceReplayStart(const char *path, uint16_t speed); // speed 0 - без пауз между записями
+bool traceReplaying();
+uint8_t traceReplayBatch(TelegramUpdate *updates, uint8_t max); // Задача Telegram: следующий пакет
+void traceReplayBatchDone();                                    // Задача Telegram: пакет обработан
+bool traceReplayCapture(IrCapture &capture);                    // Задача ИК-приемника
+void traceReplayReply();                                        // Ответ подавлен
+void traceReplayCode();                                         // Отправка кода подавлена
+
+void traceStats(TraceStats &stats);
+
+#endif // TRACE_RECORDER_H
@@ -0,0 +1,57 @@
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define VARINT_MAX_LEN 10 // Байт на uint64_t
+
+// Целые переменной длины (LEB128): 7 бит на байт, старший бит - продолжение.
+// Без зависимостей от Arduino, используется форматами на SD-карте
+
+// Запись value в buf; возвращает число байт или 0, если не хватает места
+inline size_t varintPut(uint8_t *buf, size_t size, uint64_t value)
+{
+    size_t len = 0;
+
+    do
+    {
+        if (len >= size)
+            return 0;
+
+        uint8_t b = value & 0x7F;
+        value >>= 7;
+        buf[len++] = value ? (b | 0x80) : b;
+    } while (value);
+
+    return len;
+}
+
+// Чтение из buf; возвращает число байт или 0, если данные неполные или значение длиннее 64 бит
+inline size_t varintGet(const uint8_t *buf, size_t len, uint64_t &value)
+{
+    value = 0;
+
+    for (size_t i = 0; i < len && i < VARINT_MAX_LEN; i++)
+    {
+        value |= (uint64_t)(buf[i] & 0x7F) << (7 * i);
+
+        if ((buf[i] & 0x80) == 0)
+            return i + 1;
+    }
+
+    return 0;
+}
+
+// Знаковые значения: малые по модулю отрицательные числа тоже занимают мало байт
+inline uint64_t zigzagEncode(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+inline int64_t zigzagDecode(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+#endif // VARINT_H
@@ -1,9 +1,21 @@
 #include "wifi_telegram_core.h"
 #include "config.h"
+#include "telegram_api.h"
+#include "ir_command.h"
+#include "code_store.h"
+#include "ir_import.h"
+#include "name_index.h"
+#include "learn_session.h"
+#include "ir_transmit.h"
+#include "ir_monitor.h"
+#include "ir_schedule.h"
+#include "power_manager.h"
+#include "trace_recorder.h"
 #include <WiFi.h>
-#include <WiFiClientSecure.h>
-#include <UniversalTelegramBot.h>
+#include <IRremoteESP8266.h>
+#include <IRutils.h>
 #include <SD.h>
+#include <Preferences.h>
 #include "freertos/queue.h"
 
 // Макрос для отладки
@@ -11,24 +23,85 @@
 
 uint16_t GetNewMessagesDelay = 200; // Задержка при получении новых сообщений в Telegram
 
+// --- Inline-клавиатура пульта ---
+#define REMOTE_COLUMNS 3   // Кнопок в ряду
+#define REMOTE_ROWS 6      // Рядов с кодами на странице
+#define REMOTE_PAGE_SIZE (REMOTE_COLUMNS * REMOTE_ROWS)
+#define REMOTE_BUTTON_LEN (2 * NAME_MAX_LEN + 48) // Кнопка: имя с запасом на экранирование, JSON, ID и начало ряда
+#define REMOTE_NAV_LEN 128                        // Ряд навигации и скобки массива
+#define REMOTE_KEYBOARD_LEN (REMOTE_PAGE_SIZE * REMOTE_BUTTON_LEN + REMOTE_NAV_LEN) // Буфер JSON-разметки клавиатуры
+
+// --- Постраничный /list ---
+#define LIST_PAGE_LEN 3072   // Буфер страницы (лимит сообщения Telegram - 4096 символов)
+#define LIST_READ_RECORDS 16 // Записей, читаемых из хранилища за раз
+
+// --- Расписание ---
+#define SCHEDULE_LIST_LEN (SCHEDULE_MAX_ENTRIES * 80 + 96) // Буфер списка /schedule
+
+// --- Повтор отправки ответа ---
+#define SEND_RETRY_DELAY_MS 250      // Пауза перед повтором после ошибки сети
+#define SEND_RETRY_AFTER_MAX_MS 5000 // Предел паузы retry_after из ответа 429
+
+// --- Хранение ID последнего обработанного сообщения ---
+#define LAST_ID_NVS_NAMESPACE "tg_last_id" // Пространство имен NVS
+#define LAST_ID_NVS_KEY "id"
+#define LAST_ID_NVS_EVERY 20               // Запись в NVS не чаще, чем через столько обновлений,
+#define LAST_ID_NVS_PERIOD_MS 60000UL      // или через этот период при наличии новых
+#define LAST_ID_RTC_MAGIC 0x1D5AFE26UL     // Признак валидной копии в RTC-памяти
+
+// Копия ID в RTC-памяти переживает программный сброс, WDT и panic
+RTC_NOINIT_ATTR uint32_t rtcLastIdMagic;
+RTC_NOINIT_ATTR long rtcLastId;
+RTC_NOINIT_ATTR long rtcLastIdCheck; // Инверсная копия для проверки целостности
+
+// Копия в NVS для холодного старта. Запись в NVS - стирание и запись флеша, поэтому она идет
+// не после каждого пакета, а в паузах опроса (см. flushLastMessageId) и перед /restart
+Preferences lastIdPrefs;
+long lastIdNvsSaved = 0;          // Последний ID, записанный в NVS
+unsigned long lastIdNvsSavedAt = 0;
+
 // External variables and functions from main.cpp
 extern void displayInfo(int posY, String nfo, unsigned long displayTime = 0, bool clearScreen = true);
 extern void displayMainMenu();
 extern volatile bool networkInitialized;
 extern QueueHandle_t telegramQueue;
-extern QueueHandle_t commandQueue;
 extern volatile bool btnPressed;    // Флаг для режима обучения
 extern volatile bool clearAllCodes; // Флаг для очистки кодов
+extern volatile bool importRequested; // Флаг импорта библиотеки кодов
+extern char importPath[];
+extern volatile bool learnSessionRequested; // Флаги пакетного обучения
+extern volatile bool learnSessionStop;
+extern volatile bool learnNameReady;
+extern char learnName[];
+extern volatile bool sniffMode; // Режим прослушивания ИК
+extern SemaphoreHandle_t xMutex;
+extern String getProtocolName(decode_type_t protocol);
 
-// WiFi and Telegram objects
-WiFiClientSecure secured_client;
-UniversalTelegramBot bot(BOT_TOKEN, secured_client);
+// Входящие обновления: фиксированный буфер
+TelegramUpdate tgUpdates[TG_MAX_UPDATES];
+long lastUpdateId = 0;                         // update_id последнего принятого обновления
+const long long telegramChatId = atoll(CHAT_ID); // Команды принимаются только из этого чата
+bool replayDispatch = false;                   // Обрабатывается обновление трассы: internalSendAnswer только считает ответ
 
 // Forward declarations
 bool connectToWiFi();
 void GetNewMessages(int numNewMessages);
-void parseCommand(String text);
+void parseCommand(const char *text);
+void handleCallbackQuery(TelegramUpdate &update);
+void handleDocument(TelegramUpdate &update);
+void sendRemoteKeyboard(int page, long messageId);
+void sendCodesListPage(int start, long messageId);
+void sendDevicesList();
+void sendChannelsReport();
+void sendIrStatsReport();
+void sendScheduleList();
+void sendPowerReport();
+void traceCommand(const char *args);
+void scheduleAddCommand(const char *args);
+void exportCodesFile();
+bool appendf(char *buf, size_t size, size_t &pos, const char *fmt, ...);
 void saveLastMessageId(long id);
+void flushLastMessageId(bool force);
 long loadLastMessageId();
 void internalSendAnswer(String text); // Renamed to avoid conflicts
 
@@ -38,7 +111,7 @@ void wifiTelegramTask(void *pvParameters)
     displayInfo(1, F("Connecting to WiFi..."));
     displayInfo(2, WIFI_SSID, 1000, false);
 
-    secured_client.setCACert(TELEGRAM_CERTIFICATE_ROOT); // Add root certificate for api.telegram.org
+    telegramBegin(); // Сервер Bot API и его корневой сертификат из config.h
 
     if (!connectToWiFi())
     {
@@ -51,15 +124,14 @@ void wifiTelegramTask(void *pvParameters)
     displayInfo(1, F("WiFi connected! "));
     displayInfo(2, "IP:" + WiFi.localIP().toString(), 2000, false);
 
+    // Часы для расписания: SNTP синхронизирует их в фоне и периодически подводит
+    configTzTime(TIME_ZONE, NTP_SERVER_1, NTP_SERVER_2);
+
     // Загружаем ID последнего сообщения и устанавливаем его для бота
-    long last_id = loadLastMessageId();
-    if (last_id > 0)
-    {
-        bot.last_message_received = last_id;
-    }
+    lastUpdateId = loadLastMessageId();
 
     internalSendAnswer(F("IR Remote Control System\nVersion 1.0"));
-    parseCommand(F("/help"));
+    parseCommand("/help");
 
     // Signal to the main core that the network is ready
     networkInitialized = true;
@@ -86,21 +158,38 @@ void wifiTelegramTask(void *pvParameters)
             // Check for incoming commands from Telegram
             static uint32_t tmTeleg = millis() + GetNewMessagesDelay;
 
-            if (millis() - tmTeleg > GetNewMessagesDelay)
+            // Воспроизведение трассы: пакеты из файла идут тем же путем, что и ответы getUpdates
+            int numReplayed = traceReplayBatch(tgUpdates, TG_MAX_UPDATES);
+            if (numReplayed > 0)
+            {
+                GetNewMessages(numReplayed);
+                traceReplayBatchDone();
+            }
+
+            // В экономном режиме вместо частого опроса - long polling: запрос висит на сервере до прихода сообщения.
+            // Во время воспроизведения long polling задержал бы пакеты трассы
+            bool longPoll = powerLowMode() && !traceReplaying();
+            if (longPoll || millis() - tmTeleg > GetNewMessagesDelay)
             {
                 tmTeleg = millis();
-                int numNewMessages = bot.getUpdates(bot.last_message_received + 1);
+                int numNewMessages = telegramGetUpdates(lastUpdateId + 1, tgUpdates, TG_MAX_UPDATES, lastUpdateId,
+                                                        longPoll ? POWER_LONG_POLL_S : 0);
 
                 while (numNewMessages)
                 {
+                    // ID фиксируется в RTC-памяти до обработки пакета: после теплого сброса посреди пакета
+                    // его команды не повторяются, но и необработанные теряются - доставка не более одного раза
+                    saveLastMessageId(lastUpdateId);
                     GetNewMessages(numNewMessages);
-                    numNewMessages = bot.getUpdates(bot.last_message_received + 1);
+                    numNewMessages = telegramGetUpdates(lastUpdateId + 1, tgUpdates, TG_MAX_UPDATES, lastUpdateId);
                 }
+
+                flushLastMessageId(false); // Пауза опроса: пакеты обработаны
             }
 
             // Check for outgoing messages from the main core
             String *pText = NULL;
-            if (xQueueReceive(telegramQueue, &pText, 0) == pdTRUE)
+            while (xQueueReceive(telegramQueue, &pText, 0) == pdTRUE)
             {
                 if (pText != NULL)
                 {
@@ -110,7 +199,7 @@ void wifiTelegramTask(void *pvParameters)
             }
         }
 
-        vTaskDelay(pdMS_TO_TICKS(100)); // Задержка для экономии ресурсов
+        vTaskDelay(pdMS_TO_TICKS(traceReplaying() ? 1 : 100)); // Задержка для экономии ресурсов
     }
 }
 
@@ -152,57 +241,379 @@ bool connectToWiFi()
 
 void GetNewMessages(int numNewMessages)
 {
+    traceRecordUpdates(tgUpdates, numNewMessages);
+
     for (int i = 0; i < numNewMessages; i++)
     {
-        if (i >= 0 && i < numNewMessages)
+        TelegramUpdate &update = tgUpdates[i];
+        replayDispatch = update.replayed;
+
+        if (update.chatId != telegramChatId)
         {
-            telegramMessage &msg = bot.messages[i];
-            parseCommand(msg.text);
+            if (DEBUG_TELEGRAM)
+                Serial.println("Ignored message from chat " + String(update.chatId));
+            continue;
         }
+
+        if (update.oversized)
+        {
+            internalSendAnswer(F("Message is too long, ignored."));
+            continue;
+        }
+
+        if (update.isCallback)
+            handleCallbackQuery(update);
+        else if (update.fileId[0] != '\0')
+            handleDocument(update);
+        else
+            parseCommand(update.text);
+
+        // Основной цикл в экономном режиме спит до события: команда или флаг для него уже выставлены
+        powerNotify(POWER_EVENT_COMMAND);
     }
+
+    replayDispatch = false;
+}
+
+// Аргументы команды: указатель на текст после "/command " или NULL, если это другая команда
+const char *commandArgs(const char *text, const char *command)
+{
+    size_t len = strlen(command);
+
+    if (strncasecmp(text, command, len) != 0 || (text[len] != '\0' && text[len] != ' '))
+        return NULL;
+
+    text += len;
+    while (*text == ' ')
+        text++;
+
+    return text;
+}
+
+// Ответ на отказ очереди команд; NULL - код принят (в том числе повтором ожидающего задания)
+const char *commandRejectText(CommandPushResult result)
+{
+    switch (result)
+    {
+    case COMMAND_QUEUE_FULL:
+        return "Busy";
+    case COMMAND_SOURCE_FULL:
+        return "Too many commands from this source are waiting";
+    default:
+        return NULL;
+    }
+}
+
+// Отправка кода в очередь Ядра 0. Не ждет места в очереди: опрос Telegram не останавливается
+void queueCode(int id, int8_t channel)
+{
+    IrCommand cmd = {id, replayDispatch ? CMD_SOURCE_REPLAY : CMD_SOURCE_TEXT, channel};
+    const char *reject = commandRejectText(commandEnqueue(cmd));
+
+    if (reject != NULL)
+    {
+        internalSendAnswer(String(reject) + ": " + String(commandQueueDepth()) + " commands waiting, code ID " +
+                           String(id) + " not queued, try again later.");
+    }
+}
+
+// Строка /status об очереди команд
+String commandQueueStatus()
+{
+    CommandQueueStats s = {};
+    commandQueueStats(s);
+
+    char text[160];
+    snprintf(text, sizeof(text),
+             "\n- Command queue: %u/%u waiting (max %u), %lu queued, %lu merged as repeats, %lu rejected, wait avg %lu ms max %lu ms",
+             commandQueueDepth(), COMMAND_QUEUE_LEN, s.maxDepth, (unsigned long)s.queued, (unsigned long)s.coalesced,
+             (unsigned long)s.rejected, (unsigned long)(s.dispatched ? s.waitSumMs / s.dispatched : 0),
+             (unsigned long)s.waitMaxMs);
+    return String(text);
 }
 
-void parseCommand(String text)
+// Строки /status о файлах кодов: двоичный формат против текстового (по проиндексированным устройствам)
+String codeStoreStatus()
 {
+    CodeStoreStats s = {};
+    codeStoreStats(s);
+
+    char text[256];
+    size_t pos = 0;
+
+    appendf(text, sizeof(text), pos, "\n- Code files: %lu codes, %lu bytes (as text %lu), read in %lu us (%lu us/code)",
+            (unsigned long)s.codes, (unsigned long)s.fileBytes, (unsigned long)s.textBytes, (unsigned long)s.indexUs,
+            (unsigned long)(s.codes ? s.indexUs / s.codes : 0));
+
+    if (s.migrated > 0)
+        appendf(text, sizeof(text), pos, "\n- Migrated from text: %u files, %lu codes, %lu -> %lu bytes, text read in %lu us (%lu us/code)",
+                s.migrated, (unsigned long)s.migratedCodes, (unsigned long)s.migratedTextBytes,
+                (unsigned long)s.migratedBytes, (unsigned long)s.textParseUs,
+                (unsigned long)(s.migratedCodes ? s.textParseUs / s.migratedCodes : 0));
+
+    if (s.damaged > 0)
+        appendf(text, sizeof(text), pos, "\n- Damaged code files: %u (see serial log)", s.damaged);
+
+    return String(text);
+}
+
+void parseCommand(const char *text)
+{
+    const char *args;
+
+    // Явный выбор канала излучателя: "5@2", "tv.power@2"
+    const char *at = strchr(text, '@');
+    int8_t channel = -1;
+
+    if (text[0] != '/' && at != NULL)
+    {
+        int number = atoi(at + 1);
+        if (number < 1 || number > irTransmitChannels())
+        {
+            internalSendAnswer("Error: Channel must be 1-" + String(irTransmitChannels()));
+            return;
+        }
+        channel = number - 1;
+    }
+
     // Проверяем, является ли команда числом
-    int commandID = text.toInt();
+    int commandID = atoi(text);
     if (commandID > 0)
     {
-        // Отправляем ID в очередь
-        if (xQueueSend(commandQueue, &commandID, portMAX_DELAY) != pdPASS)
+        queueCode(commandID, channel);
+    }
+    else if (text[0] != '/' && learnSessionActive() && !replayDispatch)
+    {
+        // Идет пакетное обучение: текст - имя последнего пойманного кода. Воспроизведенный
+        // текст именем не становится - он только ищется как имя кода ниже
+        if (learnNameReady)
+            internalSendAnswer(F("Previous name is still being processed, try again."));
+        else if (strlen(text) > NAME_MAX_LEN)
+            internalSendAnswer(F("Error: Name is too long"));
+        else
         {
-            internalSendAnswer(F("Error: Command queue is full"));
+            strcpy(learnName, text);
+            learnNameReady = true;
         }
     }
+    else if (text[0] != '/')
+    {
+        // Имя кода: поиск в хеш-индексе без выделения памяти
+        char name[NAME_MAX_LEN + 1];
+        size_t len = at ? min((size_t)(at - text), sizeof(name) - 1) : sizeof(name) - 1;
+
+        strncpy(name, text, len);
+        name[len] = '\0';
+
+        int id = nameIndexFind(name);
+        if (id > 0)
+        {
+            queueCode(id, channel);
+            return;
+        }
+
+        char suggestions[NAME_SUGGESTIONS * (NAME_MAX_LEN + 2)];
+        if (nameIndexSuggest(name, suggestions, sizeof(suggestions)) > 0)
+            internalSendAnswer("Unknown code name. Did you mean: " + String(suggestions) + "?");
+        else
+            internalSendAnswer(F("Unknown code name. Send a number, a code name or /help for help."));
+    }
     else
     {
         // Обработка текстовых команд
-        if (text.equalsIgnoreCase(F("/help")))
+        if (strcasecmp(text, "/help") == 0)
         {
-            internalSendAnswer(F("Available commands:\n- Send a number to execute IR code\n- /help - Show this help\n- /learn - Start IR code learning mode\n- /allclear - Delete all saved codes\n- /status - Show system status\n- /restart - Restart device\n- /memory - Show free memory"));
+            internalSendAnswer(F("Available commands:\n- Send a number or a code name to execute IR code\n- /help - Show this help\n- /remote - Show remote keyboard\n- /list - List saved codes\n- /export - Send codes file\n- /import <path> - Import IR library from SD (or send the file as a document)\n- /device [name] - List devices or switch to (create) one\n- /channels - Emitter channels and their metrics\n- /route <channel> - Send codes of the active device on this channel (or add @<channel> to a code)\n- /name <id> <name> - Name a code, e.g. /name 5 tv.power\n- /unname <name> - Remove a code name\n- /learn - Start IR code learning mode\n- /learn batch - Learn a series of codes, naming each; /skip, /done\n- /schedule - List scheduled actions\n- /schedule add <daily|weekdays|weekends|mon,wed|today|tomorrow|YYYY-MM-DD> <HH:MM> <code>[@channel] - Schedule a code\n- /schedule del <n> - Delete a scheduled action\n- /power [low|normal] - Power mode and energy budget\n- /sniff - Toggle reporting of every received IR frame\n- /irstats - IR receiver statistics\n- /trace start [path] | stop | replay [path] [speed] - Record or replay Telegram updates and IR frames\n- /allclear - Delete all saved codes\n- /status - Show system status\n- /restart - Restart device\n- /memory - Show free memory"));
         }
-        else if (text.equalsIgnoreCase("/status"))
+        else if (strcasecmp(text, "/status") == 0)
         {
             internalSendAnswer("System status:\n- WiFi: " + String(WiFi.status() == WL_CONNECTED ? "Connected" : "Disconnected") +
-                               "\n- IP: " + WiFi.localIP().toString());
+                               "\n- IP: " + WiFi.localIP().toString() +
+                               "\n- Clock: " + String(scheduleTimeValid() ? "Synchronized" : "Not synchronized") +
+                               "\n- Scheduled actions: " + String(scheduleCount()) +
+                               "\n- Bot API: " TELEGRAM_API_HOST ", " + String(telegramRetries()) + " requests retried after dropped connections" +
+                               commandQueueStatus() + codeStoreStatus());
         }
-        else if (text.equalsIgnoreCase("/restart"))
+        else if (strcasecmp(text, "/restart") == 0)
         {
             internalSendAnswer(F("Restarting device..."));
-            saveLastMessageId(bot.last_message_received); // Сохраняем ID последнего сообщения
-            vTaskDelay(pdMS_TO_TICKS(1000));              // Добавляем задержку в 1 секунду, чтобы сообщение успело отправиться
+            saveLastMessageId(lastUpdateId); // Сохраняем ID последнего сообщения
+            flushLastMessageId(true);
+            vTaskDelay(pdMS_TO_TICKS(1000)); // Добавляем задержку в 1 секунду, чтобы сообщение успело отправиться
             ESP.restart();
         }
-        else if (text.equalsIgnoreCase(F("/memory")))
+        else if (strcasecmp(text, "/memory") == 0)
         {
             int freeHeap = ESP.getFreeHeap();
-            internalSendAnswer("Free memory: " + String(freeHeap) + " bytes");
+            internalSendAnswer("Free memory: " + String(freeHeap) + " bytes" +
+                               "\nFree PSRAM: " + String(ESP.getFreePsram()) + " bytes" +
+                               "\nPeak heap per poll: " + String(telegramPollHeapPeak()) + " bytes");
+        }
+        else if (strcasecmp(text, "/remote") == 0)
+        {
+            sendRemoteKeyboard(0, 0);
+        }
+        else if (strcasecmp(text, "/list") == 0)
+        {
+            sendCodesListPage(0, 0);
+        }
+        else if (strcasecmp(text, "/export") == 0)
+        {
+            exportCodesFile();
+        }
+        else if ((args = commandArgs(text, "/import")) != NULL)
+        {
+            if (importRequested)
+                internalSendAnswer(F("Import is already in progress."));
+            else if (args[0] != '/' || strlen(args) >= IMPORT_PATH_LEN)
+                internalSendAnswer(F("Usage: /import /path/on/sd.ir (LIRC .conf, Flipper .ir or Pronto hex)"));
+            else
+            {
+                strcpy(importPath, args);
+                importRequested = true;
+            }
+        }
+        else if ((args = commandArgs(text, "/device")) != NULL)
+        {
+            if (args[0] == '\0')
+                sendDevicesList();
+            else
+            {
+                int device = codeStoreSelectDevice(args);
+                char name[DEVICE_NAME_LEN];
+
+                if (device < 0)
+                    internalSendAnswer(F("Error: Device name must be up to 15 letters, digits, '_' or '-', and at most 16 devices"));
+                else if (codeStoreDeviceName(device, name, sizeof(name)))
+                    internalSendAnswer("Active device: " + String(name) + " (" + String(codeStoreDeviceCodes(device)) +
+                                       " codes). /learn, /import, /list, /remote and /export now use it.");
+            }
         }
-        else if (text.equalsIgnoreCase(F("/learn")))
+        else if (strcasecmp(text, "/channels") == 0)
         {
-            btnPressed = true;
+            sendChannelsReport();
         }
-        else if (text.equalsIgnoreCase(F("/allclear")))
+        else if ((args = commandArgs(text, "/schedule")) != NULL)
+        {
+            const char *subArgs;
+
+            if (*args == '\0')
+                sendScheduleList();
+            else if ((subArgs = commandArgs(args, "add")) != NULL)
+                scheduleAddCommand(subArgs);
+            else if ((subArgs = commandArgs(args, "del")) != NULL)
+            {
+                int id = atoi(subArgs);
+
+                if (id > 0 && id <= 255 && scheduleRemove(id))
+                    internalSendAnswer("Scheduled action #" + String(id) + " deleted");
+                else
+                    internalSendAnswer(F("Error: No such scheduled action. See /schedule"));
+            }
+            else
+                internalSendAnswer(F("Usage: /schedule, /schedule add <days> <HH:MM> <code>[@channel], /schedule del <n>"));
+        }
+        else if ((args = commandArgs(text, "/power")) != NULL)
+        {
+            if (strcasecmp(args, "low") == 0 || strcasecmp(args, "normal") == 0)
+            {
+                bool low = strcasecmp(args, "low") == 0;
+                if (!powerSetLowMode(low))
+                    internalSendAnswer(F("Error: Could not save the power mode"));
+                internalSendAnswer(low ? F("Low-power mode on: modem sleep, long polling, event-driven main loop") : F("Normal power mode"));
+            }
+            else if (*args == '\0')
+                sendPowerReport();
+            else
+                internalSendAnswer(F("Usage: /power [low|normal]"));
+        }
+        else if (strcasecmp(text, "/sniff") == 0)
+        {
+            sniffMode = !sniffMode;
+            internalSendAnswer(sniffMode ? F("Sniff mode on: received IR frames will be reported") : F("Sniff mode off"));
+        }
+        else if (strcasecmp(text, "/irstats") == 0)
+        {
+            sendIrStatsReport();
+        }
+        else if ((args = commandArgs(text, "/trace")) != NULL)
+        {
+            traceCommand(args);
+        }
+        else if ((args = commandArgs(text, "/route")) != NULL)
+        {
+            int device = codeStoreActiveDevice();
+            int number = atoi(args);
+            char name[DEVICE_NAME_LEN];
+
+            codeStoreDeviceName(device, name, sizeof(name));
+
+            if (number < 1 || number > irTransmitChannels())
+                internalSendAnswer("Usage: /route <channel 1-" + String(irTransmitChannels()) + ">. Device " + String(name) +
+                                   " uses channel " + String(codeStoreDeviceChannel(device) + 1));
+            else if (codeStoreSetDeviceChannel(device, number - 1))
+                internalSendAnswer("Codes of " + String(name) + " are now sent on channel " + String(number));
+            else
+                internalSendAnswer(F("Error: Could not save the route"));
+        }
+        else if ((args = commandArgs(text, "/name")) != NULL)
+        {
+            char *name;
+            int id = strtol(args, &name, 10);
+            CodeRecord record;
+
+            while (*name == ' ')
+                name++;
+
+            if (id <= 0 || *name == '\0')
+                internalSendAnswer(F("Usage: /name <id> <name>, e.g. /name 5 tv.power"));
+            else if (!codeStoreFind(id, record))
+                internalSendAnswer(F("Error: Code with this ID not found"));
+            else if (nameIndexFind(name) > 0)
+                internalSendAnswer(F("Error: This name is already in use"));
+            else if (!nameIndexValid(name))
+                internalSendAnswer(F("Error: Name must start with a letter and contain up to 31 letters, digits, '.', '_' or '-'"));
+            else if (!nameIndexAdd(name, id))
+                internalSendAnswer(F("Error: Could not save the name to SD card"));
+            else
+                internalSendAnswer("Code " + String(id) + " is now available as " + String(name));
+        }
+        else if ((args = commandArgs(text, "/unname")) != NULL)
+        {
+            if (nameIndexFind(args) < 0)
+                internalSendAnswer(F("Error: Name not found"));
+            else if (nameIndexRemove(args))
+                internalSendAnswer(F("Name removed."));
+            else
+                internalSendAnswer(F("Error: Could not update the names file on SD card"));
+        }
+        else if ((args = commandArgs(text, "/learn")) != NULL)
+        {
+            if (learnSessionActive())
+                internalSendAnswer(F("Batch learning is in progress. Send /done to finish it."));
+            else if (args[0] == '\0')
+                btnPressed = true;
+            else if (strcasecmp(args, "batch") == 0)
+                learnSessionRequested = true;
+            else
+                internalSendAnswer(F("Usage: /learn or /learn batch"));
+        }
+        else if (strcasecmp(text, "/skip") == 0)
+        {
+            if (learnSessionActive() && !learnNameReady)
+            {
+                learnName[0] = '\0';
+                learnNameReady = true;
+            }
+        }
+        else if (strcasecmp(text, "/done") == 0)
+        {
+            if (learnSessionActive())
+                learnSessionStop = true;
+            else
+                internalSendAnswer(F("No batch learning session is running."));
+        }
+        else if (strcasecmp(text, "/allclear") == 0)
         {
             clearAllCodes = true;
             internalSendAnswer(F("Command to delete all codes received. The file will be deleted shortly."));
@@ -214,31 +625,593 @@ void parseCommand(String text)
     }
 }
 
+void handleCallbackQuery(TelegramUpdate &update)
+{
+    const char *data = update.text;
+
+    if (strncmp(data, "c:", 2) == 0)
+    {
+        // Сначала ставим код в очередь, затем подтверждаем нажатие - ИК-сигнал уходит без ожидания ответа сервера
+        IrCommand cmd = {atoi(data + 2), update.replayed ? CMD_SOURCE_REPLAY : CMD_SOURCE_KEYBOARD, -1};
+        const char *reject = cmd.id > 0 ? commandRejectText(commandEnqueue(cmd)) : NULL;
+        char text[80] = "";
+
+        if (cmd.id <= 0)
+            strcpy(text, "Error: Invalid code");
+        else if (reject != NULL)
+            snprintf(text, sizeof(text), "%s, try again", reject); // Показывается всплывающим уведомлением
+
+        if (update.replayed)
+            traceReplayReply();
+        else
+            telegramAnswerCallback(update.callbackId, text);
+    }
+    else if (strncmp(data, "r:", 2) == 0)
+    {
+        telegramAnswerCallback(update.callbackId);
+        sendRemoteKeyboard(atoi(data + 2), update.messageId);
+    }
+    else if (strncmp(data, "l:", 2) == 0)
+    {
+        telegramAnswerCallback(update.callbackId);
+        sendCodesListPage(atoi(data + 2), update.messageId);
+    }
+    else
+    {
+        telegramAnswerCallback(update.callbackId);
+    }
+}
+
+// Документ в чате - библиотека кодов: загружаем на SD-карту и передаем импорт Ядру 0
+void handleDocument(TelegramUpdate &update)
+{
+    if (importRequested)
+    {
+        internalSendAnswer(F("Import is already in progress."));
+        return;
+    }
+
+    char filePath[96];
+
+    if (!telegramGetFilePath(update.fileId, filePath, sizeof(filePath)) ||
+        !telegramDownloadFile(filePath, IMPORT_TEMP_FILE))
+    {
+        internalSendAnswer(F("Error: Could not download the file"));
+        return;
+    }
+
+    strcpy(importPath, IMPORT_TEMP_FILE);
+    importRequested = true;
+}
+
+// Добавление форматированного текста в буфер с контролем переполнения
+bool appendf(char *buf, size_t size, size_t &pos, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf + pos, size - pos, fmt, args);
+    va_end(args);
+
+    if (len < 0 || pos + len >= size)
+        return false;
+
+    pos += len;
+    return true;
+}
+
+// Клавиатура-пульт из кэша кодов; messageId != 0 - обновить уже отправленную клавиатуру
+void sendRemoteKeyboard(int page, long messageId)
+{
+    CodeRecord records[REMOTE_PAGE_SIZE];
+    int device = codeStoreActiveDevice();
+    int pages = max(1, (codeStoreDeviceCodes(device) + REMOTE_PAGE_SIZE - 1) / REMOTE_PAGE_SIZE);
+
+    page = constrain(page, 0, pages - 1);
+
+    // Коды активного устройства из страничного кэша хранилища
+    int idsCount = codeStoreRead(device, page * REMOTE_PAGE_SIZE, records, REMOTE_PAGE_SIZE);
+
+    if (idsCount == 0)
+    {
+        internalSendAnswer(F("No codes saved yet. Use /learn to add one."));
+        return;
+    }
+
+    static char keyboard[REMOTE_KEYBOARD_LEN];
+    size_t pos = 0;
+    bool fits = appendf(keyboard, sizeof(keyboard), pos, "[");
+
+    for (int i = 0; i < idsCount && fits; i++)
+    {
+        // На кнопке имя кода, если оно задано
+        char label[NAME_MAX_LEN + 1];
+        if (!nameIndexNameOf(records[i].id, label, sizeof(label)))
+            snprintf(label, sizeof(label), "%d", records[i].id);
+
+        const char *rowStart = (i % REMOTE_COLUMNS == 0) ? (i ? "],[" : "[") : ",";
+        fits = appendf(keyboard, sizeof(keyboard), pos, "%s{\"text\":\"%s\",\"callback_data\":\"c:%d\"}", rowStart, label, records[i].id);
+    }
+
+    fits = fits && appendf(keyboard, sizeof(keyboard), pos, "]");
+
+    // Ряд навигации по страницам
+    if (fits && pages > 1)
+    {
+        fits = appendf(keyboard, sizeof(keyboard), pos, ",[");
+        if (fits && page > 0)
+            fits = appendf(keyboard, sizeof(keyboard), pos, "{\"text\":\"<<\",\"callback_data\":\"r:%d\"}%s", page - 1, page < pages - 1 ? "," : "");
+        if (fits && page < pages - 1)
+            fits = appendf(keyboard, sizeof(keyboard), pos, "{\"text\":\">>\",\"callback_data\":\"r:%d\"}", page + 1);
+        fits = fits && appendf(keyboard, sizeof(keyboard), pos, "]");
+    }
+
+    fits = fits && appendf(keyboard, sizeof(keyboard), pos, "]");
+
+    if (!fits)
+    {
+        internalSendAnswer(F("Error: Remote keyboard is too large"));
+        return;
+    }
+
+    char deviceName[DEVICE_NAME_LEN];
+    codeStoreDeviceName(device, deviceName, sizeof(deviceName));
+
+    char title[64];
+    snprintf(title, sizeof(title), "IR remote %s, page %d/%d", deviceName, page + 1, pages);
+
+    if (telegramSendMessage(title, "", keyboard, messageId) != 200 && DEBUG_TELEGRAM)
+        Serial.println(F("Failed to send remote keyboard"));
+}
+
+// Страница /list начиная с записи start активного устройства: заполняется, пока помещается в сообщение
+void sendCodesListPage(int start, long messageId)
+{
+    static char page[LIST_PAGE_LEN];
+    const size_t headerSpace = 64; // Место под заголовок, который известен только после заполнения страницы
+    size_t pos = headerSpace;
+    char *text = page + headerSpace;
+    int device = codeStoreActiveDevice();
+    int total = codeStoreDeviceCodes(device);
+    int next;
+    bool full = false;
+
+    page[pos] = '\0';
+    start = constrain(start, 0, max(0, total - 1));
+
+    // Записи читаются порциями из страничного кэша хранилища
+    for (next = start; next < total && !full;)
+    {
+        CodeRecord records[LIST_READ_RECORDS];
+        int count = codeStoreRead(device, next, records, LIST_READ_RECORDS);
+
+        if (count == 0)
+            break;
+
+        for (int i = 0; i < count; i++, next++)
+        {
+            const CodeRecord &r = records[i];
+
+            char name[NAME_MAX_LEN + 4] = "";
+            if (nameIndexNameOf(r.id, name + 2, sizeof(name) - 3))
+            {
+                name[0] = ' ';
+                name[1] = '(';
+                strcat(name, ")");
+            }
+
+            size_t lineStart = pos;
+            if (!appendf(page, sizeof(page), pos, "%d%s: %s addr 0x%lX cmd 0x%lX\n",
+                         r.id, name, getProtocolName((decode_type_t)r.protocol).c_str(),
+                         (unsigned long)r.address, (unsigned long)r.command))
+            {
+                pos = lineStart; // Запись не поместилась - перенесем на следующую страницу
+                page[pos] = '\0';
+                full = true;
+                break;
+            }
+        }
+    }
+
+    if (total == 0)
+    {
+        internalSendAnswer(F("No codes saved yet. Use /learn to add one."));
+        return;
+    }
+
+    char deviceName[DEVICE_NAME_LEN];
+    codeStoreDeviceName(device, deviceName, sizeof(deviceName));
+
+    char header[headerSpace];
+    int headerLen = snprintf(header, sizeof(header), "Codes of %s %d-%d of %d:\n", deviceName, start + 1, next, total);
+    text -= headerLen;
+    memcpy(text, header, headerLen);
+
+    char keyboard[64] = "[]";
+    if (next < total)
+        snprintf(keyboard, sizeof(keyboard), "[[{\"text\":\"Next page >>\",\"callback_data\":\"l:%d\"}]]", next);
+
+    if (telegramSendMessage(text, "", keyboard, messageId) != 200 && DEBUG_TELEGRAM)
+        Serial.println(F("Failed to send codes list"));
+}
+
+// Список устройств с числом кодов; активное отмечено звездочкой
+void sendDevicesList()
+{
+    char text[CODE_MAX_DEVICES * (DEVICE_NAME_LEN + 24) + 48];
+    size_t pos = 0;
+    int active = codeStoreActiveDevice();
+
+    appendf(text, sizeof(text), pos, "Devices (* - active):\n");
+
+    for (int i = 0; i < codeStoreDeviceCount(); i++)
+    {
+        char name[DEVICE_NAME_LEN];
+        codeStoreDeviceName(i, name, sizeof(name));
+        appendf(text, sizeof(text), pos, "%s %s: %d codes\n", i == active ? "*" : "-", name, codeStoreDeviceCodes(i));
+    }
+
+    internalSendAnswer(text);
+}
+
+// Метрики каналов излучателей: пропускная способность, задержки и справедливость очередей
+void sendChannelsReport()
+{
+    char text[IR_TX_MAX_CHANNELS * 160 + 64];
+    size_t pos = 0;
+    uint32_t uptimeMin = max(1UL, millis() / 60000UL);
+
+    for (uint8_t i = 0; i < irTransmitChannels(); i++)
+    {
+        IrTxStats s;
+        irTransmitStats(i, s);
+
+        uint32_t sent = max(1UL, (unsigned long)s.sent);
+        appendf(text, sizeof(text), pos,
+                "Channel %u (GPIO %u): %lu sent (+%lu repeats), %lu/min, busy %lu%%, rejected %lu\n"
+                "  air %lu ms, queue delay avg %lu ms max %lu ms, core wait avg %lu ms\n",
+                i + 1, irTransmitPin(i), (unsigned long)s.sent, (unsigned long)s.repeats, (unsigned long)(s.sent / uptimeMin),
+                (unsigned long)(s.airMs / (uptimeMin * 600)), (unsigned long)s.rejected,
+                (unsigned long)(s.airMs / sent), (unsigned long)(s.queueDelayMs / sent),
+                (unsigned long)s.maxQueueDelayMs, (unsigned long)(s.lockWaitMs / sent));
+    }
+
+    appendf(text, sizeof(text), pos, "Fairness (Jain, queue delay): %.2f", irTransmitFairness());
+    internalSendAnswer(text);
+}
+
+void sendIrStatsReport()
+{
+    char text[1024];
+    size_t pos = 0;
+    IrMonitorStats s;
+    irMonitorStats(s);
+
+    appendf(text, sizeof(text), pos,
+            "IR receiver: %lu frames, %lu repeats, %lu not decoded, %lu overflows, %lu dropped\n"
+            "Frames/s: %lu (1 s), %.1f (10 s), %.1f (60 s), peak %lu\n",
+            (unsigned long)s.frames, (unsigned long)s.repeats, (unsigned long)s.failures,
+            (unsigned long)s.overflows, (unsigned long)s.dropped, (unsigned long)irMonitorRate(1),
+            irMonitorRate(10) / 10.0f, irMonitorRate(60) / 60.0f, (unsigned long)irMonitorPeakRate());
+
+    for (int protocol = 1; protocol < IR_MONITOR_PROTOCOLS; protocol++)
+    {
+        uint32_t count = irMonitorProtocolCount(protocol);
+        if (count > 0)
+            appendf(text, sizeof(text), pos, "- %s: %lu\n", typeToString((decode_type_t)protocol).c_str(),
+                    (unsigned long)count);
+    }
+
+    internalSendAnswer(text);
+}
+
+// Энергобюджет: активное время частей системы в пересчете на час и оценка среднего тока
+void sendPowerReport()
+{
+    char text[768];
+    size_t pos = 0;
+    PowerStats s;
+    powerStats(s);
+
+    float hours = max(1UL, (unsigned long)s.uptimeMs) / 3600000.0f;
+    float loopS = s.activeMs[POWER_DOMAIN_LOOP] / 1000.0f / hours;
+    float netS = s.activeMs[POWER_DOMAIN_NETWORK] / 1000.0f / hours;
+    float txS = s.irTxAirMs / 1000.0f / hours;
+    float activeS = min(loopS + netS, 3600.0f);
+
+    // Активное время считается по току активного режима, остальное - по току простоя режима
+    float mAh = (activeS * POWER_MA_ACTIVE + txS * POWER_MA_IR_LED +
+                 (3600.0f - activeS) * (powerLowMode() ? POWER_MA_IDLE_LOW : POWER_MA_IDLE_NORMAL)) / 3600.0f;
+
+    appendf(text, sizeof(text), pos, "Power mode: %s\n", powerLowMode() ? "low" : "normal");
+    if (powerLowMode())
+        appendf(text, sizeof(text), pos, "WiFi modem sleep, long polling %u s, CPU %s\n", POWER_LONG_POLL_S,
+                powerFrequencyScaling() ? "80-240 MHz" : "240 MHz (DFS not available)");
+
+    appendf(text, sizeof(text), pos,
+            "Over %lu min, per hour:\n"
+            "- Main loop active: %.1f s\n"
+            "- Network active: %.1f s, %.0f requests, %.0f TLS connects, %.0f long polls aborted for replies\n"
+            "- IR transmit: %.1f s\n",
+            (unsigned long)(s.uptimeMs / 60000), loopS, netS, s.requests / hours, s.connects / hours,
+            s.abortedPolls / hours, txS);
+
+    if (powerLowMode())
+        appendf(text, sizeof(text), pos, "- Main loop wakeups: button %.0f, IR %.0f, command %.0f, timer %.0f\n",
+                s.wakeups[0] / hours, s.wakeups[1] / hours, s.wakeups[2] / hours, s.wakeups[3] / hours);
+
+    appendf(text, sizeof(text), pos, "Estimated average current: %.0f mA, %.0f h on a %u mAh battery", mAh,
+            POWER_BATTERY_MAH / mAh, POWER_BATTERY_MAH);
+    internalSendAnswer(text);
+}
+
+// /trace start [path] | stop | replay [path] [speed]
+void traceCommand(const char *args)
+{
+    const char *subArgs;
+    char path[TRACE_PATH_LEN];
+
+    if ((subArgs = commandArgs(args, "start")) != NULL)
+    {
+        if (traceRecording() || traceReplaying())
+            internalSendAnswer(F("Trace is already being recorded or replayed. Send /trace stop first."));
+        else if (*subArgs != '\0' && *subArgs != '/')
+            internalSendAnswer(F("Usage: /trace start [/path/on/sd.bin]"));
+        else if (!traceStart(*subArgs ? subArgs : TRACE_FILE))
+            internalSendAnswer(F("Error: Could not create the trace file"));
+        else
+            internalSendAnswer("Recording Telegram updates and IR frames to " + String(*subArgs ? subArgs : TRACE_FILE));
+    }
+    else if (strcasecmp(args, "stop") == 0)
+    {
+        TraceStats s;
+        bool replay = traceReplaying();
+
+        if (!traceRecording() && !replay)
+            internalSendAnswer(F("No trace is being recorded or replayed."));
+        else if (!traceStop(s))
+            internalSendAnswer(F("Error: Trace task did not stop"));
+        else if (!replay) // Итог воспроизведения присылает сама задача трассы
+        {
+            char text[160];
+            snprintf(text, sizeof(text), "Trace recorded: %lu records, %lu bytes, %lu s, %lu dropped",
+                     (unsigned long)s.records, (unsigned long)s.bytes, (unsigned long)(s.traceMs / 1000),
+                     (unsigned long)s.dropped);
+            internalSendAnswer(text);
+        }
+    }
+    else if ((subArgs = commandArgs(args, "replay")) != NULL)
+    {
+        // Путь необязателен: "/trace replay 50" - файл по умолчанию с ускорением 50
+        strcpy(path, TRACE_FILE);
+        if (*subArgs == '/')
+        {
+            size_t len = strcspn(subArgs, " ");
+            if (len >= sizeof(path))
+                len = sizeof(path) - 1;
+            memcpy(path, subArgs, len);
+            path[len] = '\0';
+            subArgs += strcspn(subArgs, " ");
+            while (*subArgs == ' ')
+                subArgs++;
+        }
+
+        int speed = *subArgs ? atoi(subArgs) : TRACE_REPLAY_SPEED;
+
+        if (traceRecording() || traceReplaying())
+            internalSendAnswer(F("Trace is already being recorded or replayed. Send /trace stop first."));
+        else if (speed < 0 || speed > 1000 || (*subArgs && !isdigit(*subArgs)))
+            internalSendAnswer(F("Usage: /trace replay [/path/on/sd.bin] [speed 0-1000, 0 - as fast as possible]"));
+        else
+        {
+            // Во время воспроизведения ответы только считаются, поэтому сообщаем заранее
+            internalSendAnswer("Replaying " + String(path) + (speed ? " at x" + String(speed) : String(" without pauses")) +
+                               ". Replies and IR transmission are muted until the report.");
+            if (!traceReplayStart(path, speed))
+                internalSendAnswer("Error: Could not open trace " + String(path));
+        }
+    }
+    else
+    {
+        internalSendAnswer(F("Usage: /trace start [path], /trace stop, /trace replay [path] [speed]"));
+    }
+}
+
+// Время в местном часовом поясе
+void formatLocalTime(time_t time, char *buf, size_t size)
+{
+    struct tm t;
+    localtime_r(&time, &t);
+    strftime(buf, size, "%a %Y-%m-%d %H:%M", &t);
+}
+
+void sendScheduleList()
+{
+    static char text[SCHEDULE_LIST_LEN];
+    size_t pos = 0;
+    char clock[24];
+
+    if (scheduleTimeValid())
+    {
+        formatLocalTime(time(NULL), clock, sizeof(clock));
+        appendf(text, sizeof(text), pos, "Scheduled actions (now %s):\n", clock);
+    }
+    else
+        appendf(text, sizeof(text), pos, "Scheduled actions (clock is not synchronized yet):\n");
+
+    ScheduleEntry entry;
+    time_t due;
+    uint8_t i = 0;
+
+    for (; scheduleGet(i, entry, due); i++)
+    {
+        char when[SCHEDULE_WHEN_LEN];
+        char name[NAME_MAX_LEN + 1];
+        char channel[8] = "";
+
+        scheduleFormatWhen(entry, when, sizeof(when));
+        if (!nameIndexNameOf(entry.code, name, sizeof(name)))
+            snprintf(name, sizeof(name), "%d", entry.code);
+        if (entry.channel >= 0)
+            snprintf(channel, sizeof(channel), "@%d", entry.channel + 1);
+        formatLocalTime(due, clock, sizeof(clock));
+
+        appendf(text, sizeof(text), pos, "#%u %s -> %s%s, next %s\n", entry.id, when, name, channel,
+                scheduleTimeValid() ? clock : "-");
+    }
+
+    if (i == 0)
+        appendf(text, sizeof(text), pos, "none. Add one with /schedule add weekdays 07:00 <code>");
+
+    internalSendAnswer(text);
+}
+
+// /schedule add <когда> <HH:MM> <ID или имя>[@канал]
+void scheduleAddCommand(const char *args)
+{
+    ScheduleEntry entry = {};
+    CodeRecord record;
+    const char *code;
+
+    if (!scheduleTimeValid())
+    {
+        internalSendAnswer(F("Error: The clock is not synchronized yet, try again later"));
+        return;
+    }
+
+    if (!scheduleParseWhen(args, entry, time(NULL), &code) || *code == '\0')
+    {
+        internalSendAnswer(F("Usage: /schedule add <daily|weekdays|weekends|mon,wed|today|tomorrow|YYYY-MM-DD> <HH:MM> <code>[@channel]. One-time actions must be in the future."));
+        return;
+    }
+
+    char name[NAME_MAX_LEN + 1];
+    const char *at = strchr(code, '@');
+    size_t len = min(at ? (size_t)(at - code) : strlen(code), sizeof(name) - 1);
+
+    strncpy(name, code, len);
+    name[len] = '\0';
+
+    entry.channel = -1;
+    if (at != NULL)
+    {
+        int number = atoi(at + 1);
+        if (number < 1 || number > irTransmitChannels())
+        {
+            internalSendAnswer("Error: Channel must be 1-" + String(irTransmitChannels()));
+            return;
+        }
+        entry.channel = number - 1;
+    }
+
+    entry.code = atoi(name);
+    if (entry.code <= 0)
+        entry.code = nameIndexFind(name);
+
+    if (entry.code <= 0 || !codeStoreFind(entry.code, record))
+    {
+        internalSendAnswer("Error: Unknown code " + String(name));
+        return;
+    }
+
+    int id = scheduleAdd(entry);
+    if (id < 0)
+    {
+        internalSendAnswer("Error: Schedule is full (" + String(SCHEDULE_MAX_ENTRIES) + " actions)");
+        return;
+    }
+
+    char when[SCHEDULE_WHEN_LEN];
+    char next[24];
+    scheduleFormatWhen(entry, when, sizeof(when));
+    formatLocalTime(scheduleNextTime(entry, time(NULL)), next, sizeof(next));
+
+    internalSendAnswer("Scheduled action #" + String(id) + ": " + when + " -> " + code + "\nNext run: " + next);
+}
+
+// Источник документа /export: число кодов зафиксировано до отправки, чтобы оба прохода
+// (подсчет длины и передача) выдали одинаковый текст, даже если коды дописываются
+struct CodesExport
+{
+    int device;
+    int count;
+    bool ok;
+};
+
+void writeCodesExport(Print &out, void *ctx)
+{
+    CodesExport *e = (CodesExport *)ctx;
+    e->ok = codeStoreExportText(e->device, e->count, out);
+}
+
+// Выгрузка /export: коды активного устройства в текстовом формате, который читается человеком
+// и переносится обратно при загрузке. Документ собирается по порциям кэша прямо в сокет, без файла на SD
+void exportCodesFile()
+{
+    int device = codeStoreActiveDevice();
+    char name[DEVICE_NAME_LEN + 8] = "";
+    CodesExport e = {device, codeStoreDeviceCodes(device), true};
+
+    if (e.count == 0)
+    {
+        internalSendAnswer(F("No codes file found!"));
+        return;
+    }
+
+    if (device == 0)
+        snprintf(name, sizeof(name), "%s", CODES_TEXT_FILE + 1);
+    else if (codeStoreDeviceName(device, name, DEVICE_NAME_LEN))
+        strcat(name, ".txt");
+
+    if (!telegramSendDocument(name, writeCodesExport, &e) || !e.ok)
+        internalSendAnswer(F("Error: Could not send codes file"));
+}
+
 void internalSendAnswer(String text)
 {
     int maxRetries = 3;
 
+    // Ответы на воспроизводимые команды не отправляются, только считаются. Ответы живому чату,
+    // расписанию и основному циклу во время воспроизведения уходят как обычно
+    if (replayDispatch)
+    {
+        traceReplayReply();
+        return;
+    }
+
     for (int i = 0; i < maxRetries; i++)
     {
-        if (bot.sendMessage(CHAT_ID, text, "Markdown"))
+        // Обычный текст: в ответах есть имена кодов и устройств с '_' и маркер '*' в /device,
+        // которые Markdown принял бы за разметку, и сервер отклонил бы сообщение с 400
+        int status = telegramSendMessage(text.c_str());
+
+        if (status == 200)
         {
             if (DEBUG_TELEGRAM)
             {
                 Serial.print(F("Message sent successfully: "));
                 Serial.println(text);
             }
-
             return; // Успешная отправка
         }
 
         if (DEBUG_TELEGRAM)
         {
-            Serial.print(F("Failed to send message (attempt "));
+            Serial.print(F("Failed to send message, HTTP "));
+            Serial.print(status);
+            Serial.print(F(" (attempt "));
             Serial.print(i + 1);
             Serial.println(F(")"));
         }
 
-        vTaskDelay(pdMS_TO_TICKS(250)); // Небольшая неблокирующая задержка 250 мс
+        // Отказ сервера (кроме 429) при повторе не изменится
+        if (status >= 400 && status < 500 && status != 429)
+            break;
+
+        // 429: сервер сам говорит, сколько ждать; пауза ограничена, чтобы не задерживать опрос
+        unsigned long delayMs = SEND_RETRY_DELAY_MS;
+        if (status == 429 && telegramRetryAfter() > 0)
+            delayMs = min(telegramRetryAfter() * 1000UL, (unsigned long)SEND_RETRY_AFTER_MAX_MS);
+        vTaskDelay(pdMS_TO_TICKS(delayMs));
     }
 
     // Если все попытки неудачны, можно отправить сообщение об ошибке
@@ -247,25 +1220,62 @@ void internalSendAnswer(String text)
         Serial.println("Error: Failed to send message after " + String(maxRetries) + " attempts");
     }
 }
+
+// RTC-память: запись практически бесплатна, вызывается перед каждым пакетом
 void saveLastMessageId(long id)
 {
-    File file = SD.open("/last_msg_id.txt", FILE_WRITE);
-    if (file)
+    if (id <= 0)
+        return;
+
+    rtcLastId = id;
+    rtcLastIdCheck = ~id;
+    rtcLastIdMagic = LAST_ID_RTC_MAGIC;
+}
+
+// NVS: новый ID пишется каждые LAST_ID_NVS_EVERY обновлений или раз в LAST_ID_NVS_PERIOD_MS;
+// force - перед перезагрузкой. После отключения питания могут повториться команды с момента последней записи
+void flushLastMessageId(bool force)
+{
+    long id = lastUpdateId;
+
+    if (id <= lastIdNvsSaved)
+        return;
+    if (!force && id - lastIdNvsSaved < LAST_ID_NVS_EVERY && millis() - lastIdNvsSavedAt < LAST_ID_NVS_PERIOD_MS)
+        return;
+
+    lastIdNvsSavedAt = millis();
+
+    if (lastIdPrefs.putLong(LAST_ID_NVS_KEY, id) == sizeof(int32_t))
     {
-        file.print(id);
-        file.close();
+        lastIdNvsSaved = id;
+
         if (DEBUG_TELEGRAM)
             Serial.println("Saved last message ID: " + String(id));
     }
     else
     {
         if (DEBUG_TELEGRAM)
-            Serial.println("Failed to open last_msg_id.txt for writing");
+            Serial.println("Failed to save last message ID to NVS");
     }
 }
 
 long loadLastMessageId()
 {
+    long id = 0;
+
+    if (lastIdPrefs.begin(LAST_ID_NVS_NAMESPACE, false))
+    {
+        id = lastIdPrefs.getLong(LAST_ID_NVS_KEY, 0);
+        lastIdNvsSaved = id;
+    }
+    else if (DEBUG_TELEGRAM)
+        Serial.println("Failed to open NVS for last message ID");
+
+    // RTC-память новее NVS только после теплого сброса
+    if (rtcLastIdMagic == LAST_ID_RTC_MAGIC && rtcLastIdCheck == ~rtcLastId && rtcLastId > id)
+        id = rtcLastId;
+
+    // Перенос ID из файла старых версий прошивки
     if (SD.exists("/last_msg_id.txt"))
     {
         File file = SD.open("/last_msg_id.txt", FILE_READ);
@@ -273,15 +1283,28 @@ long loadLastMessageId()
         {
             String id_str = file.readString();
             file.close();
-            long id = atol(id_str.c_str()); // Используем atol для преобразования в long
-            if (DEBUG_TELEGRAM)
-                Serial.println("Loaded last message ID: " + String(id));
-            return id;
+            long fileId = atol(id_str.c_str());
+
+            if (fileId > id)
+                id = fileId;
         }
+
+        SD.remove("/last_msg_id.txt");
     }
-    if (DEBUG_TELEGRAM)
-        Serial.println("No last message ID file found.");
-    return 0; // Возвращаем 0, если файл не найден
+
+    if (id > 0)
+    {
+        // Синхронизируем RTC и NVS
+        lastUpdateId = id;
+        saveLastMessageId(id);
+        flushLastMessageId(true);
+        if (DEBUG_TELEGRAM)
+            Serial.println("Loaded last message ID: " + String(id));
+    }
+    else if (DEBUG_TELEGRAM)
+        Serial.println("No last message ID found.");
+
+    return id;
 }
 
 bool checkWiFiConnection()
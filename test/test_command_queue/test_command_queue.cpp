@@ -0,0 +1,195 @@
+// Хостовый тест CommandQueue: доли источников, срочные команды вперед, объединение повторов,
+// очередность внутри приоритета и счетчики. Собирается без Arduino (см. test/CMakeLists.txt)
+#include "command_queue.h"
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if (!(cond))                                                        \
+        {                                                                   \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+// Источники, как CommandSource в ir_command.h (он зависит от Arduino)
+enum TestSource : uint8_t
+{
+    SOURCE_TEXT,
+    SOURCE_KEYBOARD,
+    SOURCE_SCHEDULE,
+    SOURCE_REPLAY,
+};
+
+#define NORMAL COMMAND_PRIORITY_NORMAL
+#define HIGH COMMAND_PRIORITY_HIGH
+
+// Доля одного источника - COMMAND_SOURCE_MAX заданий, вся очередь - COMMAND_QUEUE_LEN
+static void testSourceLimits()
+{
+    CommandQueue queue;
+
+    queue.clear();
+
+    for (int i = 0; i < COMMAND_SOURCE_MAX; i++)
+        CHECK(queue.push(100 + i, SOURCE_REPLAY, -1, NORMAL, 0) == COMMAND_QUEUED);
+
+    CHECK(queue.push(200, SOURCE_REPLAY, -1, NORMAL, 0) == COMMAND_SOURCE_FULL);
+    CHECK(queue.countOf(SOURCE_REPLAY) == COMMAND_SOURCE_MAX);
+
+    // Повтор ожидающего кода объединяется и при исчерпанной доле
+    CHECK(queue.push(100, SOURCE_REPLAY, -1, NORMAL, 0) == COMMAND_COALESCED);
+
+    // Остальное место - другим источникам, пока не заполнена вся очередь
+    int others = COMMAND_QUEUE_LEN - COMMAND_SOURCE_MAX;
+    for (int i = 0; i < others; i++)
+        CHECK(queue.push(300 + i, i % 2 ? SOURCE_TEXT : SOURCE_KEYBOARD, -1, NORMAL, 0) == COMMAND_QUEUED);
+
+    CHECK(queue.count() == COMMAND_QUEUE_LEN);
+    CHECK(queue.push(400, SOURCE_SCHEDULE, -1, HIGH, 0) == COMMAND_QUEUE_FULL);
+    CHECK(queue.stats().rejected == 2);
+
+    // Выданное задание освобождает долю своего источника
+    CommandJob job;
+    while (queue.pop(0, job) && job.source != SOURCE_REPLAY)
+        ;
+    CHECK(job.source == SOURCE_REPLAY && queue.countOf(SOURCE_REPLAY) == COMMAND_SOURCE_MAX - 1);
+    CHECK(queue.push(200, SOURCE_REPLAY, -1, NORMAL, 0) == COMMAND_QUEUED);
+
+    // Неизвестный источник учитывается как последний
+    queue.clear();
+    CHECK(queue.push(1, 9, -1, NORMAL, 0) == COMMAND_QUEUED);
+    CHECK(queue.countOf(COMMAND_SOURCES - 1) == 1 && queue.countOf(9) == 0);
+}
+
+// Срочное задание обгоняет накопленные обычные, в том числе поставленные раньше
+static void testUrgentFirst()
+{
+    CommandQueue queue;
+    CommandJob job;
+
+    queue.clear();
+    queue.push(1, SOURCE_TEXT, -1, NORMAL, 0);
+    queue.push(2, SOURCE_TEXT, -1, NORMAL, 0);
+    queue.push(2, SOURCE_TEXT, -1, NORMAL, 0);
+    queue.push(3, SOURCE_SCHEDULE, -1, NORMAL, 0);
+    queue.push(9, SOURCE_REPLAY, -1, HIGH, 10);
+    queue.push(8, SOURCE_TEXT, -1, HIGH, 20);
+
+    // Срочные - по кругу источников, начиная с источника 0
+    CHECK(queue.pop(30, job) && job.id == 8 && job.priority == HIGH);
+    CHECK(queue.pop(30, job) && job.id == 9 && job.priority == HIGH);
+
+    // Новое срочное задание обгоняет уже ожидающие обычные
+    CHECK(queue.pop(30, job) && job.id == 1);
+    queue.push(7, SOURCE_KEYBOARD, -1, HIGH, 30);
+    CHECK(queue.pop(30, job) && job.id == 7);
+    CHECK(queue.pop(30, job) && job.priority == NORMAL);
+    CHECK(queue.pop(30, job) && job.priority == NORMAL);
+    CHECK(!queue.pop(30, job));
+
+    // Неизвестный приоритет - обычный
+    queue.push(5, SOURCE_TEXT, -1, NORMAL, 0);
+    queue.push(6, SOURCE_TEXT, -1, 7, 0);
+    CHECK(queue.pop(0, job) && job.id == 5);
+    CHECK(queue.pop(0, job) && job.id == 6 && job.priority == NORMAL);
+}
+
+// Одинаковая ожидающая команда того же источника и канала - повтор в одном задании
+static void testCoalescing()
+{
+    CommandQueue queue;
+    CommandJob job;
+    uint8_t repeat = 0;
+
+    queue.clear();
+    CHECK(queue.push(5, SOURCE_KEYBOARD, -1, NORMAL, 0, &repeat) == COMMAND_QUEUED && repeat == 1);
+    CHECK(queue.push(5, SOURCE_KEYBOARD, -1, NORMAL, 10, &repeat) == COMMAND_COALESCED && repeat == 2);
+    CHECK(queue.push(5, SOURCE_KEYBOARD, -1, NORMAL, 20, &repeat) == COMMAND_COALESCED && repeat == 3);
+
+    // Другой канал или источник - отдельное задание
+    CHECK(queue.push(5, SOURCE_KEYBOARD, 1, NORMAL, 20) == COMMAND_QUEUED);
+    CHECK(queue.push(5, SOURCE_TEXT, -1, NORMAL, 20) == COMMAND_QUEUED);
+    CHECK(queue.count() == 3);
+
+    // Время ожидания считается от первой постановки
+    CHECK(queue.pop(100, job) && job.id == 5 && job.source == SOURCE_TEXT && job.repeat == 1);
+    CHECK(queue.pop(100, job) && job.source == SOURCE_KEYBOARD && job.channel == -1 && job.repeat == 3);
+    CHECK(job.queuedAt == 0 && queue.stats().waitMaxMs == 100);
+
+    // Выданное задание уже не принимает повторы
+    CHECK(queue.push(5, SOURCE_KEYBOARD, -1, NORMAL, 100) == COMMAND_QUEUED);
+
+    // Не больше COMMAND_REPEAT_MAX повторов в задании, дальше - новое задание
+    queue.clear();
+    for (int i = 0; i < COMMAND_REPEAT_MAX; i++)
+        queue.push(3, SOURCE_TEXT, -1, NORMAL, 0);
+    CHECK(queue.count() == 1 && queue.stats().coalesced == COMMAND_REPEAT_MAX - 1);
+    CHECK(queue.push(3, SOURCE_TEXT, -1, NORMAL, 0, &repeat) == COMMAND_QUEUED && repeat == 1);
+    CHECK(queue.pop(0, job) && job.repeat == COMMAND_REPEAT_MAX);
+    CHECK(queue.pop(0, job) && job.repeat == 1);
+}
+
+// Внутри приоритета: задания источника - в порядке постановки, источники - по очереди
+static void testFifo()
+{
+    CommandQueue queue;
+    CommandJob job;
+
+    queue.clear();
+    for (int i = 1; i <= 6; i++)
+        queue.push(i, SOURCE_REPLAY, -1, NORMAL, i);
+    queue.push(11, SOURCE_TEXT, -1, NORMAL, 7);
+    queue.push(12, SOURCE_TEXT, -1, NORMAL, 8);
+
+    // Ячейки освобождаются не по порядку: новое задание в освободившейся ячейке идет последним
+    int order[8];
+    int n = 0;
+    while (n < 3 && queue.pop(10, job))
+        order[n++] = job.id;
+    queue.push(7, SOURCE_REPLAY, -1, NORMAL, 10);
+    while (n < 8 && queue.pop(10, job))
+        order[n++] = job.id;
+
+    const int expected[8] = {11, 1, 12, 2, 3, 4, 5, 6};
+    for (int i = 0; i < 8; i++)
+        CHECK(order[i] == expected[i]);
+    CHECK(queue.pop(10, job) && job.id == 7);
+    CHECK(!queue.pop(10, job) && queue.count() == 0);
+}
+
+static void testStats()
+{
+    CommandQueue queue;
+    CommandJob job;
+
+    queue.clear();
+    queue.push(1, SOURCE_TEXT, -1, NORMAL, 0);
+    queue.push(1, SOURCE_TEXT, -1, NORMAL, 0);
+    queue.push(2, SOURCE_TEXT, -1, NORMAL, 50);
+    queue.pop(100, job);
+    queue.pop(100, job);
+
+    const CommandQueueStats &s = queue.stats();
+    CHECK(s.queued == 2 && s.coalesced == 1 && s.rejected == 0 && s.dispatched == 2);
+    CHECK(s.waitSumMs == 150 && s.waitMaxMs == 100 && s.maxDepth == 2);
+
+    queue.clear();
+    CHECK(queue.stats().queued == 0 && queue.count() == 0);
+}
+
+int main()
+{
+    testSourceLimits();
+    testUrgentFirst();
+    testCoalescing();
+    testFifo();
+    testStats();
+
+    if (failures == 0)
+        printf("command_queue: all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,262 @@
+// Хостовый тест ScheduleQueue: время подается имитацией часов, часовой пояс с переходом
+// на летнее время задается через TZ. Собирается без Arduino (см. test/CMakeLists.txt)
+#include "schedule_queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if (!(cond))                                                        \
+        {                                                                   \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+// Часовой пояс с летним временем: переходы в последнее воскресенье марта (02:00 -> 03:00)
+// и октября (03:00 -> 02:00)
+#define TEST_TZ "CET-1CEST,M3.5.0,M10.5.0/3"
+
+// Имитация часов устройства: время только передается в очередь, шаг задает тест
+struct FakeClock
+{
+    time_t now;
+
+    void advance(time_t seconds) { now += seconds; }
+    void set(time_t time) { now = time; }
+};
+
+// Местное время по TZ
+static time_t localTime(int year, int month, int day, int hour, int minute, int second = 0)
+{
+    struct tm t;
+    memset(&t, 0, sizeof(t));
+    t.tm_year = year - 1900;
+    t.tm_mon = month - 1;
+    t.tm_mday = day;
+    t.tm_hour = hour;
+    t.tm_min = minute;
+    t.tm_sec = second;
+    t.tm_isdst = -1;
+    return mktime(&t);
+}
+
+static ScheduleEntry repeating(uint8_t days, int hour, int minute, int code)
+{
+    ScheduleEntry entry = {0, days, (uint16_t)(hour * 60 + minute), 0, code, -1};
+    return entry;
+}
+
+static ScheduleEntry once(time_t at, int code)
+{
+    struct tm t;
+    localtime_r(&at, &t);
+
+    ScheduleEntry entry = {0, 0, (uint16_t)(t.tm_hour * 60 + t.tm_min), at, code, -1};
+    return entry;
+}
+
+// Следующее срабатывание по дням недели: 2026-10-16 - пятница
+static void testWeekdays()
+{
+    ScheduleEntry weekdays = repeating(SCHEDULE_WEEKDAYS, 7, 0, 1);
+    ScheduleEntry weekends = repeating(SCHEDULE_WEEKENDS, 7, 0, 1);
+    ScheduleEntry wednesday = repeating(1 << 2, 7, 0, 1);
+
+    CHECK(scheduleNextTime(weekdays, localTime(2026, 10, 16, 6, 0)) == localTime(2026, 10, 16, 7, 0));
+    CHECK(scheduleNextTime(weekdays, localTime(2026, 10, 16, 7, 0)) == localTime(2026, 10, 19, 7, 0)); // Строго после
+    CHECK(scheduleNextTime(weekends, localTime(2026, 10, 16, 8, 0)) == localTime(2026, 10, 17, 7, 0));
+    CHECK(scheduleNextTime(weekends, localTime(2026, 10, 18, 8, 0)) == localTime(2026, 10, 24, 7, 0));
+    CHECK(scheduleNextTime(wednesday, localTime(2026, 10, 14, 7, 1)) == localTime(2026, 10, 21, 7, 0)); // Через неделю
+
+    ScheduleEntry past = once(localTime(2026, 10, 16, 7, 0), 1);
+    CHECK(scheduleNextTime(past, localTime(2026, 10, 16, 8, 0)) == 0);
+}
+
+// Переходы на летнее время: срок - местное время, а не сутки по 86400 с
+static void testDst()
+{
+    ScheduleEntry daily = repeating(SCHEDULE_DAILY, 7, 0, 1);
+
+    // 2026-03-29: сутки короче на час
+    time_t spring = scheduleNextTime(daily, localTime(2026, 3, 28, 7, 0));
+    CHECK(spring == localTime(2026, 3, 29, 7, 0));
+    CHECK(spring - localTime(2026, 3, 28, 7, 0) == 23 * 3600);
+
+    // 2026-10-25: сутки длиннее на час
+    time_t autumn = scheduleNextTime(daily, localTime(2026, 10, 24, 7, 0));
+    CHECK(autumn == localTime(2026, 10, 25, 7, 0));
+    CHECK(autumn - localTime(2026, 10, 24, 7, 0) == 25 * 3600);
+
+    // 02:30 в день перехода на летнее время не существует: срок в тот же день после перехода,
+    // на следующий день - снова 02:30
+    ScheduleEntry night = repeating(SCHEDULE_DAILY, 2, 30, 1);
+    time_t skipped = scheduleNextTime(night, localTime(2026, 3, 29, 0, 0));
+    struct tm t;
+    localtime_r(&skipped, &t);
+    CHECK(skipped > localTime(2026, 3, 29, 1, 59) && t.tm_mday == 29 && t.tm_isdst > 0);
+    CHECK(scheduleNextTime(night, skipped) == localTime(2026, 3, 30, 2, 30));
+}
+
+// Выдача наступивших заданий по порядку и перенос повторяющихся
+static void testPoll()
+{
+    ScheduleQueue queue;
+    ScheduleEntry entry;
+    FakeClock clock = {localTime(2026, 10, 19, 6, 0)};
+
+    queue.clear();
+    CHECK(queue.add(repeating(SCHEDULE_DAILY, 7, 0, 10), clock.now) == 1);
+    CHECK(queue.add(once(localTime(2026, 10, 19, 6, 30), 20), clock.now) == 2);
+    CHECK(queue.add(repeating(SCHEDULE_DAILY, 6, 45, 30), clock.now) == 3);
+    CHECK(queue.nextDue() == localTime(2026, 10, 19, 6, 30));
+
+    clock.set(localTime(2026, 10, 19, 6, 29, 59));
+    CHECK(queue.poll(clock.now, entry) == SCHEDULE_IDLE);
+
+    // В одном опросе - все наступившие, по времени
+    clock.set(localTime(2026, 10, 19, 7, 0));
+    CHECK(queue.poll(clock.now, entry) == SCHEDULE_MISSED && entry.code == 20); // Опоздание 30 мин
+    CHECK(queue.poll(clock.now, entry) == SCHEDULE_MISSED && entry.code == 30);
+    CHECK(queue.poll(clock.now, entry) == SCHEDULE_FIRE && entry.code == 10 && entry.id == 1);
+    CHECK(queue.poll(clock.now, entry) == SCHEDULE_IDLE);
+
+    // Разовое задание удалено, повторяющиеся перенесены на завтра
+    CHECK(queue.count() == 2);
+    CHECK(queue.nextDue() == localTime(2026, 10, 20, 6, 45));
+
+    // Удаление из середины кучи
+    CHECK(queue.remove(3));
+    CHECK(!queue.remove(3));
+    CHECK(queue.nextDue() == localTime(2026, 10, 20, 7, 0));
+
+    // Освободившийся id выдается снова
+    CHECK(queue.add(repeating(SCHEDULE_DAILY, 8, 0, 40), clock.now) == 2);
+}
+
+// Окно SCHEDULE_GRACE_SEC: опоздание в его пределах - выполнение, больше - пропуск
+static void testGrace()
+{
+    ScheduleQueue queue;
+    ScheduleEntry entry;
+    time_t at = localTime(2026, 10, 19, 7, 0);
+
+    queue.clear();
+    queue.add(once(at, 1), at - 60);
+    CHECK(queue.poll(at + SCHEDULE_GRACE_SEC, entry) == SCHEDULE_FIRE);
+    CHECK(queue.count() == 0);
+
+    queue.add(once(at, 1), at - 60);
+    CHECK(queue.poll(at + SCHEDULE_GRACE_SEC + 1, entry) == SCHEDULE_MISSED);
+    CHECK(queue.count() == 0);
+
+    // Повторяющееся задание после простоя в несколько дней сообщает об одном пропуске,
+    // а не о каждом пропущенном срабатывании
+    queue.add(repeating(SCHEDULE_DAILY, 7, 0, 2), at - 60);
+    time_t late = localTime(2026, 10, 22, 12, 0);
+    CHECK(queue.poll(late, entry) == SCHEDULE_MISSED);
+    CHECK(queue.poll(late, entry) == SCHEDULE_IDLE);
+    CHECK(queue.nextDue() == localTime(2026, 10, 23, 7, 0));
+}
+
+// Часы переведены назад (первая синхронизация SNTP): сроки пересчитываются от нового времени
+static void testClockJumpBack()
+{
+    ScheduleQueue queue;
+    ScheduleEntry entry;
+    FakeClock clock = {localTime(2027, 1, 1, 12, 0)}; // Неверное время до синхронизации
+
+    queue.clear();
+    queue.add(repeating(SCHEDULE_DAILY, 7, 0, 1), clock.now);
+    CHECK(queue.poll(clock.now, entry) == SCHEDULE_IDLE);
+    CHECK(queue.nextDue() == localTime(2027, 1, 2, 7, 0));
+
+    // Небольшой откат в пределах окна не пересчитывает сроки
+    clock.advance(-SCHEDULE_GRACE_SEC);
+    CHECK(queue.poll(clock.now, entry) == SCHEDULE_IDLE);
+    CHECK(queue.nextDue() == localTime(2027, 1, 2, 7, 0));
+
+    clock.set(localTime(2026, 10, 19, 6, 0));
+    CHECK(queue.poll(clock.now, entry) == SCHEDULE_IDLE);
+    CHECK(queue.nextDue() == localTime(2026, 10, 19, 7, 0));
+
+    clock.set(localTime(2026, 10, 19, 7, 0));
+    CHECK(queue.poll(clock.now, entry) == SCHEDULE_FIRE);
+
+    // Явный пересчет после перевода часов вперед
+    clock.set(localTime(2026, 10, 21, 9, 0));
+    queue.rebuild(clock.now);
+    CHECK(queue.nextDue() == localTime(2026, 10, 22, 7, 0));
+    CHECK(queue.poll(clock.now, entry) == SCHEDULE_IDLE);
+}
+
+// Неделя по минутам: каждое задание срабатывает в свои дни ровно один раз и без опозданий
+static void testWeekRun()
+{
+    ScheduleQueue queue;
+    ScheduleEntry entry;
+    FakeClock clock = {localTime(2026, 10, 19, 0, 0)}; // Понедельник; неделя с переходом 25 октября
+    int fired[4] = {0, 0, 0, 0};
+    int missed = 0;
+
+    queue.clear();
+    queue.add(repeating(SCHEDULE_DAILY, 7, 0, 1), clock.now);
+    queue.add(repeating(SCHEDULE_WEEKDAYS, 8, 15, 2), clock.now);
+    queue.add(repeating(SCHEDULE_WEEKENDS, 23, 59, 3), clock.now);
+
+    for (int minute = 0; minute < 7 * 24 * 60 + 60; minute++)
+    {
+        ScheduleResult result;
+        while ((result = queue.poll(clock.now, entry)) != SCHEDULE_IDLE)
+        {
+            if (result == SCHEDULE_FIRE)
+                fired[entry.code]++;
+            else
+                missed++;
+        }
+        clock.advance(60);
+    }
+
+    CHECK(fired[1] == 7);
+    CHECK(fired[2] == 5);
+    CHECK(fired[3] == 2);
+    CHECK(missed == 0);
+}
+
+// Строка файла расписания читается обратно без потерь
+static void testLineRoundTrip()
+{
+    ScheduleEntry entry = once(localTime(2026, 12, 31, 23, 59), 77);
+    ScheduleEntry parsed;
+    char line[SCHEDULE_LINE_LEN];
+
+    entry.id = 9;
+    entry.channel = 2;
+    scheduleFormatLine(entry, line, sizeof(line));
+    CHECK(scheduleParseLine(line, parsed));
+    CHECK(parsed.id == 9 && parsed.days == 0 && parsed.minute == entry.minute && parsed.at == entry.at &&
+          parsed.code == 77 && parsed.channel == 2);
+    CHECK(!scheduleParseLine("0 127 420 0 5 -1", parsed)); // id 0 - свободная ячейка
+}
+
+int main()
+{
+    setenv("TZ", TEST_TZ, 1);
+    tzset();
+
+    testWeekdays();
+    testDst();
+    testPoll();
+    testGrace();
+    testClockJumpBack();
+    testWeekRun();
+    testLineRoundTrip();
+
+    if (failures == 0)
+        printf("schedule_queue: all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,343 @@
+// Хостовый тест потокового разбора getUpdates: ответ подается целиком и кусками любой длины,
+// проверяются экранирование, callback_query, документы, обрезка длинного текста и ошибки синтаксиса.
+// Выделения памяти считаются через --wrap=malloc (см. test/CMakeLists.txt) и operator new:
+// парсер работает в фиксированных буферах и не должен выделять ничего
+#include "telegram_update_parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if (!(cond))                                                        \
+        {                                                                   \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+// --- Учет кучи: перед блоком - его размер ---
+#define HEAP_HEADER 16
+
+static size_t heapLive = 0;
+static size_t heapPeak = 0;
+static size_t heapCalls = 0;
+
+extern "C" void *__real_malloc(size_t size);
+extern "C" void *__real_realloc(void *ptr, size_t size);
+extern "C" void __real_free(void *ptr);
+
+static void *heapTrack(void *block, size_t size)
+{
+    if (block == NULL)
+        return NULL;
+
+    *(size_t *)block = size;
+    heapLive += size;
+    heapCalls++;
+    if (heapLive > heapPeak)
+        heapPeak = heapLive;
+    return (uint8_t *)block + HEAP_HEADER;
+}
+
+extern "C" void *__wrap_malloc(size_t size)
+{
+    return heapTrack(__real_malloc(size + HEAP_HEADER), size);
+}
+
+extern "C" void *__wrap_calloc(size_t count, size_t size)
+{
+    void *ptr = __wrap_malloc(count * size);
+    if (ptr != NULL)
+        memset(ptr, 0, count * size);
+    return ptr;
+}
+
+extern "C" void __wrap_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+
+    uint8_t *block = (uint8_t *)ptr - HEAP_HEADER;
+    heapLive -= *(size_t *)block;
+    __real_free(block);
+}
+
+extern "C" void *__wrap_realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+        return __wrap_malloc(size);
+
+    uint8_t *block = (uint8_t *)ptr - HEAP_HEADER;
+    size_t old = *(size_t *)block;
+    void *moved = __real_realloc(block, size + HEAP_HEADER);
+
+    if (moved == NULL)
+        return NULL;
+
+    heapLive -= old;
+    return heapTrack(moved, size);
+}
+
+void *operator new(size_t size)
+{
+    void *ptr = __wrap_malloc(size);
+    if (ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    __wrap_free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    __wrap_free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    __wrap_free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    __wrap_free(ptr);
+}
+
+// Максимум кучи сверх уже занятого за все разборы теста
+static size_t parsePeak = 0;
+static size_t parseCalls = 0;
+
+// Разбор ответа кусками по chunk байт; 0 - целиком
+static bool parse(const char *json, size_t chunk, TelegramUpdate *updates, uint8_t maxUpdates, uint8_t &count)
+{
+    static TelegramUpdateParser parser;
+    size_t len = strlen(json);
+    size_t baseline = heapLive;
+    size_t calls = heapCalls;
+
+    heapPeak = heapLive;
+    parser.begin(updates, maxUpdates);
+
+    bool fed = true;
+    for (size_t pos = 0; pos < len && fed; pos += chunk ? chunk : len)
+    {
+        size_t n = chunk && len - pos > chunk ? chunk : len - pos;
+        fed = parser.feed((const uint8_t *)json + pos, n);
+    }
+
+    if (heapPeak - baseline > parsePeak)
+        parsePeak = heapPeak - baseline;
+    parseCalls += heapCalls - calls;
+
+    count = parser.count();
+    return fed && parser.ok();
+}
+
+// Поля обновления; байты буферов после '\0' не сравниваются
+static bool sameUpdate(const TelegramUpdate &a, const TelegramUpdate &b)
+{
+    return a.updateId == b.updateId && a.chatId == b.chatId && strcmp(a.text, b.text) == 0 &&
+           a.oversized == b.oversized && a.isCallback == b.isCallback && strcmp(a.callbackId, b.callbackId) == 0 &&
+           a.messageId == b.messageId && strcmp(a.fileId, b.fileId) == 0 && a.replayed == b.replayed;
+}
+
+// Разбор всеми длинами кусков: результат не должен зависеть от того, как пришли байты
+static bool parseAllChunks(const char *json, TelegramUpdate *updates, uint8_t maxUpdates, uint8_t &count)
+{
+    TelegramUpdate reference[TG_MAX_UPDATES];
+    uint8_t referenceCount;
+    bool ok = parse(json, 0, reference, maxUpdates, referenceCount);
+
+    for (size_t chunk = 1; chunk <= strlen(json); chunk++)
+    {
+        bool chunkOk = parse(json, chunk, updates, maxUpdates, count);
+
+        CHECK(chunkOk == ok && count == referenceCount);
+        for (uint8_t i = 0; i < count && i < referenceCount; i++)
+            CHECK(sameUpdate(updates[i], reference[i]));
+    }
+
+    memcpy(updates, reference, sizeof(reference));
+    count = referenceCount;
+    return ok;
+}
+
+static void testMessages()
+{
+    TelegramUpdate updates[TG_MAX_UPDATES];
+    uint8_t count;
+
+    memset(updates, 0, sizeof(updates));
+
+    const char *json =
+        "{\"ok\":true,\"result\":[\n"
+        "{\"update_id\":700001,\"message\":{\"message_id\":5,\"from\":{\"id\":42,\"is_bot\":false,\"first_name\":\"A\"},"
+        "\"chat\":{\"id\":-1001234567890,\"type\":\"supergroup\"},\"date\":1760000000,\"text\":\"5@2\","
+        "\"entities\":[{\"offset\":0,\"length\":3,\"type\":\"bot_command\"}]}},\n"
+        "{\"update_id\":700002,\"message\":{\"message_id\":6,\"chat\":{\"id\":42},\"text\":\"/status\"}}\n"
+        "]}";
+
+    CHECK(parseAllChunks(json, updates, TG_MAX_UPDATES, count));
+    CHECK(count == 2);
+    CHECK(updates[0].updateId == 700001 && updates[0].chatId == -1001234567890LL);
+    CHECK(strcmp(updates[0].text, "5@2") == 0 && !updates[0].isCallback && !updates[0].oversized);
+    CHECK(updates[0].fileId[0] == '\0' && !updates[0].replayed);
+    CHECK(updates[1].updateId == 700002 && updates[1].chatId == 42 && strcmp(updates[1].text, "/status") == 0);
+
+    // Пустой ответ
+    CHECK(parseAllChunks("{\"ok\":true,\"result\":[]}", updates, TG_MAX_UPDATES, count));
+    CHECK(count == 0);
+}
+
+// Экранированные кавычки, управляющие символы и \u, в том числе суррогатная пара
+static void testEscapes()
+{
+    TelegramUpdate updates[TG_MAX_UPDATES];
+    uint8_t count;
+
+    const char *json =
+        "{\"ok\":true,\"result\":[{\"update_id\":1,\"message\":{\"chat\":{\"id\":1},"
+        "\"text\":\"say \\\"hi\\\" \\\\ \\/ \\n\\t\\u0041\\u00e9\\u043f\\ud83d\\ude00 \xd0\xbf\"}}]}";
+
+    CHECK(parseAllChunks(json, updates, TG_MAX_UPDATES, count));
+    CHECK(count == 1);
+    CHECK(strcmp(updates[0].text, "say \"hi\" \\ / \n\tA\xc3\xa9\xd0\xbf\xf0\x9f\x98\x80 \xd0\xbf") == 0);
+
+    // Экранирование в ключе и в неинтересном значении не мешает разбору
+    json = "{\"ok\":true,\"result\":[{\"update_id\":2,\"message\":{\"chat\":{\"id\":1},"
+           "\"caption\":\"\\\"}]\\\"\",\"te\\u0078t\":\"x\",\"text\":\"ok\"}}]}";
+    CHECK(parseAllChunks(json, updates, TG_MAX_UPDATES, count));
+    CHECK(count == 1 && strcmp(updates[0].text, "ok") == 0);
+}
+
+// Нажатие кнопки: клавиатура сообщения вложена на 9 уровней
+static void testCallbackQuery()
+{
+    TelegramUpdate updates[TG_MAX_UPDATES];
+    uint8_t count;
+
+    const char *json =
+        "{\"ok\":true,\"result\":[{\"update_id\":800,\"callback_query\":{\"id\":\"4382bfdwdsb323b2d9\","
+        "\"from\":{\"id\":42},\"message\":{\"message_id\":77,\"chat\":{\"id\":-100500},\"text\":\"IR remote\","
+        "\"reply_markup\":{\"inline_keyboard\":[[{\"text\":\"tv.power\",\"callback_data\":\"c:1\"}]]}},"
+        "\"chat_instance\":\"-1\",\"data\":\"c:12\"}}]}";
+
+    CHECK(parseAllChunks(json, updates, TG_MAX_UPDATES, count));
+    CHECK(count == 1);
+    CHECK(updates[0].isCallback && updates[0].updateId == 800);
+    CHECK(strcmp(updates[0].callbackId, "4382bfdwdsb323b2d9") == 0);
+    CHECK(strcmp(updates[0].text, "c:12") == 0); // Не текст сообщения с клавиатурой
+    CHECK(updates[0].messageId == 77 && updates[0].chatId == -100500);
+}
+
+// Документ: file_id самого документа, а не его миниатюры
+static void testDocument()
+{
+    TelegramUpdate updates[TG_MAX_UPDATES];
+    uint8_t count;
+
+    const char *json =
+        "{\"ok\":true,\"result\":[{\"update_id\":900,\"message\":{\"message_id\":3,\"chat\":{\"id\":7},"
+        "\"document\":{\"file_name\":\"tv.ir\",\"thumbnail\":{\"file_id\":\"THUMB\"},"
+        "\"file_id\":\"BQACAgIAAxkBAAIBY2ZfXyz\",\"file_size\":2048},\"caption\":\"/import\"}}]}";
+
+    CHECK(parseAllChunks(json, updates, TG_MAX_UPDATES, count));
+    CHECK(count == 1);
+    CHECK(strcmp(updates[0].fileId, "BQACAgIAAxkBAAIBY2ZfXyz") == 0);
+    CHECK(updates[0].text[0] == '\0' && updates[0].chatId == 7);
+}
+
+// Длинный текст обрезается до TG_MAX_TEXT_LEN с признаком oversized, разбор продолжается
+static void testOversized()
+{
+    static char json[2048];
+    TelegramUpdate updates[TG_MAX_UPDATES];
+    uint8_t count;
+    char text[TG_MAX_TEXT_LEN + 50];
+
+    memset(text, 'a', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    snprintf(json, sizeof(json),
+             "{\"ok\":true,\"result\":[{\"update_id\":1,\"message\":{\"chat\":{\"id\":1},\"text\":\"%s\"}},"
+             "{\"update_id\":2,\"message\":{\"chat\":{\"id\":1},\"text\":\"short\"}}]}",
+             text);
+
+    CHECK(parseAllChunks(json, updates, TG_MAX_UPDATES, count));
+    CHECK(count == 2);
+    CHECK(updates[0].oversized && strlen(updates[0].text) == TG_MAX_TEXT_LEN);
+    CHECK(!updates[1].oversized && strcmp(updates[1].text, "short") == 0);
+
+    // Обновления сверх буфера пропускаются и придут снова
+    TelegramUpdate one[1];
+    TelegramUpdateParser parser;
+    parser.begin(one, 1);
+    CHECK(parser.feed((const uint8_t *)json, strlen(json)) && parser.ok());
+    CHECK(parser.count() == 1 && parser.lastUpdateId() == 1);
+}
+
+static void testMalformed()
+{
+    static const char *const bad[] = {
+        "{\"ok\":true,\"result\":[{\"update_id\" 1}]}",             // Нет ':'
+        "{\"ok\":true,\"result\":[{\"update_id\":}]}",              // Нет значения
+        "{\"ok\":true,\"result\":[{\"update_id\":1]}",              // Скобки не совпадают
+        "{\"ok\":true,\"result\":[{\"text\":\"\\x\"}]}",             // Неизвестное экранирование
+        "{\"ok\":true,\"result\":[{\"text\":\"\\u12G4\"}]}",         // Не шестнадцатеричная цифра
+        "{\"ok\":true,\"result\":[{\"update_id\":1}]}}",            // Лишняя скобка
+        "{\"ok\":true,\"result\":[{\"update_id\":1}]",              // Ответ оборван
+        "{\"ok\":false,\"error_code\":409,\"description\":\"x\"}", // Ошибка сервера
+        "<html>502 Bad Gateway</html>",
+        "",
+        "[[[[[[[[[[[[[1]]]]]]]]]]]]]", // Глубже TG_PARSER_MAX_DEPTH
+    };
+    TelegramUpdate updates[TG_MAX_UPDATES];
+    uint8_t count;
+
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    {
+        bool ok = parseAllChunks(bad[i], updates, TG_MAX_UPDATES, count);
+        if (ok)
+            printf("accepted malformed input %u: %s\n", (unsigned)i, bad[i]);
+        CHECK(!ok);
+    }
+}
+
+int main()
+{
+    // Учет кучи работает: иначе нулевой пик ничего не доказывает
+    size_t live = heapLive;
+    void *volatile block = malloc(100);
+    CHECK(heapLive == live + 100);
+    free(block);
+    CHECK(heapLive == live);
+
+    testMessages();
+    testEscapes();
+    testCallbackQuery();
+    testDocument();
+    testOversized();
+    testMalformed();
+
+    printf("telegram_update_parser: peak heap while parsing %u bytes in %u allocations; "
+           "parser state %u bytes, update buffer %u bytes\n",
+           (unsigned)parsePeak, (unsigned)parseCalls, (unsigned)sizeof(TelegramUpdateParser),
+           (unsigned)(TG_MAX_UPDATES * sizeof(TelegramUpdate)));
+    CHECK(parsePeak == 0 && parseCalls == 0);
+
+    if (failures == 0)
+        printf("telegram_update_parser: all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,398 @@
+// Хостовое воспроизведение трассы: записи разбираются так же, как задачей воспроизведения
+// устройства (буфер дочитывается кусками, запись может быть разорвана границей), отбираются
+// traceReplayKind и ставятся в CommandQueue, а имитация основного цикла выдает задания.
+// Без аргументов проверяется синтетическая трасса; с путем к файлу трассы с SD-карты
+// печатается отчет по ней: test_trace_replay trace.bin [ускорение]
+#include "trace_format.h"
+#include "command_queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if (!(cond))                                                        \
+        {                                                                   \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+#define REPLAY_SOURCE 3      // CMD_SOURCE_REPLAY (ir_command.h зависит от Arduino)
+#define REPLAY_SPEED 10      // Ускорение по умолчанию, как у /trace replay
+#define REPLAY_JOB_MS 50     // Обработка одного задания основным циклом
+#define REPLAY_READ_LEN 1024 // Буфер чтения, как TRACE_READ_LEN задачи воспроизведения
+#define NAME_LEN 32
+
+// Известные имена кодов вместо индекса имен устройства
+struct KnownName
+{
+    const char *name;
+    int id;
+};
+
+static const KnownName knownNames[] = {{"tv.power", 7}, {"ac.off", 8}};
+
+static int findName(const char *name)
+{
+    for (size_t i = 0; i < sizeof(knownNames) / sizeof(knownNames[0]); i++)
+        if (strcmp(knownNames[i].name, name) == 0)
+            return knownNames[i].id;
+    return -1;
+}
+
+struct ReplayStats
+{
+    uint32_t records;
+    uint32_t updates;
+    uint32_t captures;
+    uint32_t skipped;  // Обновления, не прошедшие отбор
+    uint32_t commands; // Команды только для чтения: обрабатываются без очереди
+    uint32_t codes;    // Коды, поставленные в очередь или объединенные
+    uint32_t rejected; // Очередь или доля источника заполнена
+    uint32_t traceMs;
+    uint32_t replayMs; // Виртуальное время до выдачи последнего задания
+    bool error;
+};
+
+// Имитация основного цикла: одно задание за REPLAY_JOB_MS
+struct FakeLoop
+{
+    uint32_t busyUntil;
+
+    void drain(CommandQueue &queue, uint32_t now)
+    {
+        CommandJob job;
+
+        while (busyUntil <= now && queue.pop(now, job))
+            busyUntil = (busyUntil > now ? busyUntil : now) + REPLAY_JOB_MS;
+    }
+};
+
+static void replayUpdate(const TelegramUpdate &update, CommandQueue &queue, uint32_t now, ReplayStats &stats)
+{
+    char name[NAME_LEN];
+    int id;
+    TraceReplayKind kind = traceReplayKind(update, id, name, sizeof(name));
+
+    if (kind == TRACE_REPLAY_CODE_NAME)
+    {
+        id = findName(name);
+        kind = id > 0 ? TRACE_REPLAY_CODE_ID : TRACE_REPLAY_SKIP;
+    }
+
+    if (kind == TRACE_REPLAY_SKIP)
+        stats.skipped++;
+    else if (kind == TRACE_REPLAY_COMMAND)
+        stats.commands++;
+    else
+    {
+        CommandPushResult result = queue.push(id, REPLAY_SOURCE, -1, COMMAND_PRIORITY_NORMAL, now);
+
+        if (result == COMMAND_QUEUED || result == COMMAND_COALESCED)
+            stats.codes++;
+        else
+            stats.rejected++;
+    }
+}
+
+// Воспроизведение трассы из памяти: в буфер чтения подается не больше chunk байт за раз
+static ReplayStats replay(const uint8_t *trace, size_t size, size_t chunk, uint16_t speed, CommandQueue &queue)
+{
+    static uint8_t buf[REPLAY_READ_LEN];
+    static TraceRecord record;
+    ReplayStats stats;
+    FakeLoop loop = {0};
+    uint32_t startTime;
+    size_t offset = TRACE_HEADER_LEN;
+    size_t len = 0;
+
+    memset(&stats, 0, sizeof(stats));
+    queue.clear();
+
+    if (size < TRACE_HEADER_LEN || !traceDecodeHeader(trace, size, startTime))
+    {
+        stats.error = true;
+        return stats;
+    }
+
+    for (;;)
+    {
+        int n = traceDecodeRecord(buf, len, record);
+
+        if (n < 0)
+        {
+            stats.error = true;
+            break;
+        }
+
+        if (n == 0)
+        {
+            size_t got = size - offset;
+            if (got == 0)
+                break;
+            if (got > chunk)
+                got = chunk;
+            if (got > sizeof(buf) - len)
+                got = sizeof(buf) - len;
+
+            memcpy(buf + len, trace + offset, got);
+            offset += got;
+            len += got;
+            continue;
+        }
+
+        memmove(buf, buf + n, len - n);
+        len -= n;
+
+        if (record.type == 0)
+            continue;
+
+        stats.records++;
+        stats.traceMs += record.deltaMs;
+
+        uint32_t now = speed == 0 ? 0 : stats.traceMs / speed;
+        loop.drain(queue, now);
+
+        if (record.type == TRACE_RECORD_UPDATE)
+        {
+            stats.updates++;
+            replayUpdate(record.update, queue, now, stats);
+        }
+        else
+            stats.captures++; // Кадры на устройстве только учитываются в статистике приемника
+    }
+
+    // Остаток очереди основной цикл выдает после последней записи
+    uint32_t now = speed == 0 ? 0 : stats.traceMs / speed;
+    while (queue.count() > 0)
+    {
+        loop.drain(queue, now);
+        now = loop.busyUntil;
+    }
+    stats.replayMs = now;
+    return stats;
+}
+
+static void printReport(const ReplayStats &stats, const CommandQueue &queue)
+{
+    const CommandQueueStats &q = queue.stats();
+    uint32_t handled = q.dispatched > 0 ? q.dispatched : 1;
+
+    printf("records %lu (updates %lu, captures %lu), skipped %lu, commands %lu, codes %lu, rejected %lu\n",
+           (unsigned long)stats.records, (unsigned long)stats.updates, (unsigned long)stats.captures,
+           (unsigned long)stats.skipped, (unsigned long)stats.commands, (unsigned long)stats.codes,
+           (unsigned long)stats.rejected);
+    printf("queue: queued %lu, coalesced %lu, dispatched %lu, max depth %u, wait avg %lu ms, max %lu ms\n",
+           (unsigned long)q.queued, (unsigned long)q.coalesced, (unsigned long)q.dispatched, (unsigned)q.maxDepth,
+           (unsigned long)(q.waitSumMs / handled), (unsigned long)q.waitMaxMs);
+    printf("trace %lu ms, replay %lu ms (virtual), speedup %.1f\n", (unsigned long)stats.traceMs,
+           (unsigned long)stats.replayMs, stats.replayMs > 0 ? (double)stats.traceMs / stats.replayMs : 0.0);
+}
+
+// Синтетическая трасса
+struct TraceWriter
+{
+    uint8_t data[16384];
+    size_t len;
+
+    void header() { len = traceEncodeHeader(data, sizeof(data), 1760000000); }
+
+    void update(uint32_t deltaMs, uint8_t batchIndex, uint8_t batchSize, const char *text, bool callback = false,
+                const char *fileId = "")
+    {
+        static uint32_t updateId = 1000;
+        TelegramUpdate u;
+
+        memset(&u, 0, sizeof(u));
+        u.updateId = updateId++;
+        u.chatId = -100123;
+        u.isCallback = callback;
+        u.messageId = 42;
+        strcpy(u.text, text);
+        strcpy(u.fileId, fileId);
+        if (callback)
+            strcpy(u.callbackId, "cb");
+
+        size_t n = traceEncodeUpdate(data + len, sizeof(data) - len, deltaMs, batchIndex, batchSize, u);
+        CHECK(n > 0);
+        len += n;
+    }
+
+    void capture(uint32_t deltaMs, uint64_t value, bool repeat)
+    {
+        TraceCapture c = {3, value, 0x10, 0x20, 32, 68, repeat};
+        size_t n = traceEncodeCapture(data + len, sizeof(data) - len, deltaMs, c);
+        CHECK(n > 0);
+        len += n;
+    }
+};
+
+// Отбор обновлений трассы
+static void testReplayKind()
+{
+    TelegramUpdate u;
+    char name[NAME_LEN];
+    int id;
+
+    memset(&u, 0, sizeof(u));
+
+    strcpy(u.text, "5");
+    CHECK(traceReplayKind(u, id, name, sizeof(name)) == TRACE_REPLAY_CODE_ID && id == 5);
+    strcpy(u.text, "12@3");
+    CHECK(traceReplayKind(u, id, name, sizeof(name)) == TRACE_REPLAY_CODE_ID && id == 12);
+    strcpy(u.text, "0");
+    CHECK(traceReplayKind(u, id, name, sizeof(name)) == TRACE_REPLAY_SKIP);
+    strcpy(u.text, "5@0");
+    CHECK(traceReplayKind(u, id, name, sizeof(name)) == TRACE_REPLAY_SKIP);
+    strcpy(u.text, "5@x");
+    CHECK(traceReplayKind(u, id, name, sizeof(name)) == TRACE_REPLAY_SKIP);
+
+    strcpy(u.text, "TV.Power@2");
+    CHECK(traceReplayKind(u, id, name, sizeof(name)) == TRACE_REPLAY_CODE_NAME && strcmp(name, "tv.power") == 0);
+    strcpy(u.text, "hello world"); // Имя для /learn batch и прочий текст не воспроизводятся
+    CHECK(traceReplayKind(u, id, name, sizeof(name)) == TRACE_REPLAY_SKIP);
+    strcpy(u.text, "a_name_that_is_longer_than_the_buffer");
+    CHECK(traceReplayKind(u, id, name, sizeof(name)) == TRACE_REPLAY_SKIP);
+
+    strcpy(u.text, "/STATUS");
+    CHECK(traceReplayKind(u, id, name, sizeof(name)) == TRACE_REPLAY_COMMAND);
+    strcpy(u.text, "/learn batch");
+    CHECK(traceReplayKind(u, id, name, sizeof(name)) == TRACE_REPLAY_SKIP);
+    strcpy(u.text, "/allclear");
+    CHECK(traceReplayKind(u, id, name, sizeof(name)) == TRACE_REPLAY_SKIP);
+
+    u.isCallback = true;
+    strcpy(u.text, "c:9");
+    CHECK(traceReplayKind(u, id, name, sizeof(name)) == TRACE_REPLAY_CODE_ID && id == 9);
+    strcpy(u.text, "p:1"); // Листание клавиатуры
+    CHECK(traceReplayKind(u, id, name, sizeof(name)) == TRACE_REPLAY_SKIP);
+    u.isCallback = false;
+
+    strcpy(u.text, "5");
+    strcpy(u.fileId, "BQACAgIAAxkBAAI");
+    CHECK(traceReplayKind(u, id, name, sizeof(name)) == TRACE_REPLAY_SKIP);
+    u.fileId[0] = '\0';
+    u.oversized = true;
+    CHECK(traceReplayKind(u, id, name, sizeof(name)) == TRACE_REPLAY_SKIP);
+}
+
+// Трасса с пакетами, кадрами приемника и пропускаемыми обновлениями
+static void testSyntheticTrace()
+{
+    static TraceWriter w;
+    CommandQueue queue;
+
+    w.header();
+
+    // При ускорении 10: 1 выдается сразу, 5 ждет и второй раз объединяется с первым
+    w.update(1000, 0, 3, "1");
+    w.update(0, 1, 3, "5");
+    w.update(0, 2, 3, "5");
+    w.capture(200, 0x20DF10EF, false);
+    w.capture(110, 0x20DF10EF, true);
+
+    w.update(700, 0, 9, "tv.power@2");
+    w.update(0, 1, 9, "unknown.name");
+    w.update(0, 2, 9, "hello world");
+    w.update(0, 3, 9, "/allclear");
+    w.update(0, 4, 9, "/status");
+    w.update(0, 5, 9, "c:9", true);
+    w.update(0, 6, 9, "p:1", true);
+    w.update(0, 7, 9, "", false, "BQACAgIAAxkBAAI");
+    w.update(0, 8, 9, "5@2");
+
+    // Пакет из 12 разных кодов: еще ждут 9 и 5@2, поэтому в долю источника помещаются 8,
+    // остальные 4 отклоняются
+    for (int i = 0; i < 12; i++)
+    {
+        char text[8];
+        snprintf(text, sizeof(text), "%d", 20 + i);
+        w.update(i == 0 ? 2000 : 0, i, 12, text);
+    }
+
+    ReplayStats whole = replay(w.data, w.len, sizeof(w.data), REPLAY_SPEED, queue);
+    const CommandQueueStats &q = queue.stats();
+
+    CHECK(!whole.error);
+    CHECK(whole.records == 2 + 12 + 12);
+    CHECK(whole.captures == 2);
+    CHECK(whole.traceMs == 4010);
+    CHECK(whole.commands == 1);
+    CHECK(whole.skipped == 5); // unknown.name, hello world, /allclear, p:1, документ
+    CHECK(whole.codes == 14 && whole.rejected == 4);
+    CHECK(q.queued == 13 && q.coalesced == 1 && q.dispatched == 13);
+    CHECK(q.maxDepth == COMMAND_SOURCE_MAX);
+    printReport(whole, queue);
+
+    // Разбор кусками по 7 байт: записи разрываются границей буфера, результат тот же
+    CommandQueue chunked;
+    ReplayStats split = replay(w.data, w.len, 7, REPLAY_SPEED, chunked);
+    CHECK(!split.error);
+    CHECK(memcmp(&split, &whole, sizeof(split)) == 0);
+    CHECK(chunked.stats().coalesced == q.coalesced && chunked.stats().dispatched == q.dispatched);
+
+    // Обрезанная трасса: последняя запись не разбирается, но ошибкой это не считается
+    CommandQueue cut;
+    ReplayStats truncated = replay(w.data, w.len - 3, 64, REPLAY_SPEED, cut);
+    CHECK(!truncated.error && truncated.records == whole.records - 1);
+
+    // Испорченная длина записи - ошибка формата
+    static uint8_t broken[sizeof(w.data)];
+    memcpy(broken, w.data, w.len);
+    broken[TRACE_HEADER_LEN] = 0x7F;
+    broken[TRACE_HEADER_LEN + 1] = 0xFF;
+    broken[TRACE_HEADER_LEN + 2] = 0xFF;
+    broken[TRACE_HEADER_LEN + 3] = 0xFF;
+    broken[TRACE_HEADER_LEN + 4] = 0x7F;
+    CommandQueue bad;
+    CHECK(replay(broken, w.len, 64, REPLAY_SPEED, bad).error);
+}
+
+static int replayFile(const char *path, uint16_t speed)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        printf("cannot open %s\n", path);
+        return 1;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t *trace = (uint8_t *)malloc(size > 0 ? size : 1);
+    size_t got = trace != NULL ? fread(trace, 1, size, f) : 0;
+    fclose(f);
+
+    CommandQueue queue;
+    clock_t start = clock();
+    ReplayStats stats = replay(trace, got, REPLAY_READ_LEN, speed, queue);
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    free(trace);
+    printReport(stats, queue);
+    printf("decoded in %.3f s (%.0f records/s)\n", seconds, seconds > 0 ? stats.records / seconds : 0.0);
+
+    if (stats.error)
+        printf("%s: format error after %lu records\n", path, (unsigned long)stats.records);
+    return stats.error ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+        return replayFile(argv[1], argc > 2 ? atoi(argv[2]) : REPLAY_SPEED);
+
+    testReplayKind();
+    testSyntheticTrace();
+
+    if (failures == 0)
+        printf("trace_replay: all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""Convert IR code files between the text format and the binary format of the firmware.
+
+Text format (dataCodes.txt, /export): one code per line, "id protocol address command [bits]".
+Binary format (codes.bin, /devices/<name>.bin): see src/code_format.h.
+
+    python3 tools/codes_convert.py dataCodes.txt codes.bin --names codeNames.txt
+    python3 tools/codes_convert.py codes.bin codes.txt
+    python3 tools/codes_convert.py --compare dataCodes.txt
+
+The direction is chosen by the input: a file starting with the magic "IRCD" is binary.
+--names embeds names ("name id" lines, as in codeNames.txt) for the converted codes into the
+binary file; the firmware moves them into its name index on first use of the file.
+--compare writes nothing and prints the size of both formats. Parse time is measured on the
+device, where it matters: /status shows it for binary files and for text files migrated at boot.
+
+Only the Python standard library is used.
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = b"IRCD"
+VERSION = 1
+HEADER = struct.Struct("<4sBBHIiII")  # magic, version, flags, reserved, count, last id, records end, crc
+FLAG_NAMES = 0x01
+RECORD_FIELDS = 5  # id delta, protocol, address, command, bits
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        b = value & 0x7F
+        value >>= 7
+        out.append(b | 0x80 if value else b)
+        if not value:
+            return bytes(out)
+
+
+def read_varint(data, pos):
+    value = shift = 0
+    while True:
+        if pos >= len(data) or shift > 63:
+            raise ValueError("truncated varint at %d" % pos)
+        b = data[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            return value, pos
+
+
+def zigzag(value):
+    return (value << 1) ^ (value >> 63) if value < 0 else value << 1
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def parse_text(data):
+    """Records (id, protocol, address, command, bits); malformed lines are skipped like the firmware does."""
+    records = []
+    for line in data.decode("ascii", "replace").splitlines():
+        parts = line.split()
+        try:
+            fields = [int(p) for p in parts[:5]]
+        except ValueError:
+            continue
+        if len(fields) < 4 or fields[0] <= 0:
+            continue
+        records.append(tuple(fields) if len(fields) == 5 else tuple(fields) + (0,))
+    return records
+
+
+def encode_text(records):
+    lines = []
+    for code_id, protocol, address, command, bits in records:
+        line = "%d %d %d %d" % (code_id, protocol, address, command)
+        lines.append(line + (" %d" % bits if bits else "") + "\r\n")
+    return "".join(lines).encode("ascii")
+
+
+def encode_binary(records, names):
+    body = bytearray()
+    prev = 0
+    for code_id, protocol, address, command, bits in records:
+        data = b"".join(varint(v) for v in (zigzag(code_id - prev), zigzag(protocol), address, command, bits))
+        body += varint(len(data)) + data
+        prev = code_id
+
+    flags = 0
+    tail = b""
+    if names:
+        flags |= FLAG_NAMES
+        tail = varint(len(names)) + b"".join(
+            varint(code_id) + varint(len(name)) + name.encode("ascii") for name, code_id in names)
+
+    header = HEADER.pack(MAGIC, VERSION, flags, 0, len(records), prev, HEADER.size + len(body), zlib.crc32(body))
+    return header + bytes(body) + tail
+
+
+def parse_binary(data):
+    """Records and names; raises ValueError on a damaged file or an unsupported version."""
+    magic, version, flags, _, count, _, records_end, crc = HEADER.unpack_from(data)
+    if magic != MAGIC or not 1 <= version <= VERSION:
+        raise ValueError("not a codes file of a supported version")
+    if zlib.crc32(data[HEADER.size:records_end]) != crc:
+        raise ValueError("checksum mismatch")
+
+    records = []
+    pos = HEADER.size
+    prev = 0
+    for _ in range(count):
+        length, pos = read_varint(data, pos)
+        end = pos + length
+        fields = []
+        while pos < end and len(fields) < RECORD_FIELDS:
+            value, pos = read_varint(data, pos)
+            fields.append(value)
+        fields += [0] * (RECORD_FIELDS - len(fields))
+        pos = end  # Fields of newer versions are skipped
+        prev += unzigzag(fields[0])
+        records.append((prev, unzigzag(fields[1]), fields[2], fields[3], fields[4]))
+
+    names = []
+    if flags & FLAG_NAMES:
+        pos = records_end
+        total, pos = read_varint(data, pos)
+        for _ in range(total):
+            code_id, pos = read_varint(data, pos)
+            length, pos = read_varint(data, pos)
+            names.append((data[pos:pos + length].decode("ascii"), code_id))
+            pos += length
+    return records, names
+
+
+def load_names(path, records):
+    ids = {r[0] for r in records}
+    names = []
+    with open(path, encoding="ascii") as f:
+        for line in f:
+            parts = line.split()
+            if len(parts) == 2 and parts[1].isdigit() and int(parts[1]) in ids:
+                names.append((parts[0].lower(), int(parts[1])))
+    return names
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("input")
+    parser.add_argument("output", nargs="?")
+    parser.add_argument("--names", help="codeNames.txt to embed into the binary output")
+    parser.add_argument("--compare", action="store_true", help="print the size of both formats")
+    args = parser.parse_args()
+
+    with open(args.input, "rb") as f:
+        data = f.read()
+
+    binary = data[:4] == MAGIC
+    try:
+        records, names = parse_binary(data) if binary else (parse_text(data), [])
+    except (ValueError, struct.error) as e:
+        sys.exit("%s: %s" % (args.input, e))
+
+    if args.names:
+        names = load_names(args.names, records)
+
+    text_data = encode_text(records)
+    bin_data = encode_binary(records, names)
+
+    if args.compare or not args.output:
+        print("%d codes, %d names" % (len(records), len(names)))
+        print("text:   %8d bytes" % len(text_data))
+        print("binary: %8d bytes (%.0f%% of text)" % (len(bin_data), 100.0 * len(bin_data) / max(1, len(text_data))))
+
+    if args.output:
+        with open(args.output, "wb") as f:
+            f.write(text_data if binary else bin_data)
+
+
+if __name__ == "__main__":
+    main()
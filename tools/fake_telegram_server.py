@@ -0,0 +1,379 @@
+#!/usr/bin/env python3
+"""Local stand-in for the Telegram Bot API and a load test of the IR remote firmware.
+
+Point TELEGRAM_API_HOST / TELEGRAM_API_PORT / TELEGRAM_API_TLS in src/config.h at this
+server, flash the device and run, e.g.:
+
+    python3 tools/fake_telegram_server.py --chat-id 12345 --rate 5 --burst 20 --burst-every 15 \
+        --latency-ms 80 --p429 0.05 --pdrop 0.02 --duration 120
+
+The server injects updates (steady rate and bursts), serves them through getUpdates with
+long polling, and answers sendMessage, editMessageText, answerCallbackQuery and sendDocument.
+Faults - added latency, 429 responses with retry_after and dropped connections - are applied
+to every request. At the end it reports commands/sec, reply latency and retry amplification.
+
+Command kinds (--mix):
+    status  "/status"; one reply, handled entirely by the network task
+    button  inline button "c:<id>"; matched by its answerCallbackQuery
+    code    unknown code "<id>" (ids from --code-base); the main loop replies "Code ID <id> not found."
+
+Only the Python standard library is used.
+"""
+
+import argparse
+import collections
+import json
+import random
+import re
+import ssl
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+SEND_METHODS = ("sendMessage", "editMessageText", "answerCallbackQuery", "sendDocument")
+
+
+class Command:
+    """One injected update and its timeline (time.monotonic())."""
+
+    def __init__(self, update_id, kind, key):
+        self.update_id = update_id
+        self.kind = kind
+        self.key = key
+        self.injected = time.monotonic()
+        self.delivered = None
+        self.acked = None
+        self.replied = None
+
+
+class FakeBot:
+    def __init__(self, args):
+        self.args = args
+        self.cond = threading.Condition()
+        self.next_update_id = 1
+        self.next_key = args.code_base
+        self.pending = []  # Еще не подтверждены offset в getUpdates
+        self.awaiting = {}  # Ключ ответа -> команда
+        self.status_fifo = collections.deque()  # Ответы /status одинаковы: сопоставляются по порядку
+        self.commands = []
+        self.requests = collections.Counter()  # (method, outcome) -> count
+        self.unmatched_replies = 0
+        self.duplicate_replies = 0
+
+    # --- Injection ---
+
+    def inject(self, kind):
+        with self.cond:
+            key = self.next_key
+            self.next_key += 1
+            command = Command(self.next_update_id, kind, key)
+            self.next_update_id += 1
+            self.pending.append(command)
+            self.commands.append(command)
+            self.cond.notify_all()
+
+    def update_json(self, command):
+        chat = {"id": self.args.chat_id, "type": "private"}
+
+        if command.kind == "button":
+            return {
+                "update_id": command.update_id,
+                "callback_query": {
+                    "id": "cb%d" % command.key,
+                    "data": "c:%d" % command.key,
+                    "message": {"message_id": 1, "chat": chat},
+                },
+            }
+
+        text = "/status" if command.kind == "status" else str(command.key)
+        return {
+            "update_id": command.update_id,
+            "message": {"message_id": command.update_id, "chat": chat, "text": text},
+        }
+
+    # --- Bot API methods ---
+
+    def get_updates(self, offset, limit, timeout):
+        deadline = time.monotonic() + timeout
+
+        with self.cond:
+            now = time.monotonic()
+            while self.pending and self.pending[0].update_id < offset:
+                command = self.pending.pop(0)
+                command.acked = now
+
+            while not self.pending:
+                remaining = deadline - time.monotonic()
+                if remaining <= 0:
+                    break
+                self.cond.wait(remaining)
+
+            batch = self.pending[:limit]
+            now = time.monotonic()
+
+            for command in batch:
+                if command.delivered is not None:
+                    continue  # Повторная выдача: устройство не подтвердило прошлый пакет
+                command.delivered = now
+                if command.kind == "status":
+                    self.status_fifo.append(command)
+                elif command.kind == "button":
+                    self.awaiting["cb%d" % command.key] = command
+                else:
+                    self.awaiting["code%d" % command.key] = command
+
+            return [self.update_json(c) for c in batch]
+
+    def reply(self, key):
+        with self.cond:
+            command = self.awaiting.get(key)
+            if command is None and key == "status" and self.status_fifo:
+                command = self.status_fifo.popleft()
+
+            if command is None:
+                self.unmatched_replies += 1
+            elif command.replied is not None:
+                self.duplicate_replies += 1
+            else:
+                command.replied = time.monotonic()
+
+    def send_message(self, body):
+        text = body.get("text", "")
+        match = re.match(r"Code ID (\d+) not found", text)
+
+        if text.startswith("System status"):
+            self.reply("status")
+        elif match:
+            self.reply("code" + match.group(1))
+        else:
+            with self.cond:
+                self.unmatched_replies += 1
+
+    # --- Report ---
+
+    def report(self, start, final):
+        elapsed = time.monotonic() - start
+
+        with self.cond:
+            commands = list(self.commands)
+            requests = collections.Counter(self.requests)
+            unmatched = self.unmatched_replies
+            duplicates = self.duplicate_replies
+
+        kinds = collections.Counter(c.kind for c in commands)
+        delivered = [c for c in commands if c.delivered is not None]
+        acked = [c for c in commands if c.acked is not None]
+        replied = [c for c in commands if c.replied is not None]
+
+        if not final:
+            print("[%5.0f s] injected %d, delivered %d, replied %d, requests %d"
+                  % (elapsed, len(commands), len(delivered), len(replied), sum(requests.values())))
+            return
+
+        def ms_stats(values):
+            if not values:
+                return "n/a"
+            values = sorted(values)
+            pick = lambda q: values[min(len(values) - 1, int(q * len(values)))] * 1000
+            return "avg %.0f ms, p50 %.0f, p95 %.0f, max %.0f ms" % (
+                sum(values) / len(values) * 1000, pick(0.5), pick(0.95), values[-1] * 1000)
+
+        send_total = sum(n for (method, _), n in requests.items() if method in SEND_METHODS)
+        send_ok = sum(n for (method, outcome), n in requests.items() if method in SEND_METHODS and outcome == "200")
+        all_requests = sum(requests.values())
+
+        print()
+        print("Load test: %.1f s, %d commands injected (%s)"
+              % (elapsed, len(commands), ", ".join("%s %d" % kv for kv in sorted(kinds.items()))))
+        # Скорость - до последнего ответа, без хвоста ожидания
+        active = max(c.replied for c in replied) - start if replied else 0
+        print("Delivered %d, confirmed %d, replied %d: %.2f commands/s"
+              % (len(delivered), len(acked), len(replied), len(replied) / active if active > 0 else 0))
+        print("Queueing (injection -> getUpdates): " + ms_stats([c.delivered - c.injected for c in delivered]))
+        print("Reply latency (getUpdates -> reply): " + ms_stats([c.replied - c.delivered for c in replied]))
+        print("Unmatched replies: %d, duplicate replies: %d" % (unmatched, duplicates))
+        print("Requests:")
+        for method in sorted({m for m, _ in requests}):
+            outcomes = {o: n for (m, o), n in requests.items() if m == method}
+            print("  %-20s %6d  (%s)" % (method, sum(outcomes.values()),
+                                         ", ".join("%s: %d" % kv for kv in sorted(outcomes.items()))))
+        print("Retry amplification: %.2f send requests per delivered reply, %.2f requests per command"
+              % (send_total / send_ok if send_ok else 0, all_requests / len(commands) if commands else 0))
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # Keep-alive, как ожидает прошивка
+    bot = None
+
+    def log_message(self, fmt, *args):
+        if self.bot.args.verbose:
+            super().log_message(fmt, *args)
+
+    def do_GET(self):
+        self.handle_request(b"")
+
+    def do_POST(self):
+        length = int(self.headers.get("Content-Length", 0))
+        self.handle_request(self.rfile.read(length))
+
+    def send_json(self, status, payload):
+        data = json.dumps(payload).encode()
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+    def handle_request(self, body):
+        args = self.bot.args
+        url = urlparse(self.path)
+        parts = url.path.strip("/").split("/")
+
+        if len(parts) != 2 or not parts[0].startswith("bot") or (args.token and parts[0][3:] != args.token):
+            self.send_json(404, {"ok": False, "error_code": 404, "description": "Not Found"})
+            return
+
+        method = parts[1]
+
+        # Разорванное соединение: ответа нет, клиент увидит закрытый сокет
+        if random.random() < args.pdrop:
+            self.count(method, "dropped")
+            self.close_connection = True
+            return
+
+        if args.latency_ms or args.jitter_ms:
+            time.sleep(max(0, args.latency_ms + random.uniform(-args.jitter_ms, args.jitter_ms)) / 1000)
+
+        if random.random() < args.p429:
+            self.count(method, "429")
+            self.send_json(429, {"ok": False, "error_code": 429,
+                                 "description": "Too Many Requests: retry after %d" % args.retry_after,
+                                 "parameters": {"retry_after": args.retry_after}})
+            return
+
+        if method == "getUpdates":
+            query = parse_qs(url.query)
+            offset = int(query.get("offset", ["0"])[0])
+            limit = int(query.get("limit", ["100"])[0])
+            timeout = min(int(query.get("timeout", ["0"])[0]), 50)
+            result = self.bot.get_updates(offset, limit, timeout)
+            self.count(method, "200")
+            self.send_json(200, {"ok": True, "result": result})
+        elif method in ("sendMessage", "editMessageText"):
+            payload = json.loads(body or b"{}")
+            self.bot.send_message(payload)
+            self.count(method, "200")
+            self.send_json(200, {"ok": True, "result": {"message_id": 1}})
+        elif method == "answerCallbackQuery":
+            payload = json.loads(body or b"{}")
+            self.bot.reply(payload.get("callback_query_id", ""))
+            self.count(method, "200")
+            self.send_json(200, {"ok": True, "result": True})
+        elif method == "sendDocument":
+            self.count(method, "200")
+            self.send_json(200, {"ok": True, "result": {"message_id": 1}})
+        else:
+            self.count(method, "400")
+            self.send_json(400, {"ok": False, "error_code": 400, "description": "Bad Request: not supported"})
+
+    def count(self, method, outcome):
+        with self.bot.cond:
+            self.bot.requests[(method, outcome)] += 1
+
+
+def inject_loop(bot, args, stop):
+    kinds = args.mix.split(",")
+    start = time.monotonic()
+    next_steady = start
+    next_burst = start + args.burst_every if args.burst else float("inf")
+    n = 0
+
+    while not stop.is_set() and time.monotonic() - start < args.duration:
+        now = time.monotonic()
+
+        if args.rate > 0 and now >= next_steady:
+            bot.inject(kinds[n % len(kinds)])
+            n += 1
+            next_steady += 1.0 / args.rate
+
+        if now >= next_burst:
+            for _ in range(args.burst):
+                bot.inject(kinds[n % len(kinds)])
+                n += 1
+            next_burst += args.burst_every
+
+        time.sleep(0.002)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--listen", default="0.0.0.0", help="address to listen on")
+    parser.add_argument("--port", type=int, default=8081)
+    parser.add_argument("--cert", help="PEM certificate: serve HTTPS (TELEGRAM_API_TLS true)")
+    parser.add_argument("--key", help="PEM private key for --cert")
+    parser.add_argument("--token", default="", help="accept only this BOT_TOKEN (default: any)")
+    parser.add_argument("--chat-id", type=int, required=True, help="CHAT_ID of the firmware")
+    parser.add_argument("--mix", default="status", help="comma-separated command kinds: status, button, code")
+    parser.add_argument("--code-base", type=int, default=900000, help="first id for button/code commands (must not exist)")
+    parser.add_argument("--rate", type=float, default=2.0, help="steady commands per second")
+    parser.add_argument("--burst", type=int, default=0, help="commands injected at once every --burst-every s")
+    parser.add_argument("--burst-every", type=float, default=10.0)
+    parser.add_argument("--latency-ms", type=float, default=0, help="added to every response")
+    parser.add_argument("--jitter-ms", type=float, default=0)
+    parser.add_argument("--p429", type=float, default=0, help="share of requests answered 429")
+    parser.add_argument("--retry-after", type=int, default=1, help="retry_after in 429 responses, s")
+    parser.add_argument("--pdrop", type=float, default=0, help="share of requests whose connection is dropped")
+    parser.add_argument("--duration", type=float, default=60, help="injection time, s")
+    parser.add_argument("--drain", type=float, default=10, help="wait for outstanding replies after injection, s")
+    parser.add_argument("--report-every", type=float, default=10)
+    parser.add_argument("--seed", type=int)
+    parser.add_argument("--verbose", action="store_true", help="log every request")
+    args = parser.parse_args()
+
+    if args.seed is not None:
+        random.seed(args.seed)
+
+    bot = FakeBot(args)
+    Handler.bot = bot
+    server = ThreadingHTTPServer((args.listen, args.port), Handler)
+    server.daemon_threads = True
+
+    if args.cert:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(args.cert, args.key)
+        server.socket = context.wrap_socket(server.socket, server_side=True)
+
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    print("Fake Bot API on %s://%s:%d, waiting for the first getUpdates..."
+          % ("https" if args.cert else "http", args.listen, args.port))
+
+    # Отсчет начинается с первого опроса: устройство может еще подключаться к WiFi
+    while not bot.requests:
+        time.sleep(0.1)
+
+    stop = threading.Event()
+    start = time.monotonic()
+    injector = threading.Thread(target=inject_loop, args=(bot, args, stop), daemon=True)
+    injector.start()
+
+    try:
+        next_report = start + args.report_every
+        while injector.is_alive() or time.monotonic() - start < args.duration + args.drain:
+            with bot.cond:
+                outstanding = any(c.replied is None for c in bot.commands)
+            if not injector.is_alive() and not outstanding:
+                break
+            if time.monotonic() >= next_report:
+                bot.report(start, False)
+                next_report += args.report_every
+            time.sleep(0.1)
+    except KeyboardInterrupt:
+        stop.set()
+
+    bot.report(start, True)
+    server.shutdown()
+
+
+if __name__ == "__main__":
+    main()